@@ -0,0 +1,176 @@
+/**
+ * Composition benchmark: the same nested parallel workload (see compose.h)
+ * run on lithe, on nested pthread pools and on nested OpenMP.
+ *
+ * This driver runs each of bench_compose_lithe, bench_compose_pthread and
+ * bench_compose_omp (whichever were built, from the directory it lives in) as
+ * a child process, passing its arguments through, and reports for each, as a
+ * line of JSON: the mean wall time of one repetition, and the context switches
+ * and last level cache misses of the whole child process. Context switches
+ * come from getrusage(), and cache misses from a perf_event counter inherited
+ * by all of the child's threads, or are -1 where perf counters aren't
+ * available (e.g. under a restrictive perf_event_paranoid).
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <errno.h>
+#include <limits.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#ifdef HAVE_LINUX_PERF_EVENT_H
+#include <linux/perf_event.h>
+#endif
+#include "compose.h"
+
+static const char *runtimes[] = { "lithe", "pthread", "omp" };
+
+/* Open a counter of last level cache misses for process 'pid' and every
+ * thread it creates from now on, starting when it calls exec(). Returns -1 if
+ * that isn't possible. */
+static int open_llc_counter(pid_t pid)
+{
+#ifdef HAVE_LINUX_PERF_EVENT_H
+  struct perf_event_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = PERF_TYPE_HARDWARE;
+  attr.config = PERF_COUNT_HW_CACHE_MISSES;
+  attr.disabled = 1;
+  attr.enable_on_exec = 1;
+  attr.inherit = 1;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  return syscall(SYS_perf_event_open, &attr, pid, -1, -1, 0);
+#else
+  return -1;
+#endif
+}
+
+/* Run 'path' with 'argv', and fill in its wall time per repetition (from its
+ * output), context switches and cache misses. Returns 0 on success. */
+static int run_child(const char *path, char **argv, long long *wall_ns,
+                     long *voluntary, long *involuntary, long long *llc_misses)
+{
+  int out[2], go[2];
+  if (pipe(out) || pipe(go))
+    return errno;
+
+  struct rusage before, after;
+  getrusage(RUSAGE_CHILDREN, &before);
+
+  pid_t pid = fork();
+  if (pid < 0)
+    return errno;
+  if (pid == 0) {
+    /* Wait for the parent to attach its counter before exec'ing */
+    char c;
+    close(out[0]);
+    close(go[1]);
+    dup2(out[1], STDOUT_FILENO);
+    if (read(go[0], &c, 1) != 1)
+      _exit(127);
+    execv(path, argv);
+    _exit(127);
+  }
+
+  close(out[1]);
+  close(go[0]);
+  int llc = open_llc_counter(pid);
+  if (write(go[1], "g", 1) != 1)
+    return errno;
+  close(go[1]);
+
+  char buf[1024];
+  size_t len = 0;
+  ssize_t n;
+  while ((n = read(out[0], buf + len, sizeof(buf) - 1 - len)) > 0)
+    len += n;
+  buf[len] = '\0';
+  close(out[0]);
+
+  int status;
+  waitpid(pid, &status, 0);
+  getrusage(RUSAGE_CHILDREN, &after);
+  if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+    if (llc >= 0)
+      close(llc);
+    return ECHILD;
+  }
+
+  const char *wall = strstr(buf, "\"wall_ns\": ");
+  *wall_ns = wall ? atoll(wall + strlen("\"wall_ns\": ")) : -1;
+  *voluntary = after.ru_nvcsw - before.ru_nvcsw;
+  *involuntary = after.ru_nivcsw - before.ru_nivcsw;
+
+  /* The child and all of its threads have exited, so the counter holds their
+   * total */
+  *llc_misses = -1;
+  if (llc >= 0) {
+    uint64_t count;
+    if (read(llc, &count, sizeof(count)) == sizeof(count))
+      *llc_misses = count;
+    close(llc);
+  }
+  return 0;
+}
+
+int main(int argc, char **argv)
+{
+  /* Parse the arguments here too, to calibrate the work once for all of the
+   * runtimes and report the parameters */
+  compose_params_t params;
+  if (compose_parse(argc, argv, &params))
+    return 1;
+
+  char dir[PATH_MAX];
+  snprintf(dir, sizeof(dir), "%s", argv[0]);
+  char *slash = strrchr(dir, '/');
+  if (slash)
+    *slash = '\0';
+  else
+    snprintf(dir, sizeof(dir), ".");
+
+  char outer[16], inner[16], threads[16], work[32], repetitions[16];
+  snprintf(outer, sizeof(outer), "%d", params.outer);
+  snprintf(inner, sizeof(inner), "%d", params.inner);
+  snprintf(threads, sizeof(threads), "%d", params.threads);
+  snprintf(work, sizeof(work), "%llu", (unsigned long long)params.work);
+  snprintf(repetitions, sizeof(repetitions), "%d", params.repetitions);
+
+  for (int i = 0; i < sizeof(runtimes) / sizeof(runtimes[0]); i++) {
+    char path[PATH_MAX + 32];
+    snprintf(path, sizeof(path), "%s/bench_compose_%s", dir, runtimes[i]);
+    if (access(path, X_OK) != 0) {
+      fprintf(stderr, "compose: %s not built, skipping\n", path);
+      continue;
+    }
+
+    char *child_argv[] = { path, "-o", outer, "-i", inner, "-t", threads,
+                           "-w", work, "-r", repetitions, NULL };
+    long long wall_ns, llc_misses;
+    long voluntary, involuntary;
+    int ret = run_child(path, child_argv, &wall_ns, &voluntary, &involuntary,
+                        &llc_misses);
+    if (ret) {
+      fprintf(stderr, "compose: %s failed: %s\n", path, strerror(ret));
+      return 1;
+    }
+
+    printf("{\"benchmark\": \"compose\", \"runtime\": \"%s\", \"outer\": %d, "
+           "\"inner\": %d, \"threads\": %d, \"granularity_ns\": %ld, "
+           "\"repetitions\": %d, \"wall_ns\": %lld, "
+           "\"voluntary_switches\": %ld, \"involuntary_switches\": %ld, "
+           "\"llc_misses\": %lld}\n",
+           runtimes[i], params.outer, params.inner, params.threads,
+           params.granularity, params.repetitions, wall_ns, voluntary,
+           involuntary, llc_misses);
+    fflush(stdout);
+  }
+  return 0;
+}
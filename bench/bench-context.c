@@ -0,0 +1,129 @@
+/**
+ * Context benchmarks: the latency of yielding a context back to its
+ * scheduler, and of a block/unblock round trip between two contexts.
+ *
+ * Also built as bench_context_traced (with LITHE_TRACE defined) against a
+ * build of the library with the event tracer compiled in. That runs both
+ * benchmarks with tracing stopped and started, and times recording a single
+ * trace event.
+ */
+
+#include <parlib/parlib.h>
+#include "bench.h"
+#ifdef LITHE_TRACE
+#include <src/trace.h>
+#include <src/internal/trace.h>
+
+/* Events recorded per sample, to amortize reading the clock */
+#define TRACE_BATCH 100
+#endif
+
+/* Spins the waker makes before yielding its hart anyway */
+#define WAKER_SPINS 1024
+
+static int iterations;
+static bench_samples_t samples;
+
+static void yielder(void *arg)
+{
+  for (int i = 0; i < iterations; i++) {
+    uint64_t t0 = bench_now();
+    lithe_context_yield();
+    bench_samples_add(&samples, bench_now() - t0);
+  }
+}
+
+static lithe_context_t * volatile blocked;
+static volatile bool waiter_done;
+
+static void publish_blocked(lithe_context_t *context, void *arg)
+{
+  blocked = context;
+}
+
+/* Blocks over and over, timing how long it takes to be woken up and run
+ * again. */
+static void waiter(void *arg)
+{
+  for (int i = 0; i < iterations; i++) {
+    uint64_t t0 = bench_now();
+    lithe_context_block(publish_blocked, NULL);
+    bench_samples_add(&samples, bench_now() - t0);
+  }
+  waiter_done = true;
+}
+
+/* Unblocks the waiter as soon as it has blocked. Spins while there are
+ * other harts to run the waiter on, but still yields every WAKER_SPINS spins
+ * in case the waiter is queued behind us on our own hart (e.g. when the
+ * scheduler was granted a single hart, or the harts are oversubscribed). */
+static void waker(void *arg)
+{
+  int spins = 0;
+  while (!waiter_done) {
+    lithe_context_t *context = blocked;
+    if (context && __sync_bool_compare_and_swap(&blocked, context, NULL)) {
+      lithe_context_unblock(context);
+      spins = 0;
+    }
+    else if (max_harts() > 1 && ++spins < WAKER_SPINS) {
+      cpu_relax();
+    }
+    else {
+      lithe_context_yield();
+      spins = 0;
+    }
+  }
+}
+
+static void block_unblock(void *arg)
+{
+  if ((long)arg == 0)
+    waiter(arg);
+  else
+    waker(arg);
+}
+
+#ifdef LITHE_TRACE
+static void trace_events(void *arg)
+{
+  for (int i = 0; i < iterations; i++) {
+    uint64_t t0 = bench_now();
+    for (int j = 0; j < TRACE_BATCH; j++)
+      __lithe_trace(CONTEXT_YIELD, j, 0);
+    bench_samples_add(&samples, (bench_now() - t0) / TRACE_BATCH);
+  }
+}
+#endif
+
+static void run_all(const char *param, long value)
+{
+  bench_run_contexts(1, yielder);
+  bench_report("context_yield", param, value, &samples);
+
+  blocked = NULL;
+  waiter_done = false;
+  bench_run_contexts(2, block_unblock);
+  bench_report("context_block_unblock", param, value, &samples);
+}
+
+int main()
+{
+  iterations = bench_iterations(100000);
+  bench_samples_init(&samples, iterations);
+
+#ifdef LITHE_TRACE
+  run_all("trace", 0);
+  if (lithe_trace_start() != 0)
+    abort();
+  run_all("trace", 1);
+  bench_run_contexts(1, trace_events);
+  bench_report("trace_event", NULL, 0, &samples);
+  lithe_trace_stop();
+#else
+  run_all(NULL, 0);
+#endif
+
+  bench_samples_destroy(&samples);
+  return 0;
+}
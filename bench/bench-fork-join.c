@@ -0,0 +1,78 @@
+/**
+ * Fork-join scheduler benchmarks: the time to spawn and join a scheduler's
+ * worth of contexts as the fan-out grows, and the latency of another hart
+ * picking up (stealing) a context made runnable by a busy one.
+ */
+
+#include <parlib/parlib.h>
+#include "bench.h"
+
+#define MAX_FANOUT 1024
+
+static int iterations;
+static bench_samples_t samples;
+static bench_samples_t per_context;
+
+static void empty(void *arg)
+{
+}
+
+static void spawn_join(int fanout)
+{
+  for (int i = 0; i < iterations; i++) {
+    uint64_t t0 = bench_now();
+    bench_run_contexts(fanout, empty);
+    uint64_t t = bench_now() - t0;
+    bench_samples_add(&samples, t);
+    bench_samples_add(&per_context, t / fanout);
+  }
+  bench_report("fork_join_spawn_join", "fanout", fanout, &samples);
+  bench_report("fork_join_spawn_join_per_context", "fanout", fanout, &per_context);
+}
+
+struct probe {
+  uint64_t start;
+  volatile uint64_t started;
+};
+
+static void probe_run(void *arg)
+{
+  struct probe *p = arg;
+  p->started = bench_now();
+}
+
+/* The creating context keeps its hart busy until the new context has started,
+ * so every sample is the time for some other hart to find and run it. */
+static void steal(void *arg)
+{
+  lithe_fork_join_sched_t *sched = (void*)lithe_sched_current();
+  for (int i = 0; i < iterations; i++) {
+    struct probe p = { bench_now(), 0 };
+    lithe_fork_join_context_create(sched, BENCH_STACK_SIZE, probe_run, &p);
+    while (!p.started)
+      cpu_relax();
+    bench_samples_add(&samples, p.started - p.start);
+  }
+}
+
+int main()
+{
+  iterations = bench_iterations(1000);
+  bench_samples_init(&samples, iterations);
+  bench_samples_init(&per_context, iterations);
+
+  for (int fanout = 1; fanout; fanout = bench_next_count(fanout, MAX_FANOUT))
+    spawn_join(fanout);
+
+  if (max_harts() > 1) {
+    bench_run_contexts(1, steal);
+    bench_report("fork_join_steal", NULL, 0, &samples);
+  }
+  else {
+    fprintf(stderr, "fork_join_steal: needs at least 2 harts, skipping\n");
+  }
+
+  bench_samples_destroy(&per_context);
+  bench_samples_destroy(&samples);
+  return 0;
+}
@@ -0,0 +1,116 @@
+/**
+ * Hart grant and yield latency across a 3-level scheduler hierarchy: a
+ * fork-join scheduler, nested inside a second one, nested inside a third.
+ *
+ * Every iteration, a busy context in the innermost (leaf) scheduler creates a
+ * new context. The leaf's hart request propagates up to the top scheduler,
+ * and the hart it is eventually granted is passed all the way back down to run
+ * that context ('hierarchy_hart_grant'). Once the context finishes, the leaf
+ * has nothing left for that hart to do, so it is yielded back up until it
+ * reaches the top scheduler ('hierarchy_hart_yield').
+ */
+
+#include <parlib/parlib.h>
+#include "bench.h"
+
+static int iterations;
+static bench_samples_t grant_samples;
+static bench_samples_t yield_samples;
+
+/* Per hart: when the hart last started yielding out of the leaf, or 0 */
+static volatile uint64_t *yield_start;
+
+/* The top scheduler is a fork-join scheduler that also notes how long each
+ * hart returned to it took to get there. */
+static lithe_sched_funcs_t top_funcs;
+
+static void top_hart_return(lithe_sched_t *__this, lithe_sched_t *child)
+{
+  uint64_t t0 = yield_start[hart_id()];
+  if (t0) {
+    bench_samples_add(&yield_samples, bench_now() - t0);
+    yield_start[hart_id()] = 0;
+  }
+  lithe_fork_join_sched_hart_return(__this, child);
+}
+
+struct probe {
+  uint64_t start;
+  volatile uint64_t started;
+  volatile int hart;
+};
+
+static void probe_run(void *arg)
+{
+  struct probe *p = arg;
+  uint64_t now = bench_now();
+  p->hart = hart_id();
+  yield_start[p->hart] = now;
+  wmb();
+  p->started = now;
+}
+
+static void leaf_main(lithe_fork_join_sched_t *leaf)
+{
+  for (int i = 0; i < iterations; i++) {
+    struct probe p = { bench_now(), 0, -1 };
+    lithe_fork_join_context_create(leaf, BENCH_STACK_SIZE, probe_run, &p);
+    while (!p.started)
+      cpu_relax();
+    bench_samples_add(&grant_samples, p.started - p.start);
+
+    /* Give the hart a chance to make it back to the top before the next
+     * request, so the two don't overlap. */
+    uint64_t deadline = bench_now() + 1000000;
+    while (yield_start[p.hart] && bench_now() < deadline)
+      cpu_relax();
+    yield_start[p.hart] = 0;
+  }
+}
+
+int main()
+{
+  if (max_harts() < 2) {
+    fprintf(stderr, "hierarchy: needs at least 2 harts, skipping\n");
+    return 0;
+  }
+
+  iterations = bench_iterations(10000);
+  bench_samples_init(&grant_samples, iterations);
+  bench_samples_init(&yield_samples, iterations);
+  yield_start = calloc(max_harts(), sizeof(uint64_t));
+
+  top_funcs = lithe_fork_join_sched_funcs;
+  top_funcs.hart_return = top_hart_return;
+
+  lithe_fork_join_sched_t *top = lithe_fork_join_sched_create();
+  top->sched.funcs = &top_funcs;
+  lithe_sched_enter((lithe_sched_t*)top);
+
+  lithe_fork_join_sched_t *middle = lithe_fork_join_sched_create();
+  lithe_sched_enter((lithe_sched_t*)middle);
+
+  lithe_fork_join_sched_t *leaf = lithe_fork_join_sched_create();
+  lithe_sched_enter((lithe_sched_t*)leaf);
+  leaf_main(leaf);
+  lithe_fork_join_sched_join_all(leaf);
+  lithe_sched_exit();
+  lithe_fork_join_sched_destroy(leaf);
+
+  /* The middle and top schedulers never had any contexts of their own */
+  lithe_sched_exit();
+  lithe_fork_join_sched_destroy(middle);
+
+  lithe_sched_exit();
+  /* Schedulers are recycled, so hand it back the way we found it */
+  top->sched.funcs = &lithe_fork_join_sched_funcs;
+  lithe_fork_join_sched_destroy(top);
+
+  bench_report("hierarchy_hart_grant", NULL, 0, &grant_samples);
+  bench_report("hierarchy_hart_yield", NULL, 0, &yield_samples);
+
+  free((void*)yield_start);
+  bench_samples_destroy(&yield_samples);
+  bench_samples_destroy(&grant_samples);
+  return 0;
+}
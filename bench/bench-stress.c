@@ -0,0 +1,228 @@
+/**
+ * Scalability stress test for deep and wide scheduler hierarchies.
+ *
+ * Builds a tree of 'depth' levels under the base scheduler. At every level,
+ * each node either enters a fresh fork-join scheduler and runs its 'fanout'
+ * children in contexts of it ("fj"), or runs its children one after the other
+ * in its own context without a scheduler of its own ("inline"), as a serial
+ * library would. The leaves burn 'granularity' ns of CPU time each, blocking
+ * and being unblocked halfway through with the given probability, which sends
+ * hart requests up and down the hierarchy.
+ *
+ * Reports, as one line of JSON: leaf throughput; how often a context resumed
+ * on a different hart than it blocked on; how long the hierarchy took to
+ * drain after the last leaf finished; and how long until every hart but the
+ * main one had been handed back to the system (time to quiesce, or -1 if that
+ * took longer than a second).
+ */
+
+#include <getopt.h>
+#include <stdbool.h>
+#include <string.h>
+#include <parlib/parlib.h>
+#include "bench.h"
+
+#define MAX_DEPTH 16
+#define QUIESCE_TIMEOUT_NS 1000000000ULL
+
+enum { SCHED_FJ, SCHED_INLINE };
+static const char *sched_names[] = { "fj", "inline" };
+
+static int depth = 3;
+static int fanout = 4;
+static long granularity = 10000;
+static int block_pct = 10;
+static long stack_size = BENCH_STACK_SIZE;
+static int repetitions = 10;
+static int sched_types[MAX_DEPTH];
+
+static volatile uint64_t leaves_left;
+static volatile uint64_t last_leaf_done;
+static volatile uint64_t leaf_seed;
+/* Reset for every repetition, and reported as per-repetition averages */
+static volatile uint64_t resumes;
+static volatile uint64_t migrations;
+
+static void usage(const char *prog)
+{
+  fprintf(stderr,
+    "usage: %s [-d depth] [-f fanout] [-g granularity_ns] [-b block_pct]\n"
+    "       [-k stack_size] [-r repetitions] [-s type[,type...]]\n"
+    "  type is 'fj' or 'inline', one per level from the top; the last one\n"
+    "  given is repeated for any deeper levels\n", prog);
+}
+
+static int parse_sched_types(char *s)
+{
+  int n = 0;
+  for (char *tok = strtok(s, ","); tok; tok = strtok(NULL, ",")) {
+    if (n == MAX_DEPTH)
+      return -1;
+    if (strcmp(tok, "fj") == 0)
+      sched_types[n++] = SCHED_FJ;
+    else if (strcmp(tok, "inline") == 0)
+      sched_types[n++] = SCHED_INLINE;
+    else
+      return -1;
+  }
+  if (n == 0)
+    return -1;
+  for (int i = n; i < MAX_DEPTH; i++)
+    sched_types[i] = sched_types[n - 1];
+  return 0;
+}
+
+static void spin(long ns)
+{
+  uint64_t end = bench_now() + ns;
+  while (bench_now() < end)
+    cpu_relax();
+}
+
+static void unblock_now(lithe_context_t *context, void *arg)
+{
+  lithe_context_unblock(context);
+}
+
+/* Note whether the calling context came back on the hart it left from */
+static void count_resume(int hart)
+{
+  __sync_fetch_and_add(&resumes, 1);
+  if (hart_id() != hart)
+    __sync_fetch_and_add(&migrations, 1);
+}
+
+static void leaf()
+{
+  uint64_t seed = __sync_fetch_and_add(&leaf_seed, 1) * 0x9E3779B97F4A7C15ULL;
+  spin(granularity / 2);
+
+  /* Leaves under nothing but "inline" levels run in the main context of the
+   * base scheduler, which isn't ours to block */
+  bool can_block = lithe_sched_current()->parent != NULL;
+  if (can_block && (seed >> 33) % 100 < (uint64_t)block_pct) {
+    int hart = hart_id();
+    lithe_context_block(unblock_now, NULL);
+    count_resume(hart);
+  }
+  spin(granularity - granularity / 2);
+
+  if (__sync_sub_and_fetch(&leaves_left, 1) == 0)
+    last_leaf_done = bench_now();
+}
+
+static void node(int level);
+
+static void node_main(void *arg)
+{
+  node((long)arg);
+}
+
+static void node(int level)
+{
+  if (level == depth) {
+    leaf();
+    return;
+  }
+
+  if (sched_types[level] == SCHED_INLINE) {
+    for (int i = 0; i < fanout; i++)
+      node(level + 1);
+    return;
+  }
+
+  lithe_fork_join_sched_t *sched = lithe_fork_join_sched_create();
+  lithe_sched_enter((lithe_sched_t*)sched);
+  for (int i = 0; i < fanout; i++)
+    lithe_fork_join_context_create(sched, stack_size, node_main,
+                                   (void*)(long)(level + 1));
+  int hart = hart_id();
+  lithe_fork_join_sched_join_all(sched);
+  count_resume(hart);
+  lithe_sched_exit();
+  lithe_fork_join_sched_destroy(sched);
+}
+
+int main(int argc, char **argv)
+{
+  char default_types[] = "fj";
+  parse_sched_types(default_types);
+
+  int opt;
+  while ((opt = getopt(argc, argv, "d:f:g:b:k:r:s:h")) != -1) {
+    switch (opt) {
+      case 'd': depth = atoi(optarg); break;
+      case 'f': fanout = atoi(optarg); break;
+      case 'g': granularity = atol(optarg); break;
+      case 'b': block_pct = atoi(optarg); break;
+      case 'k': stack_size = atol(optarg); break;
+      case 'r': repetitions = atoi(optarg); break;
+      case 's':
+        if (parse_sched_types(optarg) == 0)
+          break;
+        /* fall through */
+      default:
+        usage(argv[0]);
+        return opt == 'h' ? 0 : 1;
+    }
+  }
+  if (depth < 1 || depth > MAX_DEPTH || fanout < 1 || granularity < 0 ||
+      block_pct < 0 || block_pct > 100 || stack_size < 16384 ||
+      repetitions < 1) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  uint64_t leaves = 1;
+  for (int i = 0; i < depth; i++)
+    leaves *= fanout;
+
+  uint64_t wall = 0, drain = 0;
+  uint64_t total_resumes = 0, total_migrations = 0;
+  int64_t quiesce = 0;
+  for (int r = 0; r < repetitions; r++) {
+    leaves_left = leaves;
+    resumes = 0;
+    migrations = 0;
+    uint64_t start = bench_now();
+    node(0);
+    uint64_t done = bench_now();
+    wall += done - start;
+    drain += done - last_leaf_done;
+    total_resumes += resumes;
+    total_migrations += migrations;
+
+    /* Wait for the idle harts to be handed back to the system */
+    while (num_vcores() > 1 && bench_now() - done < QUIESCE_TIMEOUT_NS)
+      cpu_relax();
+    if (num_vcores() > 1 || quiesce < 0)
+      quiesce = -1;
+    else
+      quiesce += bench_now() - done;
+  }
+
+  char types[MAX_DEPTH * 8] = "";
+  for (int i = 0; i < depth; i++) {
+    if (i)
+      strcat(types, ",");
+    strcat(types, sched_names[sched_types[i]]);
+  }
+
+  printf("{\"benchmark\": \"stress\", \"depth\": %d, \"fanout\": %d, "
+         "\"scheds\": \"%s\", \"granularity_ns\": %ld, \"block_pct\": %d, "
+         "\"stack_size\": %ld, \"harts\": %zu, \"repetitions\": %d, "
+         "\"leaves\": %llu, \"wall_ns\": %llu, \"leaves_per_sec\": %.1f, "
+         "\"resumes\": %llu, \"migrations\": %llu, "
+         "\"migration_rate\": %.4f, \"drain_ns\": %llu, "
+         "\"quiesce_ns\": %lld}\n",
+         depth, fanout, types, granularity, block_pct, stack_size,
+         max_harts(), repetitions, (unsigned long long)leaves,
+         (unsigned long long)(wall / repetitions),
+         (double)leaves * repetitions * 1e9 / (wall ? wall : 1),
+         (unsigned long long)(total_resumes / repetitions),
+         (unsigned long long)(total_migrations / repetitions),
+         (double)total_migrations / (total_resumes ? total_resumes : 1),
+         (unsigned long long)(drain / repetitions),
+         (long long)(quiesce < 0 ? -1 : quiesce / repetitions));
+  return 0;
+}
@@ -0,0 +1,106 @@
+/**
+ * Synchronization benchmarks: the latency of mutex, condition variable,
+ * semaphore and barrier operations with 1, 2, 4, ... up to max_harts()
+ * contexts contending for them. The fork-join scheduler asks for a hart per
+ * runnable context, so 'harts' contexts are spread over up to that many harts.
+ */
+
+#include <parlib/parlib.h>
+#include "bench.h"
+#include <src/mutex.h>
+#include <src/condvar.h>
+#include <src/semaphore.h>
+#include <src/barrier.h>
+
+static int iterations;
+static int ncontexts;
+static bench_samples_t samples;
+
+static lithe_mutex_t mutex;
+static lithe_condvar_t condvar;
+static lithe_sem_t sem;
+static lithe_barrier_t barrier;
+
+/* Time to acquire the mutex */
+static void mutex_contend(void *arg)
+{
+  for (int i = 0; i < iterations; i++) {
+    uint64_t t0 = bench_now();
+    lithe_mutex_lock(&mutex);
+    bench_samples_add(&samples, bench_now() - t0);
+    lithe_mutex_unlock(&mutex);
+  }
+}
+
+/* Time to acquire a permit of a binary semaphore */
+static void sem_contend(void *arg)
+{
+  for (int i = 0; i < iterations; i++) {
+    uint64_t t0 = bench_now();
+    lithe_sem_wait(&sem);
+    bench_samples_add(&samples, bench_now() - t0);
+    lithe_sem_post(&sem);
+  }
+}
+
+/* A token passed around a ring of contexts, each waiting on the condition
+ * variable for its turn. Measures the time from handing the token on to the
+ * next context seeing it. */
+static int turn;
+static uint64_t handoff;
+
+static void condvar_ring(void *arg)
+{
+  int id = (long)arg;
+  for (int i = 0; i < iterations; i++) {
+    lithe_mutex_lock(&mutex);
+    while (turn % ncontexts != id)
+      lithe_condvar_wait(&condvar, &mutex);
+    if (turn > 0)
+      bench_samples_add(&samples, bench_now() - handoff);
+    turn++;
+    handoff = bench_now();
+    lithe_condvar_broadcast(&condvar);
+    lithe_mutex_unlock(&mutex);
+  }
+}
+
+/* Time spent in the barrier, by every context, every round */
+static void barrier_rounds(void *arg)
+{
+  for (int i = 0; i < iterations; i++) {
+    uint64_t t0 = bench_now();
+    lithe_barrier_wait(&barrier);
+    bench_samples_add(&samples, bench_now() - t0);
+  }
+}
+
+int main()
+{
+  iterations = bench_iterations(10000);
+  bench_samples_init(&samples, (size_t)iterations * max_harts());
+
+  for (ncontexts = 1; ncontexts; ncontexts = bench_next_count(ncontexts, max_harts())) {
+    lithe_mutex_init(&mutex, NULL);
+    bench_run_contexts(ncontexts, mutex_contend);
+    bench_report("mutex_lock", "harts", ncontexts, &samples);
+
+    lithe_sem_init(&sem, 1);
+    bench_run_contexts(ncontexts, sem_contend);
+    bench_report("sem_wait", "harts", ncontexts, &samples);
+
+    lithe_mutex_init(&mutex, NULL);
+    lithe_condvar_init(&condvar);
+    turn = 0;
+    bench_run_contexts(ncontexts, condvar_ring);
+    bench_report("condvar_handoff", "harts", ncontexts, &samples);
+
+    lithe_barrier_init(&barrier, ncontexts);
+    bench_run_contexts(ncontexts, barrier_rounds);
+    bench_report("barrier_wait", "harts", ncontexts, &samples);
+    lithe_barrier_destroy(&barrier);
+  }
+
+  bench_samples_destroy(&samples);
+  return 0;
+}
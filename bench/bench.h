@@ -0,0 +1,143 @@
+/**
+ * Helpers shared by the lithe microbenchmarks.
+ *
+ * Every benchmark collects one latency sample (in nanoseconds) per measured
+ * operation and reports a summary of them as a single line of JSON on
+ * stdout, so the output of a whole run can be diffed between releases.
+ */
+
+#ifndef LITHE_BENCH_H
+#define LITHE_BENCH_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <src/lithe.h>
+#include <src/fork_join_sched.h>
+
+/* Stack size of every context the benchmarks create */
+#define BENCH_STACK_SIZE 262144
+
+typedef struct bench_samples {
+  uint64_t *ns;
+  size_t capacity;
+  volatile size_t count;
+} bench_samples_t;
+
+static inline uint64_t bench_now()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* Number of iterations to run each benchmark for. Overridable through the
+ * LITHE_BENCH_ITERATIONS environment variable. */
+static inline int bench_iterations(int def)
+{
+  const char *s = getenv("LITHE_BENCH_ITERATIONS");
+  int n = s ? atoi(s) : 0;
+  return n > 0 ? n : def;
+}
+
+/* Walk 1, 2, 4, ... up to and including 'max'. Returns 0 once done. */
+static inline int bench_next_count(int n, int max)
+{
+  if (n >= max)
+    return 0;
+  return 2*n < max ? 2*n : max;
+}
+
+static inline void bench_samples_init(bench_samples_t *s, size_t capacity)
+{
+  s->ns = malloc(capacity * sizeof(uint64_t));
+  s->capacity = capacity;
+  s->count = 0;
+  if (!s->ns)
+    abort();
+}
+
+static inline void bench_samples_destroy(bench_samples_t *s)
+{
+  free(s->ns);
+}
+
+/* Safe to call from several harts at once. Samples past 'capacity' are
+ * dropped, without 'count' ever going past 'capacity', not even
+ * transiently. */
+static inline void bench_samples_add(bench_samples_t *s, uint64_t ns)
+{
+  size_t i = s->count;
+  for (;;) {
+    if (i >= s->capacity)
+      return;
+    size_t seen = __sync_val_compare_and_swap(&s->count, i, i + 1);
+    if (seen == i)
+      break;
+    i = seen;
+  }
+  s->ns[i] = ns;
+}
+
+static int __bench_cmp(const void *a, const void *b)
+{
+  uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+  return x < y ? -1 : x > y;
+}
+
+static inline uint64_t __bench_percentile(bench_samples_t *s, double p)
+{
+  size_t i = (size_t)(p * s->count);
+  return s->ns[i < s->count ? i : s->count - 1];
+}
+
+/* Print a summary of 's' as one JSON object on its own line, and reset it.
+ * 'param' names the parameter the benchmark was run with (e.g. "harts" or
+ * "fanout"), or is NULL if there is none. */
+static inline void bench_report(const char *name, const char *param,
+                                long value, bench_samples_t *s)
+{
+  size_t n = s->count;
+  if (n == 0) {
+    fprintf(stderr, "%s: no samples collected\n", name);
+    return;
+  }
+
+  qsort(s->ns, n, sizeof(uint64_t), __bench_cmp);
+  double sum = 0;
+  for (size_t i = 0; i < n; i++)
+    sum += s->ns[i];
+
+  printf("{\"benchmark\": \"%s\", ", name);
+  if (param)
+    printf("\"%s\": %ld, ", param, value);
+  printf("\"unit\": \"ns\", \"samples\": %zu, \"mean\": %.1f, "
+         "\"min\": %llu, \"p50\": %llu, \"p90\": %llu, \"p99\": %llu, "
+         "\"p999\": %llu, \"max\": %llu}\n",
+         n, sum / n,
+         (unsigned long long)s->ns[0],
+         (unsigned long long)__bench_percentile(s, 0.50),
+         (unsigned long long)__bench_percentile(s, 0.90),
+         (unsigned long long)__bench_percentile(s, 0.99),
+         (unsigned long long)__bench_percentile(s, 0.999),
+         (unsigned long long)s->ns[n - 1]);
+  fflush(stdout);
+  s->count = 0;
+}
+
+/* Run 'func' in 'n' contexts of a fresh fork-join scheduler, passing each its
+ * index, and wait for all of them to finish. */
+static inline void bench_run_contexts(int n, void (*func)(void*))
+{
+  lithe_fork_join_sched_t *sched = lithe_fork_join_sched_create();
+  lithe_sched_enter((lithe_sched_t*)sched);
+  for (long i = 0; i < n; i++)
+    lithe_fork_join_context_create(sched, BENCH_STACK_SIZE, func, (void*)i);
+  lithe_fork_join_sched_join_all(sched);
+  lithe_sched_exit();
+  lithe_fork_join_sched_destroy(sched);
+}
+
+#endif // LITHE_BENCH_H
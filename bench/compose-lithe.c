@@ -0,0 +1,53 @@
+/**
+ * The composition workload on lithe: the application and every library call
+ * each enter a fork-join scheduler of their own, and share the same harts.
+ */
+
+#include <src/lithe.h>
+#include <src/fork_join_sched.h>
+#include "compose.h"
+
+/* Tasks barely use any stack, and there are outer * inner of them at once */
+#define STACK_SIZE 65536
+
+static compose_params_t params;
+
+static void task(void *arg)
+{
+  compose_work(params.work);
+}
+
+static void library(void *arg)
+{
+  lithe_fork_join_sched_t *sched = lithe_fork_join_sched_create();
+  lithe_sched_enter((lithe_sched_t*)sched);
+  for (int i = 0; i < params.inner; i++)
+    lithe_fork_join_context_create(sched, STACK_SIZE, task, NULL);
+  lithe_fork_join_sched_join_all(sched);
+  lithe_sched_exit();
+  lithe_fork_join_sched_destroy(sched);
+}
+
+static void application()
+{
+  lithe_fork_join_sched_t *sched = lithe_fork_join_sched_create();
+  lithe_sched_enter((lithe_sched_t*)sched);
+  for (int i = 0; i < params.outer; i++)
+    lithe_fork_join_context_create(sched, STACK_SIZE, library, NULL);
+  lithe_fork_join_sched_join_all(sched);
+  lithe_sched_exit();
+  lithe_fork_join_sched_destroy(sched);
+}
+
+int main(int argc, char **argv)
+{
+  if (compose_parse(argc, argv, &params))
+    return 1;
+  params.threads = max_harts();
+
+  uint64_t start = compose_now();
+  for (int r = 0; r < params.repetitions; r++)
+    application();
+  compose_report("lithe", &params, compose_now() - start);
+  return 0;
+}
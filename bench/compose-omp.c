@@ -0,0 +1,39 @@
+/**
+ * The composition workload on OpenMP, with nested parallelism enabled: the
+ * application's parallel loop and every library call's each get a team of
+ * 'threads' threads, as they would with OMP_NESTED=true.
+ */
+
+#include <omp.h>
+#include "compose.h"
+
+static compose_params_t params;
+
+static void library()
+{
+  #pragma omp parallel for num_threads(params.threads) schedule(dynamic)
+  for (int i = 0; i < params.inner; i++)
+    compose_work(params.work);
+}
+
+static void application()
+{
+  #pragma omp parallel for num_threads(params.threads) schedule(dynamic)
+  for (int i = 0; i < params.outer; i++)
+    library();
+}
+
+int main(int argc, char **argv)
+{
+  if (compose_parse(argc, argv, &params))
+    return 1;
+
+  /* The portable spelling of OMP_NESTED=true, which is deprecated */
+  omp_set_max_active_levels(2);
+
+  uint64_t start = compose_now();
+  for (int r = 0; r < params.repetitions; r++)
+    application();
+  compose_report("omp", &params, compose_now() - start);
+  return 0;
+}
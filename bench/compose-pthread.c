@@ -0,0 +1,136 @@
+/**
+ * The composition workload on pthreads, the way independently written
+ * libraries typically compose: the application runs its loop on a pool of
+ * 'threads' threads, and the library keeps a pool of 'threads' threads of its
+ * own for every thread that calls into it. Nesting the two oversubscribes the
+ * machine with roughly threads^2 threads.
+ */
+
+#include <pthread.h>
+#include <stdbool.h>
+#include "compose.h"
+
+/* A pool of worker threads running one parallel loop at a time. The thread
+ * calling pool_run() takes part in running the loop too. */
+struct pool {
+  int nthreads;
+  pthread_t *threads;
+  pthread_mutex_t lock;
+  pthread_cond_t work;
+  pthread_cond_t done;
+
+  /* The current loop, replaced every time its generation changes */
+  uint64_t generation;
+  void (*func)(long i);
+  long n;
+  volatile long next;
+
+  /* Iterations not yet finished, and workers still in the current loop */
+  long remaining;
+  int active;
+};
+
+static void pool_iterate(struct pool *p, void (*func)(long i), long n)
+{
+  long i;
+  while ((i = __sync_fetch_and_add(&p->next, 1)) < n) {
+    func(i);
+    if (__sync_sub_and_fetch(&p->remaining, 1) == 0) {
+      pthread_mutex_lock(&p->lock);
+      pthread_cond_broadcast(&p->done);
+      pthread_mutex_unlock(&p->lock);
+    }
+  }
+}
+
+static void *pool_worker(void *arg)
+{
+  struct pool *p = arg;
+  uint64_t seen = 0;
+  for (;;) {
+    pthread_mutex_lock(&p->lock);
+    while (p->generation == seen)
+      pthread_cond_wait(&p->work, &p->lock);
+    seen = p->generation;
+    void (*func)(long) = p->func;
+    long n = p->n;
+    p->active++;
+    pthread_mutex_unlock(&p->lock);
+
+    pool_iterate(p, func, n);
+
+    pthread_mutex_lock(&p->lock);
+    if (--p->active == 0)
+      pthread_cond_broadcast(&p->done);
+    pthread_mutex_unlock(&p->lock);
+  }
+  return NULL;
+}
+
+static struct pool *pool_create(int nthreads)
+{
+  struct pool *p = calloc(1, sizeof(struct pool));
+  if (p == NULL)
+    abort();
+  p->nthreads = nthreads - 1;
+  p->threads = calloc(p->nthreads, sizeof(pthread_t));
+  pthread_mutex_init(&p->lock, NULL);
+  pthread_cond_init(&p->work, NULL);
+  pthread_cond_init(&p->done, NULL);
+  for (int i = 0; i < p->nthreads; i++)
+    if (pthread_create(&p->threads[i], NULL, pool_worker, p))
+      abort();
+  return p;
+}
+
+static void pool_run(struct pool *p, void (*func)(long i), long n)
+{
+  /* Workers that only woke up after the last loop finished may still be
+   * checking out of it */
+  pthread_mutex_lock(&p->lock);
+  while (p->active > 0)
+    pthread_cond_wait(&p->done, &p->lock);
+  p->func = func;
+  p->n = n;
+  p->next = 0;
+  p->remaining = n;
+  p->generation++;
+  pthread_cond_broadcast(&p->work);
+  pthread_mutex_unlock(&p->lock);
+
+  pool_iterate(p, func, n);
+
+  pthread_mutex_lock(&p->lock);
+  while (p->remaining > 0)
+    pthread_cond_wait(&p->done, &p->lock);
+  pthread_mutex_unlock(&p->lock);
+}
+
+static compose_params_t params;
+static struct pool *application_pool;
+static __thread struct pool *library_pool;
+
+static void task(long i)
+{
+  compose_work(params.work);
+}
+
+static void library(long i)
+{
+  if (library_pool == NULL)
+    library_pool = pool_create(params.threads);
+  pool_run(library_pool, task, params.inner);
+}
+
+int main(int argc, char **argv)
+{
+  if (compose_parse(argc, argv, &params))
+    return 1;
+  application_pool = pool_create(params.threads);
+
+  uint64_t start = compose_now();
+  for (int r = 0; r < params.repetitions; r++)
+    pool_run(application_pool, library, params.outer);
+  compose_report("pthread", &params, compose_now() - start);
+  return 0;
+}
@@ -0,0 +1,132 @@
+/**
+ * Workload shared by the composition benchmarks (see bench-compose.c).
+ *
+ * An "application" runs a parallel loop of 'outer' iterations, and every
+ * iteration calls into a "library" that runs a parallel loop of its own, of
+ * 'inner' tasks. Each task does a fixed amount of computation, calibrated to
+ * take 'granularity' ns on an otherwise idle core, so that tasks preempted by
+ * the OS still have to finish their work once rescheduled. The same workload
+ * is implemented on top of lithe, nested pthread pools and nested OpenMP, each
+ * in a program of its own so that none of them is linked against the others'
+ * runtime.
+ *
+ * Unlike the rest of the benchmarks, this header doesn't depend on lithe.
+ */
+
+#ifndef LITHE_BENCH_COMPOSE_H
+#define LITHE_BENCH_COMPOSE_H
+
+#include <getopt.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+typedef struct compose_params {
+  /* Iterations of the application's loop, and tasks of each library call */
+  int outer;
+  int inner;
+
+  /* Threads per pool (pthreads) or parallel region (OpenMP). Lithe always
+   * uses every hart. */
+  int threads;
+
+  /* Nanoseconds of work per task, and the number of iterations of the work
+   * loop that takes (calibrated from 'granularity' unless given) */
+  long granularity;
+  uint64_t work;
+
+  int repetitions;
+} compose_params_t;
+
+static volatile uint64_t compose_sink;
+
+static inline uint64_t compose_now()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* A chain of dependent multiply-adds the compiler can't elide or vectorize */
+static inline void compose_work(uint64_t iterations)
+{
+  uint64_t x = iterations;
+  for (uint64_t i = 0; i < iterations; i++)
+    x = x * 6364136223846793005ULL + 1442695040888963407ULL;
+  compose_sink = x;
+}
+
+/* Number of compose_work() iterations that take 'ns' nanoseconds */
+static inline uint64_t compose_calibrate(long ns)
+{
+  const uint64_t iterations = 10000000;
+  uint64_t best = UINT64_MAX;
+  for (int i = 0; i < 5; i++) {
+    uint64_t start = compose_now();
+    compose_work(iterations);
+    uint64_t elapsed = compose_now() - start;
+    if (elapsed < best)
+      best = elapsed;
+  }
+  return (uint64_t)((double)iterations * ns / (best ? best : 1));
+}
+
+static inline void compose_usage(const char *prog)
+{
+  fprintf(stderr,
+    "usage: %s [-o outer] [-i inner] [-t threads] [-g granularity_ns]\n"
+    "       [-w work_iterations] [-r repetitions]\n", prog);
+}
+
+/* Parse the command line shared by all of the composition benchmarks.
+ * Returns 0 on success, or prints usage and returns -1. */
+static inline int compose_parse(int argc, char **argv, compose_params_t *p)
+{
+  long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+  p->outer = ncpus;
+  p->inner = 4 * ncpus;
+  p->threads = ncpus;
+  p->granularity = 20000;
+  p->work = 0;
+  p->repetitions = 10;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "o:i:t:g:w:r:h")) != -1) {
+    switch (opt) {
+      case 'o': p->outer = atoi(optarg); break;
+      case 'i': p->inner = atoi(optarg); break;
+      case 't': p->threads = atoi(optarg); break;
+      case 'g': p->granularity = atol(optarg); break;
+      case 'w': p->work = strtoull(optarg, NULL, 10); break;
+      case 'r': p->repetitions = atoi(optarg); break;
+      default:
+        compose_usage(argv[0]);
+        return -1;
+    }
+  }
+  if (p->outer < 1 || p->inner < 1 || p->threads < 1 ||
+      p->granularity < 0 || p->repetitions < 1) {
+    compose_usage(argv[0]);
+    return -1;
+  }
+  if (p->work == 0)
+    p->work = compose_calibrate(p->granularity);
+  return 0;
+}
+
+/* Print the parameters and the mean wall time of one repetition as a line of
+ * JSON. bench-compose.c picks "wall_ns" out of it. */
+static inline void compose_report(const char *runtime, compose_params_t *p,
+                                  uint64_t wall_ns)
+{
+  printf("{\"benchmark\": \"compose\", \"runtime\": \"%s\", \"outer\": %d, "
+         "\"inner\": %d, \"threads\": %d, \"granularity_ns\": %ld, "
+         "\"repetitions\": %d, \"wall_ns\": %llu}\n",
+         runtime, p->outer, p->inner, p->threads, p->granularity,
+         p->repetitions, (unsigned long long)(wall_ns / p->repetitions));
+  fflush(stdout);
+}
+
+#endif // LITHE_BENCH_COMPOSE_H
@@ -0,0 +1,359 @@
+/*
+ * Lithe Parallel Algorithms
+ *
+ * Parallel versions of common standard algorithms taking a lithe::par
+ * execution policy, e.g. lithe::sort(lithe::par, v.begin(), v.end()). Each
+ * call splits its range into chunks run by the contexts of a fork-join
+ * scheduler entered as a child of the calling context's scheduler, so the
+ * work is spread over harts borrowed from the caller's share (and balanced
+ * with the fork-join scheduler's work stealing) rather than over a separate
+ * thread pool. Must be called from a lithe context. All iterators must be
+ * random access iterators.
+ */
+
+#ifndef LITHE_ALGORITHM_HH
+#define LITHE_ALGORITHM_HH
+
+#include <algorithm>
+#include <iterator>
+#include <numeric>
+#include <vector>
+#include "hart.h"
+#include "fork_join_sched.h"
+
+namespace lithe {
+
+/* Execution policy for the algorithms below. 'grain' is the smallest number
+ * of elements worth handing to a context of its own; ranges smaller than two
+ * grains run serially on the calling context. */
+struct parallel_policy {
+  size_t grain;
+  size_t stack_size;
+
+  parallel_policy(size_t grain = 2048, size_t stack_size = 262144)
+    : grain(grain), stack_size(stack_size) {}
+
+  parallel_policy with_grain(size_t g) const { return parallel_policy(g, stack_size); }
+};
+
+static const parallel_policy par;
+
+namespace detail {
+
+/* Number of chunks to split 'n' elements into */
+inline size_t num_chunks(const parallel_policy &policy, size_t n)
+{
+  size_t max_chunks = 4 * max_harts();
+  size_t chunks = policy.grain ? (n + policy.grain - 1) / policy.grain : n;
+  if (chunks > max_chunks)
+    chunks = max_chunks;
+  return chunks ? chunks : 1;
+}
+
+template<typename F>
+struct chunk_arg {
+  F *f;
+  size_t i;
+
+  static void run(void *arg)
+  {
+    chunk_arg *self = (chunk_arg*)arg;
+    (*self->f)(self->i);
+  }
+};
+
+/* Call f(i) for every i in [0, nchunks), in parallel on a nested fork-join
+ * scheduler. The calling context runs chunk 0 itself. */
+template<typename F>
+void parallel_chunks(const parallel_policy &policy, size_t nchunks, F f)
+{
+  if (nchunks <= 1) {
+    if (nchunks == 1)
+      f(0);
+    return;
+  }
+
+  std::vector<chunk_arg<F> > args(nchunks);
+  lithe_fork_join_sched_t *sched = lithe_fork_join_sched_create();
+  lithe_sched_enter((lithe_sched_t*)sched);
+  for (size_t i = 1; i < nchunks; i++) {
+    args[i].f = &f;
+    args[i].i = i;
+    lithe_fork_join_context_create(sched, policy.stack_size,
+                                   chunk_arg<F>::run, &args[i]);
+  }
+  f(0);
+  lithe_fork_join_sched_join_all(sched);
+  lithe_sched_exit();
+  lithe_fork_join_sched_destroy(sched);
+}
+
+/* Call f(begin, end) for contiguous offset ranges covering [0, n) */
+template<typename F>
+void parallel_ranges(const parallel_policy &policy, size_t n, F f)
+{
+  size_t nchunks = n < 2 * policy.grain ? 1 : num_chunks(policy, n);
+  parallel_chunks(policy, nchunks, [&](size_t i) {
+    f(n * i / nchunks, n * (i + 1) / nchunks);
+  });
+}
+
+}
+
+template<typename It, typename F>
+void for_each(const parallel_policy &policy, It first, It last, F f)
+{
+  detail::parallel_ranges(policy, last - first, [&](size_t b, size_t e) {
+    std::for_each(first + b, first + e, f);
+  });
+}
+
+template<typename It, typename OutIt, typename UnaryOp>
+OutIt transform(const parallel_policy &policy, It first, It last, OutIt d_first,
+                UnaryOp op)
+{
+  detail::parallel_ranges(policy, last - first, [&](size_t b, size_t e) {
+    std::transform(first + b, first + e, d_first + b, op);
+  });
+  return d_first + (last - first);
+}
+
+template<typename It1, typename It2, typename OutIt, typename BinaryOp>
+OutIt transform(const parallel_policy &policy, It1 first1, It1 last1,
+                It2 first2, OutIt d_first, BinaryOp op)
+{
+  detail::parallel_ranges(policy, last1 - first1, [&](size_t b, size_t e) {
+    std::transform(first1 + b, first1 + e, first2 + b, d_first + b, op);
+  });
+  return d_first + (last1 - first1);
+}
+
+template<typename It, typename T, typename BinaryOp, typename UnaryOp>
+T transform_reduce(const parallel_policy &policy, It first, It last, T init,
+                   BinaryOp reduce, UnaryOp transform)
+{
+  size_t n = last - first;
+  if (n == 0)
+    return init;
+
+  size_t nchunks = n < 2 * policy.grain ? 1 : detail::num_chunks(policy, n);
+  std::vector<T> partial(nchunks, init);
+  detail::parallel_chunks(policy, nchunks, [&](size_t i) {
+    It b = first + n * i / nchunks, e = first + n * (i + 1) / nchunks;
+    T acc = transform(*b);
+    for (++b; b != e; ++b)
+      acc = reduce(acc, transform(*b));
+    partial[i] = acc;
+  });
+
+  T result = init;
+  for (size_t i = 0; i < nchunks; i++)
+    result = reduce(result, partial[i]);
+  return result;
+}
+
+template<typename It, typename T, typename BinaryOp>
+T reduce(const parallel_policy &policy, It first, It last, T init,
+         BinaryOp op)
+{
+  typedef typename std::iterator_traits<It>::reference ref;
+  return lithe::transform_reduce(policy, first, last, init, op,
+                                 [](ref x) -> T { return x; });
+}
+
+template<typename It, typename T>
+T reduce(const parallel_policy &policy, It first, It last, T init)
+{
+  return lithe::reduce(policy, first, last, init, std::plus<T>());
+}
+
+namespace detail {
+
+/* Three pass scan: total up each chunk, scan the totals serially, then scan
+ * each chunk starting from its offset. */
+template<typename It, typename OutIt, typename T, typename BinaryOp>
+OutIt scan(const parallel_policy &policy, It first, It last, OutIt d_first,
+           const T *init, BinaryOp op, bool inclusive)
+{
+  size_t n = last - first;
+  if (n == 0)
+    return d_first;
+
+  size_t nchunks = n < 2 * policy.grain ? 1 : num_chunks(policy, n);
+  std::vector<T> totals(nchunks);
+  if (nchunks > 1) {
+    parallel_chunks(policy, nchunks - 1, [&](size_t i) {
+      It b = first + n * i / nchunks, e = first + n * (i + 1) / nchunks;
+      T acc = *b;
+      for (++b; b != e; ++b)
+        acc = op(acc, *b);
+      totals[i] = acc;
+    });
+  }
+
+  /* offsets[i] is everything before chunk i, if there is anything */
+  std::vector<T> offsets(nchunks);
+  std::vector<char> has_offset(nchunks, 0);
+  for (size_t i = 0; i < nchunks; i++) {
+    if (i == 0) {
+      if (init) {
+        offsets[0] = *init;
+        has_offset[0] = 1;
+      }
+    }
+    else {
+      offsets[i] = has_offset[i - 1] ? op(offsets[i - 1], totals[i - 1])
+                                     : totals[i - 1];
+      has_offset[i] = 1;
+    }
+  }
+
+  parallel_chunks(policy, nchunks, [&](size_t i) {
+    size_t b = n * i / nchunks, e = n * (i + 1) / nchunks;
+    bool have = has_offset[i];
+    T acc = have ? offsets[i] : T();
+    for (size_t j = b; j < e; j++) {
+      T x = first[j];
+      if (inclusive) {
+        acc = have ? op(acc, x) : x;
+        have = true;
+        d_first[j] = acc;
+      }
+      else {
+        d_first[j] = acc;
+        acc = op(acc, x);
+      }
+    }
+  });
+  return d_first + n;
+}
+
+}
+
+template<typename It, typename OutIt, typename BinaryOp>
+OutIt inclusive_scan(const parallel_policy &policy, It first, It last,
+                     OutIt d_first, BinaryOp op)
+{
+  typedef typename std::iterator_traits<It>::value_type T;
+  return detail::scan(policy, first, last, d_first, (const T*)NULL, op, true);
+}
+
+template<typename It, typename OutIt>
+OutIt inclusive_scan(const parallel_policy &policy, It first, It last,
+                     OutIt d_first)
+{
+  typedef typename std::iterator_traits<It>::value_type T;
+  return lithe::inclusive_scan(policy, first, last, d_first, std::plus<T>());
+}
+
+template<typename It, typename OutIt, typename T, typename BinaryOp>
+OutIt exclusive_scan(const parallel_policy &policy, It first, It last,
+                     OutIt d_first, T init, BinaryOp op)
+{
+  return detail::scan(policy, first, last, d_first, &init, op, false);
+}
+
+template<typename It, typename OutIt, typename T>
+OutIt exclusive_scan(const parallel_policy &policy, It first, It last,
+                     OutIt d_first, T init)
+{
+  return lithe::exclusive_scan(policy, first, last, d_first, init, std::plus<T>());
+}
+
+template<typename It1, typename It2, typename OutIt, typename Compare>
+OutIt merge(const parallel_policy &policy, It1 first1, It1 last1,
+            It2 first2, It2 last2, OutIt d_first, Compare comp)
+{
+  /* Split the first range evenly, and the second one wherever the first
+   * element of each piece of the first range would go. Elements of the first
+   * range stay ahead of equal elements of the second, as with std::merge. */
+  size_t n1 = last1 - first1, n2 = last2 - first2;
+  size_t n = n1 + n2;
+  size_t nchunks = n < 2 * policy.grain || n1 == 0 ? 1
+                   : std::min(detail::num_chunks(policy, n), n1);
+
+  std::vector<It2> splits(nchunks + 1);
+  splits[0] = first2;
+  splits[nchunks] = last2;
+  for (size_t i = 1; i < nchunks; i++)
+    splits[i] = std::lower_bound(first2, last2, first1[n1 * i / nchunks], comp);
+
+  detail::parallel_chunks(policy, nchunks, [&](size_t i) {
+    size_t b1 = n1 * i / nchunks, e1 = n1 * (i + 1) / nchunks;
+    size_t b2 = splits[i] - first2;
+    std::merge(first1 + b1, first1 + e1, splits[i], splits[i + 1],
+               d_first + b1 + b2, comp);
+  });
+  return d_first + n;
+}
+
+template<typename It1, typename It2, typename OutIt>
+OutIt merge(const parallel_policy &policy, It1 first1, It1 last1,
+            It2 first2, It2 last2, OutIt d_first)
+{
+  typedef typename std::iterator_traits<It1>::value_type T;
+  return lithe::merge(policy, first1, last1, first2, last2, d_first, std::less<T>());
+}
+
+template<typename It, typename Compare>
+void sort(const parallel_policy &policy, It first, It last, Compare comp)
+{
+  typedef typename std::iterator_traits<It>::value_type T;
+  size_t n = last - first;
+  size_t nruns = n < 2 * policy.grain ? 1 : detail::num_chunks(policy, n);
+  if (nruns == 1) {
+    std::sort(first, last, comp);
+    return;
+  }
+
+  /* Sort evenly sized runs in parallel, then merge pairs of neighbouring
+   * runs in parallel rounds, bouncing between the input and a buffer */
+  std::vector<size_t> bounds(nruns + 1);
+  for (size_t i = 0; i <= nruns; i++)
+    bounds[i] = n * i / nruns;
+  detail::parallel_chunks(policy, nruns, [&](size_t i) {
+    std::sort(first + bounds[i], first + bounds[i + 1], comp);
+  });
+
+  std::vector<T> buffer(first, last);
+  bool in_buffer = false;
+  while (bounds.size() > 2) {
+    size_t nruns = bounds.size() - 1;
+    size_t nmerges = (nruns + 1) / 2;
+    std::vector<size_t> next(nmerges + 1);
+    for (size_t i = 0; i < nmerges; i++)
+      next[i] = bounds[2 * i];
+    next[nmerges] = n;
+
+    detail::parallel_chunks(policy, nmerges, [&](size_t i) {
+      size_t b = bounds[2 * i];
+      size_t m = bounds[2 * i + 1];
+      size_t e = 2 * i + 2 <= nruns ? bounds[2 * i + 2] : n;
+      if (in_buffer)
+        std::merge(buffer.begin() + b, buffer.begin() + m,
+                   buffer.begin() + m, buffer.begin() + e, first + b, comp);
+      else
+        std::merge(first + b, first + m, first + m, first + e,
+                   buffer.begin() + b, comp);
+    });
+    bounds.swap(next);
+    in_buffer = !in_buffer;
+  }
+
+  if (in_buffer) {
+    detail::parallel_ranges(policy, n, [&](size_t b, size_t e) {
+      std::copy(buffer.begin() + b, buffer.begin() + e, first + b);
+    });
+  }
+}
+
+template<typename It>
+void sort(const parallel_policy &policy, It first, It last)
+{
+  typedef typename std::iterator_traits<It>::value_type T;
+  lithe::sort(policy, first, last, std::less<T>());
+}
+
+}
+
+#endif // LITHE_ALGORITHM_HH
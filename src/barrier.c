@@ -6,6 +6,7 @@
 
 #include <parlib/parlib.h>
 #include <stdlib.h>
+#include <string.h>
 #include "internal/assert.h"
 #include "barrier.h"
 
@@ -75,9 +76,7 @@ void lithe_barrier_wait(lithe_barrier_t *barrier)
     contextq_t *blocked = &barrier->blocked[wait];
     mcs_lock_qnode_t qnode = {0};
     mcs_pdr_lock(&blocked->mtx, &qnode);
-    for (i = 0; i < blocked->len; i++) {
-      lithe_context_unblock(blocked->queue[i]);
-    }
+    lithe_context_unblock_many(blocked->queue, blocked->len);
     blocked->len = 0;
     mcs_pdr_unlock(&blocked->mtx, &qnode);
   } 
@@ -107,3 +106,163 @@ void lithe_barrier_wait(lithe_barrier_t *barrier)
 }
 
 
+/* Bounds on the adaptive spin budget of a tree barrier node. Every node
+ * starts out with the same budget the flat barrier uses. */
+#define TREE_BARRIER_MINSPINS 16
+#define TREE_BARRIER_MAXSPINS (1 << 16)
+#define TREE_BARRIER_INITSPINS 1000
+
+/* Deep enough for any tree with an int number of participants */
+#define TREE_BARRIER_MAXDEPTH 32
+
+void lithe_tree_barrier_init(lithe_tree_barrier_t *barrier, int N)
+{
+  assert(barrier != NULL);
+  assert(N > 0);
+  const int R = LITHE_TREE_BARRIER_RADIX;
+
+  /* Count the nodes in each level of the tree, leaves first */
+  int nnodes = 0;
+  for (int width = N; ; width = (width + R - 1) / R) {
+    nnodes += (width + R - 1) / R;
+    if (width <= R)
+      break;
+  }
+
+  barrier->N = N;
+  barrier->nnodes = nnodes;
+  barrier->nodes = parlib_aligned_alloc(CACHE_LINE_SIZE,
+                     nnodes * sizeof(lithe_tree_barrier_node_t));
+  assert(barrier->nodes);
+  memset(barrier->nodes, 0, nnodes * sizeof(lithe_tree_barrier_node_t));
+
+  /* Lay the levels out one after another, wiring each node up to its parent
+   * in the level above. 'width' is the number of arrivals feeding the level
+   * (participants for the leaves, nodes of the level below otherwise). */
+  int level = 0;
+  for (int width = N; ; width = (width + R - 1) / R) {
+    int nlevel = (width + R - 1) / R;
+    for (int i = 0; i < nlevel; i++) {
+      lithe_tree_barrier_node_t *node = &barrier->nodes[level + i];
+      node->count = (i + 1) * R <= width ? R : width - i * R;
+      node->spin_budget = TREE_BARRIER_INITSPINS;
+      node->parent = nlevel > 1 ? &barrier->nodes[level + nlevel + i / R]
+                                : NULL;
+      mcs_pdr_init(&node->mtx);
+    }
+    level += nlevel;
+    if (nlevel == 1)
+      break;
+  }
+  assert(level == nnodes);
+}
+
+
+void lithe_tree_barrier_destroy(lithe_tree_barrier_t *barrier)
+{
+  assert(barrier != NULL);
+  free(barrier->nodes);
+}
+
+
+static void __lithe_tree_barrier_block(lithe_context_t *context, void *__node)
+{
+  lithe_tree_barrier_node_t *node = (lithe_tree_barrier_node_t *)__node;
+  assert(node != NULL);
+  assert(node->nblocked < LITHE_TREE_BARRIER_RADIX);
+  node->blocked[node->nblocked] = context;
+  node->nblocked += 1;
+  mcs_pdr_unlock(&node->mtx, node->qnode);
+}
+
+
+/* Wait at 'node' until its sense flips away from 'sense'. */
+static void __lithe_tree_barrier_await(lithe_tree_barrier_node_t *node,
+                                       bool sense)
+{
+  int budget = node->spin_budget;
+  int nspins = 0;
+  while (node->sense == sense) {
+    if (nspins >= budget) {
+      mcs_lock_qnode_t qnode = {0};
+      mcs_pdr_lock(&node->mtx, &qnode);
+      if (node->sense == sense) {
+        node->qnode = &qnode;
+        lithe_context_block(__lithe_tree_barrier_block, (void *)node);
+
+        /* Spinning for the whole budget bought us nothing, so halve it */
+        budget /= 2;
+        node->spin_budget = budget < TREE_BARRIER_MINSPINS ?
+                            TREE_BARRIER_MINSPINS : budget;
+        return;
+      }
+      mcs_pdr_unlock(&node->mtx, &qnode);
+      break;
+    }
+    nspins++;
+    cpu_relax();
+  }
+
+  /* Released while spinning: pull the budget towards twice the skew we
+   * actually observed, so the next episode has some headroom */
+  budget = (budget + 2 * nspins) / 2;
+  if (budget < TREE_BARRIER_MINSPINS)
+    budget = TREE_BARRIER_MINSPINS;
+  if (budget > TREE_BARRIER_MAXSPINS)
+    budget = TREE_BARRIER_MAXSPINS;
+  node->spin_budget = budget;
+}
+
+
+/* Release everyone waiting at 'node', spinning or blocked. */
+static void __lithe_tree_barrier_release(lithe_tree_barrier_node_t *node)
+{
+  wmb();
+  node->sense = !node->sense;
+
+  /* Always take the lock, a waiter may have checked the old sense under it
+   * and be on its way to blocking */
+  lithe_context_t *blocked[LITHE_TREE_BARRIER_RADIX];
+  mcs_lock_qnode_t qnode = {0};
+  mcs_pdr_lock(&node->mtx, &qnode);
+  int nblocked = node->nblocked;
+  memcpy(blocked, node->blocked, nblocked * sizeof(lithe_context_t *));
+  node->nblocked = 0;
+  mcs_pdr_unlock(&node->mtx, &qnode);
+
+  lithe_context_unblock_many(blocked, nblocked);
+}
+
+
+void lithe_tree_barrier_wait(lithe_tree_barrier_t *barrier, int id)
+{
+  assert(barrier != NULL);
+  assert(id >= 0 && id < barrier->N);
+
+  /* Climb the tree for as long as we are the last to arrive at each node,
+   * remembering the nodes we are responsible for releasing */
+  lithe_tree_barrier_node_t *won[TREE_BARRIER_MAXDEPTH];
+  int nwon = 0;
+  lithe_tree_barrier_node_t *node = &barrier->nodes[id / LITHE_TREE_BARRIER_RADIX];
+  while (node != NULL) {
+    /* toggled signal value for barrier reuse */
+    bool sense = node->sense;
+    rmb();
+
+    if (__sync_add_and_fetch(&node->arrived, 1) < node->count) {
+      __lithe_tree_barrier_await(node, sense);
+      break;
+    }
+
+    /* Last to arrive: reset the node for the next episode and move up */
+    node->arrived = 0;
+    assert(nwon < TREE_BARRIER_MAXDEPTH);
+    won[nwon++] = node;
+    node = node->parent;
+  }
+
+  /* Once released (or having arrived last at the root), release the nodes we
+   * won from the top down, so the biggest subtrees get going first */
+  while (nwon > 0)
+    __lithe_tree_barrier_release(won[--nwon]);
+}
@@ -55,6 +55,45 @@ void lithe_barrier_destroy(lithe_barrier_t *barrier);
 void lithe_barrier_wait(lithe_barrier_t *barrier);
 
 
+/* A combining tree barrier. Participants arrive at the leaf owning their id
+ * and only the last arrival at each node carries on to its parent, so the
+ * critical path is O(log N) instead of O(N) on a single shared counter.  On
+ * the way back down, every node's last arrival releases the participants
+ * waiting at that node, so release is done in parallel across the tree.
+ * Waiters spin for an adaptive number of iterations (tracking the arrival
+ * skew observed at their node) before blocking their context. */
+
+/* Fan-in of each node in the tree */
+#define LITHE_TREE_BARRIER_RADIX 4
+
+typedef struct lithe_tree_barrier_node {
+  struct lithe_tree_barrier_node *parent;
+  int count;
+  int arrived;
+  volatile bool sense;
+  int spin_budget;
+  mcs_pdr_lock_t mtx;
+  mcs_lock_qnode_t *qnode;
+  int nblocked;
+  lithe_context_t *blocked[LITHE_TREE_BARRIER_RADIX];
+} __attribute__((aligned(CACHE_LINE_SIZE))) lithe_tree_barrier_node_t;
+
+
+typedef struct lithe_tree_barrier {
+  int N;
+  int nnodes;
+  lithe_tree_barrier_node_t *nodes;
+} lithe_tree_barrier_t;
+
+
+void lithe_tree_barrier_init(lithe_tree_barrier_t *barrier, int nthreads);
+void lithe_tree_barrier_destroy(lithe_tree_barrier_t *barrier);
+
+/* Wait on the barrier as participant 'id', where 0 <= id < nthreads and each
+ * participant uses a distinct id. */
+void lithe_tree_barrier_wait(lithe_tree_barrier_t *barrier, int id);
+
+
 #ifdef __cplusplus 
 }
 #endif
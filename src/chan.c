@@ -0,0 +1,458 @@
+/**
+ * Implementation of bounded, multi-producer multi-consumer channels.
+ *
+ * The fast path is a lock-free bounded queue in the style of Dmitry Vyukov's
+ * MPMC queue: each cell carries a sequence number telling producers and
+ * consumers whose turn it is to use it. The lock and the wait queues are only
+ * touched when a context has to park because the ring is full (or empty), or
+ * when someone is known to be parked (nsenders / nreceivers > 0).
+ */
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include "internal/assert.h"
+
+#include <parlib/parlib.h>
+#include "chan.h"
+
+/* Maximum number of parked contexts woken with a single call to
+ * lithe_context_unblock_many() when closing a channel */
+#define CHAN_UNBLOCK_BATCH 64
+
+int lithe_chan_init(lithe_chan_t *chan, size_t capacity)
+{
+  if(chan == NULL)
+    return EINVAL;
+  if(capacity == 0)
+    return EINVAL;
+
+  size_t size = 1;
+  while (size < capacity)
+    size <<= 1;
+
+  chan->cells = malloc(size * sizeof(struct lithe_chan_cell));
+  if(chan->cells == NULL)
+    return ENOMEM;
+  for (size_t i = 0; i < size; i++)
+    chan->cells[i].seq = i;
+  chan->mask = size - 1;
+  chan->head = 0;
+  chan->tail = 0;
+
+  chan->nsenders = 0;
+  chan->nreceivers = 0;
+  chan->closed = 0;
+  mcs_pdr_init(&chan->lock);
+  chan->qnode = NULL;
+  STAILQ_INIT(&chan->senders);
+  STAILQ_INIT(&chan->receivers);
+  return 0;
+}
+
+int lithe_chan_destroy(lithe_chan_t *chan)
+{
+  if(chan == NULL)
+    return EINVAL;
+  if(!STAILQ_EMPTY(&chan->senders) || !STAILQ_EMPTY(&chan->receivers))
+    return EBUSY;
+
+  free(chan->cells);
+  chan->cells = NULL;
+  return 0;
+}
+
+/* Lock-free push onto the ring. Returns false if the ring is full. */
+static bool ring_push(lithe_chan_t *chan, void *msg)
+{
+  struct lithe_chan_cell *cell;
+  size_t pos = chan->head;
+  while (1) {
+    cell = &chan->cells[pos & chan->mask];
+    size_t seq = cell->seq;
+    rmb();
+    intptr_t dif = (intptr_t)seq - (intptr_t)pos;
+    if (dif == 0) {
+      if (__sync_bool_compare_and_swap(&chan->head, pos, pos + 1))
+        break;
+      pos = chan->head;
+    }
+    else if (dif < 0)
+      return false;
+    else
+      pos = chan->head;
+  }
+  cell->msg = msg;
+  wmb();
+  cell->seq = pos + 1;
+  return true;
+}
+
+/* Lock-free pop off of the ring. Returns false if the ring is empty. */
+static bool ring_pop(lithe_chan_t *chan, void **msg)
+{
+  struct lithe_chan_cell *cell;
+  size_t pos = chan->tail;
+  while (1) {
+    cell = &chan->cells[pos & chan->mask];
+    size_t seq = cell->seq;
+    rmb();
+    intptr_t dif = (intptr_t)seq - (intptr_t)(pos + 1);
+    if (dif == 0) {
+      if (__sync_bool_compare_and_swap(&chan->tail, pos, pos + 1))
+        break;
+      pos = chan->tail;
+    }
+    else if (dif < 0)
+      return false;
+    else
+      pos = chan->tail;
+  }
+  *msg = cell->msg;
+  mb();
+  cell->seq = pos + chan->mask + 1;
+  return true;
+}
+
+static void block(lithe_context_t *context, void *arg)
+{
+  struct lithe_chan_waiter *w = (struct lithe_chan_waiter *) arg;
+  assert(w);
+  w->context = context;
+  STAILQ_INSERT_TAIL(w->queue, w, link);
+  mcs_pdr_unlock(&w->chan->lock, w->chan->qnode);
+}
+
+/* Wake somebody taken off of one of the channel's wait queues */
+static void wake_waiter(struct lithe_chan_waiter *w)
+{
+  if (w->wake)
+    w->wake(w);
+  else
+    lithe_context_unblock(w->context);
+}
+
+/* Park the calling context on one of the channel's wait queues. Must be
+ * called with the channel lock held; the lock is released once the context
+ * is safely on the queue. */
+static void park(lithe_chan_t *chan, struct lithe_chan_waiter *w,
+                 mcs_lock_qnode_t *qnode)
+{
+  chan->qnode = qnode;
+  lithe_context_block(block, w);
+}
+
+/* Hand 'msg' directly to a parked receiver, if there is one. */
+static bool handoff_to_receiver(lithe_chan_t *chan, void *msg)
+{
+  struct lithe_chan_waiter *w;
+  mcs_lock_qnode_t qnode = {0};
+  mcs_pdr_lock(&chan->lock, &qnode);
+  if ((w = STAILQ_FIRST(&chan->receivers)) != NULL) {
+    STAILQ_REMOVE_HEAD(&chan->receivers, link);
+    __sync_fetch_and_add(&chan->nreceivers, -1);
+    w->msg = msg;
+    w->done = true;
+  }
+  mcs_pdr_unlock(&chan->lock, &qnode);
+
+  if (w != NULL)
+    wake_waiter(w);
+  return w != NULL;
+}
+
+/* Called after pushing onto the ring: if a receiver is parked, pop a message
+ * off the ring on its behalf and wake it up with it. */
+static void wake_receiver(lithe_chan_t *chan)
+{
+  /* Order our push before the check below (pairs with the increment of
+   * nreceivers in lock_for_recv()) */
+  mb();
+  if (chan->nreceivers == 0)
+    return;
+
+  struct lithe_chan_waiter *w;
+  mcs_lock_qnode_t qnode = {0};
+  mcs_pdr_lock(&chan->lock, &qnode);
+  if ((w = STAILQ_FIRST(&chan->receivers)) != NULL) {
+    if (ring_pop(chan, &w->msg)) {
+      STAILQ_REMOVE_HEAD(&chan->receivers, link);
+      __sync_fetch_and_add(&chan->nreceivers, -1);
+      w->done = true;
+    }
+    else {
+      w = NULL;
+    }
+  }
+  mcs_pdr_unlock(&chan->lock, &qnode);
+
+  if (w != NULL)
+    wake_waiter(w);
+}
+
+/* Called after popping off of the ring: if a sender is parked, push its
+ * message onto the ring on its behalf and wake it up. */
+static void wake_sender(lithe_chan_t *chan)
+{
+  /* Order our pop before the check below (pairs with the increment of
+   * nsenders in lock_for_send()) */
+  mb();
+  if (chan->nsenders == 0)
+    return;
+
+  struct lithe_chan_waiter *w;
+  mcs_lock_qnode_t qnode = {0};
+  mcs_pdr_lock(&chan->lock, &qnode);
+  if ((w = STAILQ_FIRST(&chan->senders)) != NULL) {
+    if (ring_push(chan, w->msg)) {
+      STAILQ_REMOVE_HEAD(&chan->senders, link);
+      __sync_fetch_and_add(&chan->nsenders, -1);
+      w->done = true;
+    }
+    else {
+      w = NULL;
+    }
+  }
+  mcs_pdr_unlock(&chan->lock, &qnode);
+
+  if (w != NULL) {
+    wake_waiter(w);
+    wake_receiver(chan);
+  }
+}
+
+int lithe_chan_trysend(lithe_chan_t *chan, void *msg)
+{
+  if(chan == NULL)
+    return EINVAL;
+  if(chan->closed)
+    return EPIPE;
+
+  if (chan->nreceivers > 0 && handoff_to_receiver(chan, msg))
+    return 0;
+  if (!ring_push(chan, msg))
+    return EAGAIN;
+  wake_receiver(chan);
+  return 0;
+}
+
+int lithe_chan_tryrecv(lithe_chan_t *chan, void **msg)
+{
+  if(chan == NULL || msg == NULL)
+    return EINVAL;
+
+  if (!ring_pop(chan, msg))
+    return chan->closed ? EPIPE : EAGAIN;
+  wake_sender(chan);
+  return 0;
+}
+
+/* Called once trysend has failed: take the channel lock and announce
+ * ourselves in nsenders, then recheck everything so a receiver can't drain the
+ * ring in between without noticing us. Returns 0 or EPIPE if the send could be
+ * finished after all, or EAGAIN with the lock held if the caller has to park. */
+static int lock_for_send(lithe_chan_t *chan, void *msg,
+                         mcs_lock_qnode_t *qnode)
+{
+  mcs_pdr_lock(&chan->lock, qnode);
+  __sync_fetch_and_add(&chan->nsenders, 1);
+  bool sent = false;
+  if (!chan->closed)
+    sent = ring_push(chan, msg);
+  if (chan->closed || sent) {
+    __sync_fetch_and_add(&chan->nsenders, -1);
+    mcs_pdr_unlock(&chan->lock, qnode);
+    if (!sent)
+      return EPIPE;
+    wake_receiver(chan);
+    return 0;
+  }
+  return EAGAIN;
+}
+
+/* The receiving counterpart of lock_for_send() */
+static int lock_for_recv(lithe_chan_t *chan, void **msg,
+                         mcs_lock_qnode_t *qnode)
+{
+  mcs_pdr_lock(&chan->lock, qnode);
+  __sync_fetch_and_add(&chan->nreceivers, 1);
+  bool received = ring_pop(chan, msg);
+  if (chan->closed || received) {
+    __sync_fetch_and_add(&chan->nreceivers, -1);
+    mcs_pdr_unlock(&chan->lock, qnode);
+    if (!received)
+      return EPIPE;
+    wake_sender(chan);
+    return 0;
+  }
+  return EAGAIN;
+}
+
+int lithe_chan_send(lithe_chan_t *chan, void *msg)
+{
+  if(chan == NULL)
+    return EINVAL;
+
+  while (1) {
+    int ret = lithe_chan_trysend(chan, msg);
+    if (ret != EAGAIN)
+      return ret;
+
+    /* The ring is full, so get ready to park */
+    mcs_lock_qnode_t qnode = {0};
+    ret = lock_for_send(chan, msg, &qnode);
+    if (ret != EAGAIN)
+      return ret;
+
+    struct lithe_chan_waiter w = {
+      .queue = &chan->senders,
+      .chan = chan,
+      .msg = msg,
+      .done = false,
+    };
+    park(chan, &w, &qnode);
+
+    /* A receiver either moved our message onto the ring for us, or we were
+     * woken up by lithe_chan_close() and should go around again. */
+    if (w.done)
+      return 0;
+  }
+}
+
+int lithe_chan_recv(lithe_chan_t *chan, void **msg)
+{
+  if(chan == NULL || msg == NULL)
+    return EINVAL;
+
+  while (1) {
+    int ret = lithe_chan_tryrecv(chan, msg);
+    if (ret != EAGAIN)
+      return ret;
+
+    /* The ring is empty, so get ready to park */
+    mcs_lock_qnode_t qnode = {0};
+    ret = lock_for_recv(chan, msg, &qnode);
+    if (ret != EAGAIN)
+      return ret;
+
+    struct lithe_chan_waiter w = {
+      .queue = &chan->receivers,
+      .chan = chan,
+      .msg = NULL,
+      .done = false,
+    };
+    park(chan, &w, &qnode);
+
+    /* A sender either handed us a message directly, or we were woken up by
+     * lithe_chan_close() and should go around again. */
+    if (w.done) {
+      *msg = w.msg;
+      return 0;
+    }
+  }
+}
+
+/* Queue 'w' where a context would have parked, and release the lock. Whoever
+ * takes it off of the queue calls its wake function. */
+static void enqueue(lithe_chan_t *chan, struct lithe_chan_waiter *w,
+                    struct lithe_chan_waitq *queue, mcs_lock_qnode_t *qnode)
+{
+  assert(w->wake);
+  w->queue = queue;
+  w->chan = chan;
+  w->context = NULL;
+  w->done = false;
+  STAILQ_INSERT_TAIL(queue, w, link);
+  mcs_pdr_unlock(&chan->lock, qnode);
+}
+
+int lithe_chan_send_async(lithe_chan_t *chan, void *msg,
+                          struct lithe_chan_waiter *waiter)
+{
+  if(chan == NULL || waiter == NULL)
+    return EINVAL;
+
+  int ret = lithe_chan_trysend(chan, msg);
+  if (ret != EAGAIN)
+    return ret;
+
+  mcs_lock_qnode_t qnode = {0};
+  ret = lock_for_send(chan, msg, &qnode);
+  if (ret != EAGAIN)
+    return ret;
+  waiter->msg = msg;
+  enqueue(chan, waiter, &chan->senders, &qnode);
+  return EINPROGRESS;
+}
+
+int lithe_chan_recv_async(lithe_chan_t *chan, void **msg,
+                          struct lithe_chan_waiter *waiter)
+{
+  if(chan == NULL || msg == NULL || waiter == NULL)
+    return EINVAL;
+
+  int ret = lithe_chan_tryrecv(chan, msg);
+  if (ret != EAGAIN)
+    return ret;
+
+  mcs_lock_qnode_t qnode = {0};
+  ret = lock_for_recv(chan, msg, &qnode);
+  if (ret != EAGAIN)
+    return ret;
+  waiter->msg = NULL;
+  enqueue(chan, waiter, &chan->receivers, &qnode);
+  return EINPROGRESS;
+}
+
+/* Wake every context parked on 'q', in batches. */
+static void unblock_waitq(struct lithe_chan_waitq *q)
+{
+  lithe_context_t *batch[CHAN_UNBLOCK_BATCH];
+  int nbatch = 0;
+  struct lithe_chan_waiter *w, *n;
+  for (w = STAILQ_FIRST(q); w != NULL; w = n) {
+    /* Grab the next waiter before this one's context can possibly run
+     * again, since the waiter lives on that context's stack. */
+    n = STAILQ_NEXT(w, link);
+    if (w->wake) {
+      w->wake(w);
+      continue;
+    }
+    batch[nbatch++] = w->context;
+    if (nbatch == CHAN_UNBLOCK_BATCH) {
+      lithe_context_unblock_many(batch, nbatch);
+      nbatch = 0;
+    }
+  }
+  lithe_context_unblock_many(batch, nbatch);
+}
+
+int lithe_chan_close(lithe_chan_t *chan)
+{
+  if(chan == NULL)
+    return EINVAL;
+
+  mcs_lock_qnode_t qnode = {0};
+  mcs_pdr_lock(&chan->lock, &qnode);
+  if (chan->closed) {
+    mcs_pdr_unlock(&chan->lock, &qnode);
+    return EPIPE;
+  }
+  chan->closed = 1;
+  struct lithe_chan_waitq senders = chan->senders;
+  struct lithe_chan_waitq receivers = chan->receivers;
+  if (STAILQ_EMPTY(&chan->senders))
+    STAILQ_INIT(&senders);
+  if (STAILQ_EMPTY(&chan->receivers))
+    STAILQ_INIT(&receivers);
+  STAILQ_INIT(&chan->senders);
+  STAILQ_INIT(&chan->receivers);
+  chan->nsenders = 0;
+  chan->nreceivers = 0;
+  mcs_pdr_unlock(&chan->lock, &qnode);
+
+  unblock_waitq(&senders);
+  unblock_waitq(&receivers);
+  return 0;
+}
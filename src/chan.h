@@ -0,0 +1,105 @@
+/**
+ * Interface of bounded, multi-producer multi-consumer channels for passing
+ * messages (pointers) between lithe contexts.
+ */
+
+#ifndef LITHE_CHAN_H
+#define LITHE_CHAN_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/queue.h>
+#include <parlib/mcs.h>
+#include "lithe.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* A slot in the channel's ring buffer */
+struct lithe_chan_cell {
+  volatile size_t seq;
+  void *msg;
+};
+
+struct lithe_chan;
+struct lithe_chan_waiter;
+STAILQ_HEAD(lithe_chan_waitq, lithe_chan_waiter);
+
+/* Somebody parked on a channel. Contexts park with a waiter on their own
+ * stack. Callers of lithe_chan_send_async() and lithe_chan_recv_async()
+ * supply their own instead, and only set 'wake', which is called in place of
+ * unblocking a context once the waiter is done with. Everything else is
+ * private to the implementation. */
+struct lithe_chan_waiter {
+  void (*wake)(struct lithe_chan_waiter *waiter);
+  volatile bool done;
+  void *msg;
+  STAILQ_ENTRY(lithe_chan_waiter) link;
+  struct lithe_chan_waitq *queue;
+  struct lithe_chan *chan;
+  lithe_context_t *context;
+};
+
+/* A lithe channel struct. Sends and receives go through a lock-free ring
+ * buffer, and only fall back to the lock and wait queues below when the ring
+ * is full (or empty) and a context has to park. */
+typedef struct lithe_chan {
+  struct lithe_chan_cell *cells;
+  size_t mask;
+  volatile size_t head CACHE_LINE_ALIGNED;
+  volatile size_t tail CACHE_LINE_ALIGNED;
+  volatile int nsenders CACHE_LINE_ALIGNED;
+  volatile int nreceivers;
+  volatile int closed;
+  mcs_pdr_lock_t lock;
+  mcs_lock_qnode_t *qnode;
+  struct lithe_chan_waitq senders;
+  struct lithe_chan_waitq receivers;
+} lithe_chan_t;
+
+/* Initialize a channel able to buffer up to 'capacity' messages. The capacity
+ * is rounded up to a power of two. */
+int lithe_chan_init(lithe_chan_t *chan, size_t capacity);
+
+/* Destroy a channel. No contexts may be parked on it. */
+int lithe_chan_destroy(lithe_chan_t *chan);
+
+/* Send a message on a channel, parking the calling context while the channel
+ * is full. If a receiver is already parked, the message is handed to it
+ * directly. Returns EPIPE if the channel has been closed. */
+int lithe_chan_send(lithe_chan_t *chan, void *msg);
+
+/* Receive a message from a channel, parking the calling context while the
+ * channel is empty. Returns EPIPE once the channel has been closed and
+ * drained. */
+int lithe_chan_recv(lithe_chan_t *chan, void **msg);
+
+/* Non-parking variants of send and receive. They return EAGAIN instead of
+ * parking when the channel is full (or empty). */
+int lithe_chan_trysend(lithe_chan_t *chan, void *msg);
+int lithe_chan_tryrecv(lithe_chan_t *chan, void **msg);
+
+/* Variants of send and receive for code that can't park a context, e.g.
+ * coroutine tasks. They behave like the non-parking variants, except that
+ * instead of returning EAGAIN they queue 'waiter' on the channel alongside any
+ * parked contexts and return EINPROGRESS. 'waiter->wake(waiter)' is called
+ * once the operation has completed, with 'waiter->done' set (and, for a
+ * receive, the message in 'waiter->msg'), or once the channel has been closed,
+ * with 'waiter->done' clear, after which the caller should retry with
+ * lithe_chan_trysend() or lithe_chan_tryrecv(). 'waiter' must stay valid
+ * until then. */
+int lithe_chan_send_async(lithe_chan_t *chan, void *msg,
+                          struct lithe_chan_waiter *waiter);
+int lithe_chan_recv_async(lithe_chan_t *chan, void **msg,
+                          struct lithe_chan_waiter *waiter);
+
+/* Close a channel. Parked senders and receivers are woken up; further sends
+ * fail with EPIPE while receives keep draining any buffered messages. */
+int lithe_chan_close(lithe_chan_t *chan);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // LITHE_CHAN_H
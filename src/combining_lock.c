@@ -0,0 +1,186 @@
+/**
+ * Implementation of flat-combining locks.
+ */
+
+#include <errno.h>
+#include "internal/assert.h"
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <parlib/parlib.h>
+#include "combining_lock.h"
+
+/* Slot states */
+enum {
+  SLOT_EMPTY,
+  SLOT_PENDING,
+  SLOT_PARKED,
+  SLOT_DONE,
+};
+
+/* Number of passes the lock holder makes over the slots before giving up the
+ * lock, and how long a waiter spins before parking its context */
+#define COMBINING_LOCK_PASSES 3
+#define COMBINING_LOCK_MAXSPINS 4096
+
+int lithe_combining_lock_init(lithe_combining_lock_t *lock)
+{
+  if(lock == NULL)
+    return EINVAL;
+
+  lock->locked = 0;
+  lock->nslots = max_harts();
+  lock->slots = parlib_aligned_alloc(ARCH_CL_SIZE,
+                  lock->nslots * sizeof(lithe_combining_slot_t));
+  if(lock->slots == NULL)
+    return ENOMEM;
+  memset(lock->slots, 0, lock->nslots * sizeof(lithe_combining_slot_t));
+  for (int i = 0; i < lock->nslots; i++)
+    lock->slots[i].lock = lock;
+  return 0;
+}
+
+int lithe_combining_lock_destroy(lithe_combining_lock_t *lock)
+{
+  if(lock == NULL)
+    return EINVAL;
+  if(lock->locked)
+    return EBUSY;
+
+  free(lock->slots);
+  lock->slots = NULL;
+  return 0;
+}
+
+/* Run every published operation. Must be called with the lock held. */
+static void combine(lithe_combining_lock_t *lock)
+{
+  for (int pass = 0; pass < COMBINING_LOCK_PASSES; pass++) {
+    bool found = false;
+    for (int i = 0; i < lock->nslots; i++) {
+      lithe_combining_slot_t *slot = &lock->slots[i];
+      int state = slot->state;
+      if (state != SLOT_PENDING && state != SLOT_PARKED)
+        continue;
+
+      rmb();
+      slot->op(slot->arg);
+      found = true;
+
+      /* If the owner parked in the meantime, it's up to us to wake it */
+      wmb();
+      if (__sync_lock_test_and_set(&slot->state, SLOT_DONE) == SLOT_PARKED)
+        lithe_context_unblock(slot->context);
+    }
+    if (!found)
+      break;
+  }
+}
+
+static bool has_parked(lithe_combining_lock_t *lock)
+{
+  for (int i = 0; i < lock->nslots; i++)
+    if (lock->slots[i].state == SLOT_PARKED)
+      return true;
+  return false;
+}
+
+/* Release the lock. A waiter may have parked after our last pass over the
+ * slots, so check for parked waiters once the lock is free and combine again
+ * on their behalf if nobody else has picked the lock up. */
+static void unlock(lithe_combining_lock_t *lock)
+{
+  while (1) {
+    wmb();
+    lock->locked = 0;
+    mb();
+    if (!has_parked(lock))
+      return;
+    if (!__sync_bool_compare_and_swap(&lock->locked, 0, 1))
+      return;
+    combine(lock);
+  }
+}
+
+static void block(lithe_context_t *context, void *arg)
+{
+  lithe_combining_slot_t *slot = (lithe_combining_slot_t *) arg;
+  assert(slot);
+  slot->context = context;
+  wmb();
+
+  /* Our operation was completed before we got the chance to park */
+  if (!__sync_bool_compare_and_swap(&slot->state, SLOT_PENDING, SLOT_PARKED)) {
+    lithe_context_unblock(context);
+    return;
+  }
+
+  /* Nobody holds the lock, so nobody may be around to combine on our behalf.
+   * Take our request back (unless a combiner beat us to it) and go around
+   * again. Pairs with the check for parked waiters in unlock(). */
+  if (slot->lock->locked == 0 &&
+      __sync_bool_compare_and_swap(&slot->state, SLOT_PARKED, SLOT_PENDING))
+    lithe_context_unblock(context);
+}
+
+/* Fallback for when our hart's slot is taken by a context that parked on
+ * this hart and hasn't been resumed yet: take the lock ourselves. */
+static void apply_locked(lithe_combining_lock_t *lock,
+                         void (*op) (void *), void *arg)
+{
+  int spins = 0;
+  while (lock->locked || !__sync_bool_compare_and_swap(&lock->locked, 0, 1)) {
+    if (++spins >= COMBINING_LOCK_MAXSPINS) {
+      lithe_context_yield();
+      spins = 0;
+    }
+    cpu_relax();
+  }
+  op(arg);
+  combine(lock);
+  unlock(lock);
+}
+
+int lithe_combining_lock_apply(lithe_combining_lock_t *lock,
+                               void (*op) (void *), void *arg)
+{
+  if(lock == NULL || op == NULL)
+    return EINVAL;
+
+  lithe_combining_slot_t *slot = &lock->slots[hart_id()];
+  if (!__sync_bool_compare_and_swap(&slot->owner, NULL, lithe_context_self())) {
+    apply_locked(lock, op, arg);
+    return 0;
+  }
+
+  /* Publish our operation */
+  slot->op = op;
+  slot->arg = arg;
+  wmb();
+  slot->state = SLOT_PENDING;
+
+  /* Wait for someone to run it, becoming the combiner ourselves if the lock
+   * is free, and parking if it's taking too long */
+  int spins = 0;
+  while (slot->state != SLOT_DONE) {
+    if (lock->locked == 0 && __sync_bool_compare_and_swap(&lock->locked, 0, 1)) {
+      combine(lock);
+      unlock(lock);
+      continue;
+    }
+    if (++spins >= COMBINING_LOCK_MAXSPINS) {
+      lithe_context_block(block, slot);
+      spins = 0;
+      continue;
+    }
+    cpu_relax();
+  }
+
+  /* Give the slot back */
+  rmb();
+  slot->state = SLOT_EMPTY;
+  wmb();
+  slot->owner = NULL;
+  return 0;
+}
@@ -0,0 +1,53 @@
+/**
+ * Interface of flat-combining locks.
+ */
+
+#ifndef LITHE_COMBINING_LOCK_H
+#define LITHE_COMBINING_LOCK_H
+
+#include "lithe.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* A per-hart publication slot in a combining lock */
+typedef struct lithe_combining_slot {
+  struct lithe_combining_lock *lock;
+  lithe_context_t *volatile owner;
+  volatile int state;
+  void (*op) (void *);
+  void *arg;
+  lithe_context_t *context;
+} __attribute__((aligned(ARCH_CL_SIZE))) lithe_combining_slot_t;
+
+/* A lithe combining lock struct. Rather than each context taking the lock
+ * and dragging the protected data over to its own hart, contexts publish the
+ * operation they want to perform in their hart's slot, and whichever context
+ * holds the lock runs every published operation in one go while the data
+ * stays in its cache. */
+typedef struct lithe_combining_lock {
+  volatile int locked CACHE_LINE_ALIGNED;
+  int nslots;
+  lithe_combining_slot_t *slots;
+} lithe_combining_lock_t;
+
+/* Initialize a combining lock. */
+int lithe_combining_lock_init(lithe_combining_lock_t *lock);
+
+/* Destroy a combining lock. */
+int lithe_combining_lock_destroy(lithe_combining_lock_t *lock);
+
+/* Run 'op(arg)' under the lock, either directly or by having the current lock
+ * holder run it on our behalf. Returns once 'op' has completed. If combining
+ * takes too long the calling context is parked until its operation is done.
+ * Since 'op' may be run by another context, it must not block, yield or rely
+ * on lithe_context_self(). */
+int lithe_combining_lock_apply(lithe_combining_lock_t *lock,
+                               void (*op) (void *), void *arg);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // LITHE_COMBINING_LOCK_H
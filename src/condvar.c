@@ -69,23 +69,36 @@ int lithe_condvar_signal(lithe_condvar_t* c) {
   return 0;
 }
 
-/* Broadcast a signal to all lithe contexts waiting on the condition variable */
+/* Broadcast a signal to all lithe contexts waiting on the condition variable.
+ * Rather than waking every waiter only to have all but one of them block again
+ * on the mutex they reacquire in lithe_condvar_wait(), move them straight onto
+ * that mutex's wait queue (a la FUTEX_CMP_REQUEUE).  At most one waiter is
+ * made runnable here (and only if the mutex is currently free); the rest are
+ * woken one at a time, in order, as the mutex is unlocked. */
 int lithe_condvar_broadcast(lithe_condvar_t* c) {
   if(c == NULL)
     return EINVAL;
 
+  lithe_context_t *context = NULL;
   mcs_lock_qnode_t qnode = {0};
-  while(1) {
-    mcs_pdr_lock(&c->lock, &qnode);
-    lithe_context_t *context = TAILQ_FIRST(&c->queue);
-    if(context)
+  mcs_pdr_lock(&c->lock, &qnode);
+  if(!TAILQ_EMPTY(&c->queue)) {
+    lithe_mutex_t *mutex = c->waiting_mutex;
+    assert(mutex);
+
+    mcs_lock_qnode_t mqnode = {0};
+    mcs_pdr_lock(&mutex->lock, &mqnode);
+    if(!mutex->locked) {
+      context = TAILQ_FIRST(&c->queue);
       TAILQ_REMOVE(&c->queue, context, link);
-    else break;
-    mcs_pdr_unlock(&c->lock, &qnode);
-    lithe_context_unblock(context);
-    memset(&qnode, 0, sizeof(mcs_lock_qnode_t));
+    }
+    TAILQ_CONCAT(&mutex->queue, &c->queue, link);
+    mcs_pdr_unlock(&mutex->lock, &mqnode);
   }
   mcs_pdr_unlock(&c->lock, &qnode);
+
+  if (context != NULL) {
+    lithe_context_unblock(context);
+  }
   return 0;
 }
-
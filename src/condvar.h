@@ -40,7 +40,10 @@ int lithe_condvar_wait(lithe_condvar_t* c, lithe_mutex_t* m);
 /* Signal the next lithe context waiting on the condition variable */
 int lithe_condvar_signal(lithe_condvar_t* c);
 
-/* Broadcast a signal to all lithe contexts waiting on the condition variable */
+/* Broadcast a signal to all lithe contexts waiting on the condition variable.
+ * Waiters are requeued directly onto the wait queue of the mutex they passed
+ * to lithe_condvar_wait() instead of all being woken at once, so every waiter
+ * must wait with the same mutex (as with pthreads). */
 int lithe_condvar_broadcast(lithe_condvar_t* c);
 
 #ifdef __cplusplus
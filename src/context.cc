@@ -41,9 +41,14 @@ void Context::start_routine_wrapper(void *__arg)
 
 void Context::init(size_t stack_size, void (*start_routine)(void*), void *arg)
 {
+  /* Reuse the existing stack if it's the right size. There's nothing on it
+   * worth preserving, so don't realloc() (and copy) it otherwise. */
+  if (this->stack.bottom == NULL || this->stack.size != stack_size) {
+    free(this->stack.bottom);
+    this->stack.bottom = malloc(stack_size);
+    assert(this->stack.bottom);
+  }
   this->stack.size = stack_size;
-  this->stack.bottom = realloc(this->stack.bottom, stack_size);
-  assert(this->stack.bottom);
 
   this->start_routine = start_routine;
   this->arg = arg;
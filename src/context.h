@@ -6,6 +6,7 @@
 #define LITHE_CONTEXT_H
 
 #include <stdarg.h>
+#include <stdint.h>
 #include <sys/queue.h>
 #include <parlib/uthread.h>
 
@@ -62,6 +63,10 @@ struct lithe_context {
   /* The context_stack associated with this context */
   lithe_context_stack_t stack;
 
+  /* When this context was last unblocked, if it hasn't run since and its
+   * scheduler keeps latency statistics, or 0 */
+  uint64_t unblock_time;
+
 };
 
 #ifdef __cplusplus
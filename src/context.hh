@@ -5,7 +5,11 @@
 #ifndef LITHE_CONTEXT_HH
 #define LITHE_CONTEXT_HH
 
+#include <assert.h>
+#include <stdlib.h>
 #include "context.h"
+#include "hart.h"
+#include <parlib/parlib.h>
 #include <parlib/mcs.h>
 
 namespace lithe {
@@ -27,65 +31,149 @@ private:
   void init(size_t stack_size, void (*start_routine)(void*), void *arg);
 };
 
+/* A factory for recycling contexts of type T, which must derive from Context
+ * and be constructible as T(stack_size, start_routine, arg). Recycled
+ * contexts are kept on a small free list per hart, which is only ever
+ * touched by the hart it belongs to and so needs no locking. Only when a
+ * hart's list runs empty or overflows does it exchange a batch of contexts
+ * with a shared, MCS-locked depot. At most 'max_size' contexts are kept
+ * around in total; any beyond that are deleted. */
 template<typename T>
 class ContextFactory {
 public:
   ContextFactory(size_t max_size = size_t(0)-1)
+    : max_size(max_size), depot_size(0), nharts(max_harts())
   {
-    mcs_pdr_init(&queue_lock);
-    TAILQ_INIT(&queue);
+    mcs_pdr_init(&depot_lock);
+    TAILQ_INIT(&depot);
+
+    /* Split the bound between the per-hart lists and the depot */
+    local_max = max_size / nharts < LOCAL_CACHE_SIZE ?
+                max_size / nharts : LOCAL_CACHE_SIZE;
+    depot_max = max_size - local_max * nharts;
+
+    caches = (HartCache*)parlib_aligned_alloc(ARCH_CL_SIZE,
+                                              sizeof(HartCache) * nharts);
+    assert(caches);
+    for (size_t i = 0; i < nharts; i++) {
+      TAILQ_INIT(&caches[i].queue);
+      caches[i].size = 0;
+    }
   }
 
-  ~ContextFactory()
+  virtual ~ContextFactory()
   {
-    lithe_context_t *e;
-    TAILQ_FOREACH_REVERSE(e, &queue, lithe_context_queue, link)
-      delete e;
+    for (size_t i = 0; i < nharts; i++)
+      delete_all(&caches[i].queue);
+    delete_all(&depot);
+    free(caches);
   }
 
   virtual T *create(size_t stack_size, void (*start_routine)(void*), void *arg)
   {
-    Context *c = NULL;
+    HartCache *cache = &caches[hart_id()];
 
-    /* Try and pull a context from the queue and recycle it */
-    mcs_lock_qnode_t qnode = MCS_QNODE_INIT;
-    mcs_pdr_lock(&queue_lock, &qnode);
-      if((c = (Context*)TAILQ_FIRST(&queue)) != NULL)
-      {
-        TAILQ_REMOVE(&queue, c, link);
-        queue_size--;
+    /* Refill our list from the depot if it has run dry */
+    if (cache->size == 0 && depot_size > 0) {
+      mcs_lock_qnode_t qnode = MCS_QNODE_INIT;
+      mcs_pdr_lock(&depot_lock, &qnode);
+        lithe_context_t *e;
+        while (cache->size < (local_max + 1) / 2 + 1 &&
+               (e = TAILQ_FIRST(&depot)) != NULL) {
+          TAILQ_REMOVE(&depot, e, link);
+          TAILQ_INSERT_TAIL(&cache->queue, e, link);
+          depot_size--;
+          cache->size++;
+        }
+      mcs_pdr_unlock(&depot_lock, &qnode);
+    }
+
+    /* Prefer a context whose stack can be reused as is */
+    lithe_context_t *e, *found = NULL;
+    TAILQ_FOREACH(e, &cache->queue, link) {
+      if (e->stack.size == stack_size) {
+        found = e;
+        break;
       }
-    mcs_pdr_unlock(&queue_lock, &qnode);
+    }
+    if (found == NULL)
+      found = TAILQ_FIRST(&cache->queue);
 
-    if (c == NULL)
-      c = new Context(stack_size, start_routine, arg);
-    else
-      c->reinit(stack_size, start_routine, arg);
+    if (found == NULL)
+      return new T(stack_size, start_routine, arg);
 
+    TAILQ_REMOVE(&cache->queue, found, link);
+    cache->size--;
+    T *c = to_T(found);
+    c->reinit(stack_size, start_routine, arg);
     return c;
   }
 
   virtual void destroy(T* c)
   {
-    /* See if we can afford to recycle the context, or just delete it */
-    if (queue_size == max_size) {
-      delete c;
-    }
-    else {
-      mcs_lock_qnode_t qnode = MCS_QNODE_INIT;
-      mcs_pdr_lock(&queue_lock, &qnode);
-        TAILQ_INSERT_TAIL(&queue, c, link);
-        queue_size++;
-      mcs_pdr_unlock(&queue_lock, &qnode);
+    HartCache *cache = &caches[hart_id()];
+    if (cache->size < local_max) {
+      TAILQ_INSERT_HEAD(&cache->queue, c, link);
+      cache->size++;
+      return;
     }
+
+    /* Our list is full, so move half of it (plus 'c') over to the depot,
+     * deleting whatever doesn't fit there either */
+    lithe_context_queue_t overflow = TAILQ_HEAD_INITIALIZER(overflow);
+    mcs_lock_qnode_t qnode = MCS_QNODE_INIT;
+    mcs_pdr_lock(&depot_lock, &qnode);
+      TAILQ_INSERT_TAIL(&cache->queue, c, link);
+      cache->size++;
+      size_t keep = local_max / 2;
+      while (cache->size > keep) {
+        lithe_context_t *e = TAILQ_LAST(&cache->queue, lithe_context_queue);
+        TAILQ_REMOVE(&cache->queue, e, link);
+        cache->size--;
+        if (depot_size < depot_max) {
+          TAILQ_INSERT_TAIL(&depot, e, link);
+          depot_size++;
+        }
+        else {
+          TAILQ_INSERT_TAIL(&overflow, e, link);
+        }
+      }
+    mcs_pdr_unlock(&depot_lock, &qnode);
+    delete_all(&overflow);
   }
 
 private:
-  size_t max_size;
-  size_t queue_size;
+  /* Upper bound on the size of each hart's free list */
+  static const size_t LOCAL_CACHE_SIZE = 16;
+
+  struct HartCache {
+    lithe_context_queue_t queue;
+    size_t size;
+  } __attribute__((aligned(ARCH_CL_SIZE)));
+
+  static T *to_T(lithe_context_t *e)
+  {
+    return static_cast<T*>(static_cast<Context*>(e));
+  }
 
-  mcs_pdr_lock_t queue_lock;
-  lithe_context_queue_t queue;
+  static void delete_all(lithe_context_queue_t *queue)
+  {
+    lithe_context_t *e;
+    while ((e = TAILQ_FIRST(queue)) != NULL) {
+      TAILQ_REMOVE(queue, e, link);
+      delete to_T(e);
+    }
+  }
+
+  size_t max_size;
+  size_t local_max;
+  size_t depot_max;
+  size_t depot_size;
+  size_t nharts;
+  HartCache *caches;
+
+  mcs_pdr_lock_t depot_lock;
+  lithe_context_queue_t depot;
 };
 
 }
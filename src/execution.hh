@@ -0,0 +1,416 @@
+/*
+ * Lithe Sender/Receiver Adaptor
+ *
+ * A small sender/receiver layer in the style of P2300 (std::execution) whose
+ * work runs on a lithe::Executor, and hence on harts shared through the lithe
+ * scheduler hierarchy rather than on a private thread pool.
+ *
+ * Senders here complete with at most one value (their 'value_type', which may
+ * be void) and are connected to receivers providing set_value() and
+ * set_stopped(). Connecting a sender yields an operation state that embeds
+ * the operation states of everything upstream of it, including the work
+ * items bulk() fans out into, so starting a pipeline performs no heap
+ * allocation.
+ *
+ * Requires C++17.
+ */
+
+#ifndef LITHE_EXECUTION_HH
+#define LITHE_EXECUTION_HH
+
+#if __cplusplus >= 201703L
+
+#include <atomic>
+#include <cstddef>
+#include <optional>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include "executor.hh"
+#include "semaphore.h"
+
+namespace lithe {
+namespace execution {
+
+/* Maximum number of work items a single bulk() operation fans out into */
+static const size_t BULK_MAX_CHUNKS = 64;
+
+namespace detail {
+
+template<class S, class R>
+using connect_result_t = decltype(std::declval<S>().connect(std::declval<R>()));
+
+/* The result of calling 'f' with a value of type T (or nothing, for void) */
+template<class F, class T>
+struct invoke_result { typedef std::invoke_result_t<F, T> type; };
+template<class F>
+struct invoke_result<F, void> { typedef std::invoke_result_t<F> type; };
+
+/* Storage for a value of type T, which may be void */
+template<class T>
+struct slot {
+  std::optional<T> value;
+  template<class... A> void set(A&&... a) { value.emplace(std::forward<A>(a)...); }
+  template<class R> void deliver(R &r) { r.set_value(std::move(*value)); }
+  std::tuple<T> as_tuple() { return std::tuple<T>(std::move(*value)); }
+};
+template<>
+struct slot<void> {
+  void set() {}
+  template<class R> void deliver(R &r) { r.set_value(); }
+  std::tuple<> as_tuple() { return std::tuple<>(); }
+};
+
+}
+
+/* Sender of a single, value-less completion on one of an executor's workers */
+class schedule_sender {
+  template<class R>
+  class op : WorkItem {
+  public:
+    op(Executor *executor, R r) : executor(executor), r(std::move(r))
+      { run = &op::execute; }
+    op(const op&) = delete;
+    void start() { executor->submit(this); }
+
+  private:
+    static void execute(WorkItem *item) { static_cast<op*>(item)->r.set_value(); }
+
+    Executor *executor;
+    R r;
+  };
+
+public:
+  typedef void value_type;
+
+  explicit schedule_sender(Executor *executor) : executor_(executor) {}
+  Executor *executor() const { return executor_; }
+
+  template<class R>
+  op<R> connect(R r) && { return op<R>(executor_, std::move(r)); }
+
+private:
+  Executor *executor_;
+};
+
+/* A scheduler handing out work to a lithe::Executor */
+class scheduler {
+public:
+  explicit scheduler(Executor &executor) : executor(&executor) {}
+
+  schedule_sender schedule() const { return schedule_sender(executor); }
+
+  bool operator==(const scheduler &other) const { return executor == other.executor; }
+  bool operator!=(const scheduler &other) const { return executor != other.executor; }
+
+private:
+  Executor *executor;
+};
+
+/* then(s, f): completes with f applied to the value s completes with */
+template<class S, class F>
+class then_sender {
+  template<class R>
+  class op {
+    struct receiver {
+      op *self;
+      template<class... A>
+      void set_value(A&&... a) { self->finish(std::forward<A>(a)...); }
+      void set_stopped() { self->r.set_stopped(); }
+    };
+
+  public:
+    op(S s, F f, R r)
+      : f(std::move(f)), r(std::move(r)),
+        inner(std::move(s).connect(receiver{this})) {}
+    op(const op&) = delete;
+    void start() { inner.start(); }
+
+    template<class... A>
+    void finish(A&&... a)
+    {
+      if constexpr (std::is_void_v<std::invoke_result_t<F&, A...> >) {
+        f(std::forward<A>(a)...);
+        r.set_value();
+      }
+      else {
+        r.set_value(f(std::forward<A>(a)...));
+      }
+    }
+
+  private:
+    F f;
+    R r;
+    detail::connect_result_t<S, receiver> inner;
+  };
+
+public:
+  typedef typename detail::invoke_result<F&, typename S::value_type>::type value_type;
+
+  then_sender(S s, F f) : s(std::move(s)), f(std::move(f)) {}
+  Executor *executor() const { return s.executor(); }
+
+  template<class R>
+  op<R> connect(R r) && { return op<R>(std::move(s), std::move(f), std::move(r)); }
+
+private:
+  S s;
+  F f;
+};
+
+template<class S, class F>
+then_sender<S, F> then(S s, F f)
+{
+  return then_sender<S, F>(std::move(s), std::move(f));
+}
+
+/* bulk(s, shape, f): once s completes, calls f(i, value) for every i in
+ * [0, shape), split into contiguous ranges run in parallel on the executor s
+ * completes on, then completes with s's value. */
+template<class S, class Shape, class F>
+class bulk_sender {
+  template<class R>
+  class op {
+    struct receiver {
+      op *self;
+      template<class... A>
+      void set_value(A&&... a) { self->fan_out(std::forward<A>(a)...); }
+      void set_stopped() { self->r.set_stopped(); }
+    };
+
+    struct chunk : WorkItem {
+      op *self;
+      Shape begin;
+      Shape end;
+    };
+
+  public:
+    op(S s, Shape shape, F f, R r)
+      : executor(s.executor()), shape(shape), f(std::move(f)), r(std::move(r)),
+        inner(std::move(s).connect(receiver{this})) {}
+    op(const op&) = delete;
+    void start() { inner.start(); }
+
+    template<class... A>
+    void fan_out(A&&... a)
+    {
+      values.set(std::forward<A>(a)...);
+      if (shape <= 0) {
+        values.deliver(r);
+        return;
+      }
+
+      size_t nchunks = size_t(shape) < BULK_MAX_CHUNKS ? size_t(shape) : BULK_MAX_CHUNKS;
+      remaining.store(nchunks, std::memory_order_relaxed);
+      for (size_t i = 0; i < nchunks; i++) {
+        chunks[i].run = &op::run_chunk;
+        chunks[i].self = this;
+        chunks[i].begin = Shape(size_t(shape) * i / nchunks);
+        chunks[i].end = Shape(size_t(shape) * (i + 1) / nchunks);
+      }
+
+      /* Hand out all but the first range, which we run ourselves */
+      for (size_t i = 1; i < nchunks; i++)
+        executor->submit(&chunks[i]);
+      run_chunk(&chunks[0]);
+    }
+
+  private:
+    static void run_chunk(WorkItem *item)
+    {
+      chunk *c = static_cast<chunk*>(item);
+      op *self = c->self;
+      for (Shape i = c->begin; i < c->end; i++)
+        self->call(i);
+      /* Whoever finishes last completes the operation */
+      if (self->remaining.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        self->values.deliver(self->r);
+    }
+
+    void call(Shape i)
+    {
+      if constexpr (std::is_void_v<typename S::value_type>)
+        f(i);
+      else
+        f(i, *values.value);
+    }
+
+    Executor *executor;
+    Shape shape;
+    F f;
+    R r;
+    detail::slot<typename S::value_type> values;
+    std::atomic<size_t> remaining;
+    chunk chunks[BULK_MAX_CHUNKS];
+    detail::connect_result_t<S, receiver> inner;
+  };
+
+public:
+  typedef typename S::value_type value_type;
+
+  bulk_sender(S s, Shape shape, F f) : s(std::move(s)), shape(shape), f(std::move(f)) {}
+  Executor *executor() const { return s.executor(); }
+
+  template<class R>
+  op<R> connect(R r) && { return op<R>(std::move(s), shape, std::move(f), std::move(r)); }
+
+private:
+  S s;
+  Shape shape;
+  F f;
+};
+
+template<class S, class Shape, class F>
+bulk_sender<S, Shape, F> bulk(S s, Shape shape, F f)
+{
+  return bulk_sender<S, Shape, F>(std::move(s), shape, std::move(f));
+}
+
+/* when_all(s...): starts every s at once and completes when all of them have.
+ * Completes with a std::tuple of the non-void values of its children (or with
+ * no value if they are all void), or is stopped if any of them was. */
+template<class... S>
+class when_all_sender {
+  typedef decltype(std::tuple_cat(std::declval<detail::slot<typename S::value_type>&>().as_tuple()...)) values_tuple;
+
+  template<class R, class Idx>
+  class op;
+
+  template<class R, size_t... I>
+  class op<R, std::index_sequence<I...> > {
+    template<size_t J>
+    struct receiver {
+      op *self;
+      template<class... A>
+      void set_value(A&&... a)
+      {
+        std::get<J>(self->values).set(std::forward<A>(a)...);
+        self->arrive();
+      }
+      void set_stopped()
+      {
+        self->stopped.store(true, std::memory_order_relaxed);
+        self->arrive();
+      }
+    };
+
+    /* One base class per child, so every child's operation state can be
+     * constructed in place even though none of them can be moved */
+    template<size_t J, class C>
+    struct child {
+      detail::connect_result_t<C, receiver<J> > state;
+      child(C c, op *self) : state(std::move(c).connect(receiver<J>{self})) {}
+    };
+
+  public:
+    op(std::tuple<S...> &&senders, R r)
+      : r(std::move(r)), remaining(sizeof...(S)), stopped(false),
+        children(std::move(senders), this) {}
+    op(const op&) = delete;
+
+    void start()
+    {
+      if constexpr (sizeof...(S) == 0)
+        r.set_value();
+      else
+        children.start();
+    }
+
+  private:
+    struct all_children : child<I, S>... {
+      all_children(std::tuple<S...> &&senders, op *self)
+        : child<I, S>(std::move(std::get<I>(senders)), self)... {}
+      void start() { (child<I, S>::state.start(), ...); }
+    };
+
+    void arrive()
+    {
+      if (remaining.fetch_sub(1, std::memory_order_acq_rel) != 1)
+        return;
+      if (stopped.load(std::memory_order_relaxed))
+        r.set_stopped();
+      else if constexpr (std::tuple_size<values_tuple>::value == 0)
+        r.set_value();
+      else
+        r.set_value(std::tuple_cat(std::get<I>(values).as_tuple()...));
+    }
+
+    R r;
+    std::tuple<detail::slot<typename S::value_type>...> values;
+    std::atomic<size_t> remaining;
+    std::atomic<bool> stopped;
+    all_children children;
+  };
+
+public:
+  typedef std::conditional_t<std::tuple_size<values_tuple>::value == 0,
+                             void, values_tuple> value_type;
+
+  explicit when_all_sender(S... senders) : senders(std::move(senders)...) {}
+  Executor *executor() const { return std::get<0>(senders).executor(); }
+
+  template<class R>
+  op<R, std::index_sequence_for<S...> > connect(R r) &&
+  {
+    return op<R, std::index_sequence_for<S...> >(std::move(senders), std::move(r));
+  }
+
+private:
+  std::tuple<S...> senders;
+};
+
+template<class... S>
+when_all_sender<S...> when_all(S... senders)
+{
+  return when_all_sender<S...>(std::move(senders)...);
+}
+
+namespace detail {
+
+template<class Result>
+struct sync_wait_state {
+  lithe_sem_t done;
+  std::optional<Result> result;
+};
+
+template<class Result>
+struct sync_wait_receiver {
+  sync_wait_state<Result> *st;
+
+  template<class... A>
+  void set_value(A&&... a)
+  {
+    if constexpr (sizeof...(A) == 0)
+      st->result.emplace(true);
+    else
+      st->result.emplace(std::forward<A>(a)...);
+    lithe_sem_post(&st->done);
+  }
+  void set_stopped() { lithe_sem_post(&st->done); }
+};
+
+}
+
+/* Start 's' and block the calling lithe context until it completes. Returns
+ * its value (or true, for void senders), or nothing if it was stopped. */
+template<class S>
+auto sync_wait(S s)
+{
+  typedef typename S::value_type T;
+  typedef std::conditional_t<std::is_void_v<T>, bool, T> result_type;
+
+  detail::sync_wait_state<result_type> st;
+  lithe_sem_init(&st.done, 0);
+
+  auto op = std::move(s).connect(detail::sync_wait_receiver<result_type>{&st});
+  op.start();
+  lithe_sem_wait(&st.done);
+  return std::move(st.result);
+}
+
+}
+}
+
+#endif // __cplusplus >= 201703L
+
+#endif // LITHE_EXECUTION_HH
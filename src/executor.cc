@@ -0,0 +1,74 @@
+#include "executor.hh"
+#include "hart.h"
+#include "internal/assert.h"
+
+using namespace lithe;
+
+Executor::Executor(lithe_fork_join_sched_t *sched, int nworkers,
+                   size_t stack_size)
+  : sched_(sched), nworkers(nworkers > 0 ? nworkers : max_harts()),
+    stopping(false), head(NULL), tail(NULL)
+{
+  assert(sched);
+  mcs_pdr_init(&lock);
+  lithe_sem_init(&ready, 0);
+  lithe_latch_init(&exited, this->nworkers);
+
+  for (int i = 0; i < this->nworkers; i++)
+    lithe_fork_join_context_create(sched, stack_size, worker, this);
+}
+
+Executor::~Executor()
+{
+  /* Wake every worker one last time without any work to give it */
+  stopping = true;
+  wmb();
+  lithe_sem_post_n(&ready, nworkers);
+  lithe_latch_wait(&exited);
+}
+
+void Executor::submit(WorkItem *item)
+{
+  item->next = NULL;
+  mcs_lock_qnode_t qnode = MCS_QNODE_INIT;
+  mcs_pdr_lock(&lock, &qnode);
+    if (tail)
+      tail->next = item;
+    else
+      head = item;
+    tail = item;
+  mcs_pdr_unlock(&lock, &qnode);
+  lithe_sem_post(&ready);
+}
+
+WorkItem *Executor::pop()
+{
+  mcs_lock_qnode_t qnode = MCS_QNODE_INIT;
+  mcs_pdr_lock(&lock, &qnode);
+    WorkItem *item = head;
+    if (item) {
+      head = item->next;
+      if (head == NULL)
+        tail = NULL;
+    }
+  mcs_pdr_unlock(&lock, &qnode);
+  return item;
+}
+
+void Executor::worker(void *arg)
+{
+  Executor *self = (Executor*)arg;
+
+  /* Each permit on 'ready' stands for either one item or one stop request,
+   * so a worker only ever finds the queue empty once it's being stopped. */
+  while (true) {
+    lithe_sem_wait(&self->ready);
+    WorkItem *item = self->pop();
+    if (item == NULL) {
+      assert(self->stopping);
+      break;
+    }
+    item->run(item);
+  }
+  lithe_latch_count_down(&self->exited, 1);
+}
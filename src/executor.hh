@@ -0,0 +1,65 @@
+/*
+ * Lithe Executors
+ */
+
+#ifndef LITHE_EXECUTOR_HH
+#define LITHE_EXECUTOR_HH
+
+#include <parlib/mcs.h>
+#include "fork_join_sched.h"
+#include "semaphore.h"
+#include "latch.h"
+
+namespace lithe {
+
+/* A unit of stackless work, e.g. the resumption of a coroutine. Embedded
+ * (intrusively) in whatever object describes the work, so submitting work
+ * never allocates. */
+struct WorkItem {
+  WorkItem *next;
+  void (*run)(WorkItem *item);
+};
+
+/* Runs WorkItems on a fork-join scheduler. A fixed number of worker
+ * contexts, created in the scheduler like any other context, pull items off
+ * the executor's own FIFO; the scheduler's run queues only ever hold the
+ * workers themselves. Workers sleep on a lithe semaphore while there is no
+ * work, so their harts go to the scheduler's other (stackful) contexts.
+ *
+ * An Executor must be created and destroyed from a context running in
+ * 'sched'. */
+class Executor {
+public:
+  Executor(lithe_fork_join_sched_t *sched, int nworkers = 0,
+           size_t stack_size = DEFAULT_STACK_SIZE);
+  ~Executor();
+
+  /* Queue 'item' to be run by one of the workers. */
+  void submit(WorkItem *item);
+
+  lithe_fork_join_sched_t *sched() const { return sched_; }
+  int num_workers() const { return nworkers; }
+
+  static const size_t DEFAULT_STACK_SIZE = 262144;
+
+private:
+  static void worker(void *arg);
+  WorkItem *pop();
+
+  lithe_fork_join_sched_t *sched_;
+  int nworkers;
+  volatile bool stopping;
+
+  mcs_pdr_lock_t lock;
+  WorkItem *head;
+  WorkItem *tail;
+  lithe_sem_t ready;
+  lithe_latch_t exited;
+
+  Executor(const Executor&);
+  Executor &operator=(const Executor&);
+};
+
+}
+
+#endif
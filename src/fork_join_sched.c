@@ -4,11 +4,13 @@
  * See COPYING for details.
  */
 
+#include <errno.h>
 #include <sys/mman.h>
 #include <parlib/waitfreelist.h>
 #include "fork_join_sched.h"
 #include "lithe.h"
 #include "internal/assert.h"
+#include "internal/trace.h"
 
 static struct wfl sched_zombie_list = WFL_INITIALIZER(sched_zombie_list);
 static struct wfl context_zombie_list = WFL_INITIALIZER(context_zombie_list);
@@ -24,7 +26,9 @@ const lithe_sched_funcs_t lithe_fork_join_sched_funcs = {
   .context_block   = lithe_fork_join_sched_context_block,
   .context_unblock = lithe_fork_join_sched_context_unblock,
   .context_yield   = lithe_fork_join_sched_context_yield,
-  .context_exit    = lithe_fork_join_sched_context_exit
+  .context_exit    = lithe_fork_join_sched_context_exit,
+  .context_unblock_batch = lithe_fork_join_sched_context_unblock_batch,
+  .runnable_contexts = lithe_fork_join_sched_runnable_contexts
 };
 
 static lithe_fork_join_context_t *__ctx_alloc(size_t stacksize)
@@ -137,14 +141,18 @@ static lithe_fork_join_context_t *__thread_dequeue()
 		{
 			lithe_fork_join_context_t *ctx = NULL;
 			int num_to_steal = (tqsize(vcoreid) + 1) / 2;
+			steal_attempts(vcore_id())++;
 			if (num_to_steal) {
 				ctx = tdequeue(vcoreid);
 				if (ctx) {
-					for (int i=1; i<num_to_steal; i++) {
+					int i;
+					for (i=1; i<num_to_steal; i++) {
 						lithe_fork_join_context_t *u = tdequeue(vcoreid);
 						if (u) __thread_enqueue(u, false);
 						else break;
 					}
+					steals(vcore_id())++;
+					__lithe_trace(STEAL, vcoreid, i);
 				}
 			}
 			return ctx;
@@ -217,6 +225,8 @@ void lithe_fork_join_sched_init(lithe_fork_join_sched_t *sched,
     tqsize_s(sched, i) = 0;
     rseed_s(sched, i) = i;
     vconline_s(sched, i) = false;
+    steal_attempts_s(sched, i) = 0;
+    steals_s(sched, i) = 0;
   }
 
   memset(main_context, 0, sizeof(*main_context));
@@ -295,6 +305,24 @@ void lithe_fork_join_sched_join_all(lithe_fork_join_sched_t *sched)
   lithe_context_block(block_main_context, sched);
 }
 
+int lithe_fork_join_stats_snapshot(lithe_fork_join_sched_t *sched,
+                                   lithe_fork_join_stats_t *out)
+{
+  if (sched == NULL || out == NULL)
+    return EINVAL;
+
+  memset(out, 0, sizeof(*out));
+  lithe_stats_snapshot(&sched->sched, &out->sched);
+  for (int i = 0; i < max_vcores(); i++) {
+    out->steal_attempts += steal_attempts_s(sched, i);
+    out->steals += steals_s(sched, i);
+    out->queue_depth += tqsize_s(sched, i);
+  }
+  out->context_zombies = wfl_size(&context_zombie_list);
+  out->sched_zombies = wfl_size(&sched_zombie_list);
+  return 0;
+}
+
 void lithe_fork_join_sched_hart_request(lithe_sched_t *__this,
                                        lithe_sched_t *child,
                                        int h)
@@ -424,6 +452,72 @@ void lithe_fork_join_sched_context_unblock(lithe_sched_t *__this,
 	schedule_context(ctx, false);
 }
 
+void lithe_fork_join_sched_context_unblock_batch(lithe_sched_t *__this,
+                                                 lithe_context_t **c,
+                                                 size_t n)
+{
+	/* Pick a queue for every context up front, and gather the contexts bound
+	 * for each queue on a list of our own. Nobody else can touch a blocked
+	 * context, so its link is ours to use until it is on a run queue. */
+	if (n == 0)
+		return;
+
+	size_t ngroups = 0;
+	size_t max_groups = n < max_vcores() ? n : max_vcores();
+	struct {
+		int vcoreid;
+		size_t size;
+		lithe_context_queue_t queue;
+	} groups[max_groups];
+
+	for (size_t i = 0; i < n; i++) {
+		lithe_fork_join_context_t *ctx = (void*)c[i];
+		assert(ctx->context.sched == __this);
+		assert(ctx->state == FJS_CTX_BLOCKED);
+		if (ctx->preferred_vcq == -1 || !vconline(ctx->preferred_vcq))
+			ctx->preferred_vcq = get_next_queue_id();
+		ctx->state = FJS_CTX_RUNNABLE;
+
+		size_t g;
+		for (g = 0; g < ngroups; g++)
+			if (groups[g].vcoreid == ctx->preferred_vcq)
+				break;
+		if (g == ngroups) {
+			assert(ngroups < max_groups);
+			groups[g].vcoreid = ctx->preferred_vcq;
+			groups[g].size = 0;
+			TAILQ_INIT(&groups[g].queue);
+			ngroups++;
+		}
+		TAILQ_INSERT_TAIL(&groups[g].queue, &ctx->context, link);
+		groups[g].size++;
+	}
+
+	/* Then take each queue's lock only once, splicing in its whole list. Once
+	 * a lock is dropped, the contexts behind it may already be running again
+	 * (or gone), so they must not be touched anymore. */
+	for (size_t g = 0; g < ngroups; g++) {
+		int vcoreid = groups[g].vcoreid;
+		spin_pdr_lock(&tqlock(vcoreid));
+		TAILQ_CONCAT(&tqueue(vcoreid), &groups[g].queue, link);
+		tqsize(vcoreid) += groups[g].size;
+		spin_pdr_unlock(&tqlock(vcoreid));
+	}
+
+	/* And make a single, combined hart request for the whole batch. */
+	lithe_hart_request(n);
+}
+
+long lithe_fork_join_sched_runnable_contexts(lithe_sched_t *__this)
+{
+	/* Read without the queue locks, so only approximate. */
+	lithe_fork_join_sched_t *sched = (void*)__this;
+	long n = 0;
+	for (int i = 0; i < max_vcores(); i++)
+		n += tqsize_s(sched, i);
+	return n;
+}
+
 void lithe_fork_join_sched_context_yield(lithe_sched_t *__this,
                                          lithe_context_t *c)
 {
@@ -13,6 +13,7 @@
 
 #include "sched.h"
 #include "context.h"
+#include "stats.h"
 #include <parlib/waitfreelist.h>
 #include <parlib/spinlock.h>
 
@@ -38,17 +39,23 @@ struct lithe_fork_join_vc_mgmt {
 	int tqsize;
 	unsigned int rseed;
 	bool vconline;
+	unsigned long steal_attempts;
+	unsigned long steals;
 } __attribute__((aligned(ARCH_CL_SIZE)));
 #define tqueue_s(sched, i)   (sched)->vc_mgmt[(i)].tqueue
 #define tqlock_s(sched, i)   (sched)->vc_mgmt[(i)].tqlock
 #define tqsize_s(sched, i)   (sched)->vc_mgmt[(i)].tqsize
 #define rseed_s(sched, i)    (sched)->vc_mgmt[(i)].rseed
 #define vconline_s(sched, i) (sched)->vc_mgmt[(i)].vconline
+#define steal_attempts_s(sched, i) (sched)->vc_mgmt[(i)].steal_attempts
+#define steals_s(sched, i)   (sched)->vc_mgmt[(i)].steals
 #define tqueue(i)   tqueue_s((lithe_fork_join_sched_t*)lithe_sched_current(), i)
 #define tqlock(i)   tqlock_s((lithe_fork_join_sched_t*)lithe_sched_current(), i)
 #define tqsize(i)   tqsize_s((lithe_fork_join_sched_t*)lithe_sched_current(), i)
 #define rseed(i)    rseed_s((lithe_fork_join_sched_t*)lithe_sched_current(), i)
 #define vconline(i) vconline_s((lithe_fork_join_sched_t*)lithe_sched_current(), i)
+#define steal_attempts(i) steal_attempts_s((lithe_fork_join_sched_t*)lithe_sched_current(), i)
+#define steals(i)   steals_s((lithe_fork_join_sched_t*)lithe_sched_current(), i)
 
 typedef struct {
   lithe_sched_t sched;
@@ -69,6 +76,25 @@ typedef struct {
   int stack_offset;
 } lithe_fork_join_context_t;
 
+/* Statistics of a fork-join scheduler, as returned by
+ * lithe_fork_join_stats_snapshot() */
+typedef struct {
+  /* Generic scheduler statistics (all zero unless lithe stats are enabled) */
+  lithe_stats_t sched;
+
+  /* Attempts by a hart with an empty queue to steal from another hart's
+   * queue, and how many of them came away with a context */
+  uint64_t steal_attempts;
+  uint64_t steals;
+
+  /* Contexts sitting in a run queue right now */
+  size_t queue_depth;
+
+  /* Contexts and schedulers waiting on the (global) zombie lists for reuse */
+  size_t context_zombies;
+  size_t sched_zombies;
+} lithe_fork_join_stats_t;
+
 
 /* API to request harts and make sure they are tracked properly when
  * "inheriting" from the lithe_fork_join_sched.  You should call this instead
@@ -97,6 +123,11 @@ void lithe_fork_join_context_destroy(lithe_fork_join_context_t *context);
 void lithe_fork_join_sched_join_one(lithe_fork_join_sched_t *sched);
 void lithe_fork_join_sched_join_all(lithe_fork_join_sched_t *sched);
 
+/* Fill 'out' with the statistics of 'sched'. The fork-join specific counters
+ * are always kept, whether or not lithe stats are enabled. */
+int lithe_fork_join_stats_snapshot(lithe_fork_join_sched_t *sched,
+                                   lithe_fork_join_stats_t *out);
+
 /* Callback implementations that can be used by schedulers that "inherit" from
  * the lithe_fork_join_sched. */
 void lithe_fork_join_sched_hart_request(lithe_sched_t *__this,
@@ -115,6 +146,10 @@ void lithe_fork_join_sched_context_block(lithe_sched_t *__this,
                                          lithe_context_t *c);
 void lithe_fork_join_sched_context_unblock(lithe_sched_t *__this,
                                            lithe_context_t *c);
+void lithe_fork_join_sched_context_unblock_batch(lithe_sched_t *__this,
+                                                 lithe_context_t **c,
+                                                 size_t n);
+long lithe_fork_join_sched_runnable_contexts(lithe_sched_t *__this);
 void lithe_fork_join_sched_context_yield(lithe_sched_t *__this,
                                          lithe_context_t *c);
 void lithe_fork_join_sched_context_exit(lithe_sched_t *__this,
@@ -100,14 +100,26 @@ int futex_wake_one(int *uaddr)
   return 0;
 }
 
+/* Maximum number of contexts handed to lithe_context_unblock_many() at once
+ * when waking up a futex queue. */
+#define FUTEX_UNBLOCK_BATCH 64
+
 static inline int unblock_futex_queue(struct futex_tailq *q)
 {
-  int num = 0;
+  lithe_context_t *batch[FUTEX_UNBLOCK_BATCH];
+  int num = 0, nbatch = 0;
   struct futex_element *e,*n;
   for (e = STAILQ_FIRST(q), num = 0; e != NULL; e = n, num++) {
+    /* Grab the next element before this one's context can possibly run
+     * again, since the element lives on that context's stack. */
     n = STAILQ_NEXT(e, next);
-    lithe_context_unblock(e->context);
+    batch[nbatch++] = e->context;
+    if (nbatch == FUTEX_UNBLOCK_BATCH) {
+      lithe_context_unblock_many(batch, nbatch);
+      nbatch = 0;
+    }
   }
+  lithe_context_unblock_many(batch, nbatch);
 
   return num;
 }
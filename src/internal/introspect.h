@@ -0,0 +1,15 @@
+#ifndef LITHE_INTERNAL_INTROSPECT_H
+#define LITHE_INTERNAL_INTROSPECT_H
+
+#include "../introspect.h"
+
+/* Register the base scheduler and read LITHE_DUMP from the environment.
+ * Called from lithe_lib_init(). */
+void __lithe_registry_init(lithe_sched_t *base);
+
+/* Add a scheduler to the registry as it enters, and remove it once it has
+ * exited and given up its last hart. */
+void __lithe_registry_add(lithe_sched_t *sched);
+void __lithe_registry_remove(lithe_sched_t *sched);
+
+#endif
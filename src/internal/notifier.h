@@ -0,0 +1,30 @@
+#ifndef LITHE_INTERNAL_NOTIFIER_H
+#define LITHE_INTERNAL_NOTIFIER_H
+
+#include <stdbool.h>
+#include "../notifier.h"
+
+/* Inbox of notifiers with a context waiting to be unblocked */
+extern lithe_notifier_t *volatile __lithe_notifier_inbox;
+
+/* Set up the inbox doorbell. */
+void __lithe_notifier_init();
+
+/* Unblock the contexts of all notifiers in the inbox. Runs in vcore context. */
+void __lithe_notifier_drain();
+
+/* Park the calling hart on the doorbell instead of yielding it to the
+ * system, if there are contexts waiting on a notifier and no other hart is
+ * parked already. Returns false if the hart didn't park. */
+bool __lithe_notifier_park();
+
+/* Claim the parked hart, if any, and wake it. Returns true only to the one
+ * caller that claimed it, which may then count on it as a woken hart. */
+bool __lithe_notifier_ring();
+
+static inline bool __lithe_notifier_pending()
+{
+  return __lithe_notifier_inbox != NULL;
+}
+
+#endif
@@ -0,0 +1,22 @@
+#ifndef LITHE_INTERNAL_PROFILE_H
+#define LITHE_INTERNAL_PROFILE_H
+
+#include <stdbool.h>
+#include "../profile.h"
+
+/* Read LITHE_PROFILE from the environment. Called from lithe_lib_init(). */
+void __lithe_profile_init();
+
+extern volatile bool __lithe_profile_enabled;
+
+/* Give the calling hart its SIGPROF timer, if it doesn't have one yet. */
+void __lithe_profile_arm();
+
+/* Called every time a hart enters lithe, so harts get their timer lazily */
+static inline void __lithe_profile_hart_enter()
+{
+  if (__builtin_expect(__lithe_profile_enabled, 0))
+    __lithe_profile_arm();
+}
+
+#endif
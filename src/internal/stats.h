@@ -0,0 +1,134 @@
+#ifndef LITHE_INTERNAL_STATS_H
+#define LITHE_INTERNAL_STATS_H
+
+#include <stdint.h>
+#include <time.h>
+#include <parlib/vcore.h>
+#include "../stats.h"
+#include "../context.h"
+
+/* One hart's counters for one scheduler. Only ever written by that hart. */
+struct lithe_hart_stats {
+  lithe_stats_t counters;
+} __attribute__((aligned(ARCH_CL_SIZE)));
+
+/* Read LITHE_STATS from the environment and remember which scheduler is the
+ * base scheduler. Called from lithe_lib_init(). */
+void __lithe_stats_init(lithe_sched_t *base);
+
+/* Allocate a zeroed set of per-hart counters if statistics are enabled, or
+ * return NULL if they aren't. */
+struct lithe_hart_stats *__lithe_stats_alloc();
+void __lithe_stats_free(struct lithe_hart_stats *stats);
+
+/* Same for a scheduler's latency histogram */
+struct lithe_latency *__lithe_latency_alloc();
+void __lithe_latency_free(struct lithe_latency *latency);
+
+#define __lithe_stats_add(sched, field, n) \
+  do { \
+    struct lithe_hart_stats *__s = (sched)->stats; \
+    if (__s) \
+      __s[vcore_id()].counters.field += (n); \
+  } while (0)
+
+#define __lithe_stats_inc(sched, field) __lithe_stats_add(sched, field, 1)
+
+static inline uint64_t __lithe_stats_now()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static inline int __lithe_latency_bucket(uint64_t ns)
+{
+  if (ns < (1 << LITHE_LATENCY_SUB_BITS))
+    return ns;
+  int magnitude = 63 - __builtin_clzll(ns);
+  int shift = magnitude - LITHE_LATENCY_SUB_BITS;
+  int sub = (ns >> shift) & ((1 << LITHE_LATENCY_SUB_BITS) - 1);
+  return ((shift + 1) << LITHE_LATENCY_SUB_BITS) + sub;
+}
+
+/* Note when 'context' was unblocked, if its scheduler keeps a histogram */
+static inline void __lithe_latency_unblock(lithe_context_t *context)
+{
+  if (context->sched->latency)
+    context->unblock_time = __lithe_stats_now();
+}
+
+/* Record how long 'context' waited to run since it was unblocked, if it was.
+ * Any number of harts may record into the same histogram at once. */
+static inline void __lithe_latency_run(lithe_context_t *context)
+{
+  if (context->unblock_time == 0)
+    return;
+
+  struct lithe_latency *l = context->sched->latency;
+  if (l) {
+    uint64_t now = __lithe_stats_now();
+    uint64_t ns = now > context->unblock_time ? now - context->unblock_time : 0;
+    __sync_fetch_and_add(&l->count, 1);
+    __sync_fetch_and_add(&l->sum_ns, ns);
+    __sync_fetch_and_add(&l->buckets[__lithe_latency_bucket(ns)], 1);
+    uint64_t max = l->max_ns;
+    while (ns > max && !__sync_bool_compare_and_swap(&l->max_ns, max, ns))
+      max = l->max_ns;
+  }
+  context->unblock_time = 0;
+}
+
+/* What a hart is spending its time on, for utilization accounting */
+enum {
+  LITHE_HART_CONTEXT,   /* running a context of 'sched' */
+  LITHE_HART_SCHED,     /* running code of 'sched' in vcore context */
+  LITHE_HART_IDLE,      /* spinning or parked, waiting for work */
+  LITHE_HART_YIELDED,   /* handed back to the system */
+};
+
+/* A hart's current state, the scheduler it is charged to, and since when.
+ * Only ever written by that hart. */
+struct lithe_hart_account {
+  int state;
+  lithe_sched_t *sched;
+  uint64_t since;
+} __attribute__((aligned(ARCH_CL_SIZE)));
+
+/* One per hart, or NULL if statistics are disabled */
+extern struct lithe_hart_account *__lithe_hart_accounts;
+
+static inline uint64_t *__lithe_account_bucket(lithe_stats_t *c, int state)
+{
+  switch (state) {
+    case LITHE_HART_CONTEXT: return &c->context_ns;
+    case LITHE_HART_SCHED:   return &c->sched_ns;
+    case LITHE_HART_IDLE:    return &c->idle_ns;
+    default:                 return &c->yielded_ns;
+  }
+}
+
+/* Charge the time since the calling hart's last transition to its previous
+ * state and scheduler, and start charging to 'state' and 'sched' instead.
+ * Must be called before a hart stops being counted in a scheduler's 'harts',
+ * since the scheduler may exit (freeing its statistics) right after. */
+static inline void __lithe_account(int state, lithe_sched_t *sched)
+{
+  struct lithe_hart_account *accounts = __lithe_hart_accounts;
+  if (accounts == NULL)
+    return;
+
+  int hart = vcore_id();
+  struct lithe_hart_account *a = &accounts[hart];
+  if (a->state == state && a->sched == sched)
+    return;
+
+  uint64_t now = __lithe_stats_now();
+  if (a->sched && a->sched->stats)
+    *__lithe_account_bucket(&a->sched->stats[hart].counters, a->state) += now - a->since;
+  a->state = state;
+  a->sched = sched;
+  a->since = now;
+}
+
+#endif
@@ -0,0 +1,73 @@
+#ifndef LITHE_INTERNAL_TRACE_H
+#define LITHE_INTERNAL_TRACE_H
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+#include <parlib/vcore.h>
+#include "../trace.h"
+
+/* Read LITHE_TRACE from the environment. Called from lithe_lib_init(). */
+void __lithe_trace_init();
+
+/* Every tracepoint is also a static (USDT) probe named lithe:<EVENT> with the
+ * event's two arguments, for perf and bpftrace to attach to. An unattached
+ * probe is a single nop. */
+#if defined(HAVE_SYS_SDT_H) && !defined(LITHE_NO_SDT)
+#include <sys/sdt.h>
+#define __lithe_probe(event, arg0, arg1) \
+  DTRACE_PROBE2(lithe, event, (uint64_t)(uintptr_t)(arg0), \
+                              (uint64_t)(uintptr_t)(arg1))
+#else
+#define __lithe_probe(event, arg0, arg1) do {} while (0)
+#endif
+
+#ifdef LITHE_TRACE
+
+/* A hart's ring of events. Only ever written by that hart. */
+struct lithe_trace_buffer {
+  struct lithe_trace_event *events;
+  uint64_t next;
+} __attribute__((aligned(ARCH_CL_SIZE)));
+
+extern volatile bool __lithe_trace_enabled;
+extern struct lithe_trace_buffer *__lithe_trace_buffers;
+extern uint64_t __lithe_trace_mask;
+
+static inline void __lithe_trace_record(uint32_t type, uint64_t arg0, uint64_t arg1)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  int hart = vcore_id();
+  struct lithe_trace_buffer *b = &__lithe_trace_buffers[hart];
+  struct lithe_trace_event *e = &b->events[b->next++ & __lithe_trace_mask];
+  e->time = (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+  e->type = type;
+  e->hart = hart;
+  e->arg0 = arg0;
+  e->arg1 = arg1;
+}
+
+/* Fire the probe for 'event' (one of LITHE_TRACE_EVENTS, without the prefix),
+ * and record it on the calling hart if tracing has been started. */
+#define __lithe_trace(event, arg0, arg1) \
+  do { \
+    __lithe_probe(event, arg0, arg1); \
+    if (__builtin_expect(__lithe_trace_enabled, 0)) \
+      __lithe_trace_record(LITHE_TRACE_##event, \
+                           (uint64_t)(uintptr_t)(arg0), \
+                           (uint64_t)(uintptr_t)(arg1)); \
+  } while (0)
+
+#else
+
+#define __lithe_trace(event, arg0, arg1) __lithe_probe(event, arg0, arg1)
+
+#endif // LITHE_TRACE
+
+#endif
@@ -5,6 +5,9 @@
 #include <sys/queue.h>
 #include <parlib/vcore.h>
 #include "assert.h"
+#include "notifier.h"
+#include "stats.h"
+#include "trace.h"
 
 static struct {
   int vcid;
@@ -23,18 +26,33 @@ static inline void lithe_vcore_init()
     max_spin_count = atoi(spin_count_string);
 }
 
-static inline void maybe_vcore_yield()
+// Called by the base scheduler 'base' on one of its idle harts
+static inline void maybe_vcore_yield(lithe_sched_t *base)
 {
   int *flag = &wake_me_up[vcore_id()].vcid;
 
+  __lithe_stats_inc(base, idle_spins);
+  __lithe_account(LITHE_HART_IDLE, base);
+
   *flag = 1;
   // make a local copy of max_spin_count to avoid reloading it due to cpu_relax
   int spins, max;
-  for (spins = 0, max = max_spin_count; spins < (unsigned)max && *flag; spins++)
+  for (spins = 0, max = max_spin_count; spins < (unsigned)max && *flag; spins++) {
+    if (__lithe_notifier_pending())
+      break;
     cpu_relax();
+  }
 
-  if (*flag && __sync_lock_test_and_set(flag, 0))
-    vcore_yield(false);
+  // Rather than handing the hart back to the system, keep one hart parked on
+  // the notifier doorbell while there are contexts waiting on notifiers.
+  if (*flag && __sync_lock_test_and_set(flag, 0)) {
+    if (!__lithe_notifier_pending() && !__lithe_notifier_park()) {
+      __lithe_trace(VCORE_YIELD, 0, 0);
+      __lithe_stats_inc(base, vcore_yields);
+      __lithe_account(LITHE_HART_YIELDED, base);
+      vcore_yield(false);
+    }
+  }
 }
 
 static inline void maybe_vcore_request(int k)
@@ -44,6 +62,12 @@ static inline void maybe_vcore_request(int k)
     if (wake_me_up[i].vcid && __sync_lock_test_and_set(&wake_me_up[i].vcid, 0))
       k--;
 
+  /* Then the one parked on the notifier doorbell. */
+  if (k > 0 && __lithe_notifier_ring())
+    k--;
+
+  if (k > 0)
+    __lithe_trace(VCORE_REQUEST, k, 0);
   for (int i = 0; i < k; i++)
     if (vcore_request(1) < 0)
       break;
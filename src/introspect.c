@@ -0,0 +1,264 @@
+/**
+ * Implementation of the registry of live schedulers.
+ *
+ * The registry is protected by a plain test-and-set lock rather than one of
+ * parlib's locks, so that the signal handler dumping it can give up instead
+ * of deadlocking if it interrupted the lock holder.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <parlib/parlib.h>
+#include "hart.h"
+#include "introspect.h"
+#include "internal/introspect.h"
+
+/* How long lithe_sched_dump() waits for the registry lock */
+#define DUMP_LOCK_SPINS (1 << 20)
+
+static struct lithe_sched_queue registry = TAILQ_HEAD_INITIALIZER(registry);
+static volatile int registry_lock = 0;
+
+static void registry_lock_acquire()
+{
+  while (__sync_lock_test_and_set(&registry_lock, 1))
+    cpu_relax();
+}
+
+static bool registry_lock_try(int spins)
+{
+  for (int i = 0; i < spins; i++) {
+    if (!__sync_lock_test_and_set(&registry_lock, 1))
+      return true;
+    cpu_relax();
+  }
+  return false;
+}
+
+static void registry_lock_release()
+{
+  __sync_lock_release(&registry_lock);
+}
+
+void __lithe_registry_add(lithe_sched_t *sched)
+{
+  registry_lock_acquire();
+  TAILQ_INSERT_TAIL(&registry, sched, registry_link);
+  registry_lock_release();
+}
+
+void __lithe_registry_remove(lithe_sched_t *sched)
+{
+  registry_lock_acquire();
+  TAILQ_REMOVE(&registry, sched, registry_link);
+  registry_lock_release();
+}
+
+void __lithe_registry_init(lithe_sched_t *base)
+{
+  __lithe_registry_add(base);
+
+  const char *path = getenv("LITHE_DUMP");
+  if (path != NULL && path[0] != '\0')
+    lithe_sched_dump_on_signal(SIGUSR2, path);
+}
+
+/* Visit the children of 'parent' (and their children) with the registry
+ * locked. Children always enter after their parents, and leave before them. */
+static int walk_children(lithe_sched_t *parent, int depth,
+                         void (*func) (const lithe_sched_info_t *, void *),
+                         void *arg)
+{
+  int n = 0;
+  lithe_sched_t *sched;
+  TAILQ_FOREACH(sched, &registry, registry_link) {
+    if (sched->parent != parent)
+      continue;
+
+    lithe_sched_info_t info;
+    info.sched = sched;
+    info.parent = parent;
+    info.depth = depth;
+    info.harts = atomic_read(&sched->harts);
+    info.hart_demand = atomic_read(&sched->hart_demand);
+    info.blocked_contexts = atomic_read(&sched->blocked_contexts);
+    info.runnable_contexts = -1;
+    if (sched->funcs && sched->funcs->runnable_contexts)
+      info.runnable_contexts = sched->funcs->runnable_contexts(sched);
+
+    func(&info, arg);
+    n += 1 + walk_children(sched, depth + 1, func, arg);
+  }
+  return n;
+}
+
+int lithe_sched_walk(void (*func) (const lithe_sched_info_t *info, void *arg),
+                     void *arg)
+{
+  registry_lock_acquire();
+  int n = walk_children(NULL, 0, func, arg);
+  registry_lock_release();
+  return n;
+}
+
+/* Dumps may be taken from a signal handler, so lines are formatted by hand
+ * rather than with stdio, none of which is async-signal-safe. Output that
+ * doesn't fit in a line is dropped. */
+struct dump_line {
+  char buf[160];
+  size_t len;
+};
+
+static void line_char(struct dump_line *l, char c)
+{
+  if (l->len < sizeof(l->buf))
+    l->buf[l->len++] = c;
+}
+
+static void line_str(struct dump_line *l, const char *s)
+{
+  while (*s)
+    line_char(l, *s++);
+}
+
+static void line_pad(struct dump_line *l, int n)
+{
+  while (n-- > 0)
+    line_char(l, ' ');
+}
+
+/* Write 'v' in 'base', zero padded to at least 'width' digits */
+static void line_unsigned(struct dump_line *l, unsigned long v, unsigned base,
+                          int width)
+{
+  char digits[sizeof(unsigned long) * 8];
+  int n = 0;
+  do {
+    digits[n++] = "0123456789abcdef"[v % base];
+    v /= base;
+  } while (v);
+  while (width-- > n)
+    line_char(l, '0');
+  while (n > 0)
+    line_char(l, digits[--n]);
+}
+
+static void line_long(struct dump_line *l, long v)
+{
+  if (v < 0) {
+    line_char(l, '-');
+    line_unsigned(l, -(unsigned long)v, 10, 0);
+  }
+  else {
+    line_unsigned(l, v, 10, 0);
+  }
+}
+
+static void line_ptr(struct dump_line *l, const void *p)
+{
+  line_str(l, "0x");
+  line_unsigned(l, (uintptr_t)p, 16, 0);
+}
+
+static void line_write(struct dump_line *l, int fd)
+{
+  const char *s = l->buf;
+  size_t len = l->len;
+  while (len > 0) {
+    ssize_t ret = write(fd, s, len);
+    if (ret < 0 && errno == EINTR)
+      continue;
+    if (ret <= 0)
+      break;
+    s += ret;
+    len -= ret;
+  }
+  l->len = 0;
+}
+
+static void dump_one(const lithe_sched_info_t *info, void *arg)
+{
+  struct dump_line l = { .len = 0 };
+  line_pad(&l, 2 * info->depth);
+  line_ptr(&l, info->sched);
+  line_str(&l, ": harts=");
+  line_long(&l, info->harts);
+  line_str(&l, " demand=");
+  line_long(&l, info->hart_demand);
+  line_str(&l, " runnable=");
+  if (info->runnable_contexts >= 0)
+    line_long(&l, info->runnable_contexts);
+  else
+    line_char(&l, '?');
+  line_str(&l, " blocked=");
+  line_long(&l, info->blocked_contexts);
+  line_char(&l, '\n');
+  line_write(&l, *(int*)arg);
+}
+
+int lithe_sched_dump(int fd)
+{
+  if (!registry_lock_try(DUMP_LOCK_SPINS))
+    return EBUSY;
+
+  struct dump_line l = { .len = 0 };
+  line_str(&l, "lithe schedulers (");
+  line_unsigned(&l, num_harts(), 10, 0);
+  line_str(&l, " of ");
+  line_unsigned(&l, max_harts(), 10, 0);
+  line_str(&l, " harts online):\n");
+  line_write(&l, fd);
+  walk_children(NULL, 0, dump_one, &fd);
+
+  registry_lock_release();
+  return 0;
+}
+
+static const char *signal_dump_path = NULL;
+
+static void dump_signal_handler(int signum)
+{
+  int saved_errno = errno;
+  int fd = open(signal_dump_path, O_WRONLY | O_CREAT | O_APPEND, 0644);
+  if (fd >= 0) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    struct dump_line l = { .len = 0 };
+    line_str(&l, "--- ");
+    line_long(&l, ts.tv_sec);
+    line_char(&l, '.');
+    line_unsigned(&l, ts.tv_nsec, 10, 9);
+    line_char(&l, '\n');
+    line_write(&l, fd);
+    if (lithe_sched_dump(fd) == EBUSY) {
+      line_str(&l, "scheduler registry busy, try again\n");
+      line_write(&l, fd);
+    }
+    close(fd);
+  }
+  errno = saved_errno;
+}
+
+int lithe_sched_dump_on_signal(int signum, const char *path)
+{
+  if (path == NULL)
+    return EINVAL;
+  signal_dump_path = path;
+
+  struct sigaction sa;
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = dump_signal_handler;
+  sa.sa_flags = SA_RESTART;
+  sigemptyset(&sa.sa_mask);
+  if (sigaction(signum, &sa, NULL) != 0)
+    return errno;
+  return 0;
+}
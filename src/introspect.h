@@ -0,0 +1,63 @@
+/**
+ * Interface for introspecting lithe's live scheduler hierarchy.
+ *
+ * Lithe keeps a registry of every scheduler that is currently entered, from
+ * the base scheduler down. It can be walked programmatically, dumped as an
+ * indented tree, or dumped to a file whenever the process receives a given
+ * signal, e.g. to find out which scheduler is holding on to harts when a
+ * service stalls.
+ */
+
+#ifndef LITHE_INTROSPECT_H
+#define LITHE_INTROSPECT_H
+
+#include "sched.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct lithe_sched_info {
+  lithe_sched_t *sched;
+  lithe_sched_t *parent;
+
+  /* Distance from the base scheduler, which is at depth 0 */
+  int depth;
+
+  /* Harts the scheduler holds right now */
+  long harts;
+
+  /* Net number of harts the scheduler has asked for with
+   * lithe_hart_request(), i.e. its outstanding demand as seen by its parent */
+  long hart_demand;
+
+  /* Contexts waiting for a hart, or -1 if the scheduler doesn't say (see
+   * runnable_contexts() in sched.h) */
+  long runnable_contexts;
+
+  /* Contexts blocked in lithe_context_block() or on a syscall */
+  long blocked_contexts;
+} lithe_sched_info_t;
+
+/* Call 'func' on every live scheduler, parents before their children.
+ * 'func' runs with the registry locked, so it must not enter or exit a
+ * scheduler. Returns the number of schedulers visited. */
+int lithe_sched_walk(void (*func) (const lithe_sched_info_t *info, void *arg),
+                     void *arg);
+
+/* Write the live scheduler hierarchy, one scheduler per line, indented by
+ * depth, to file descriptor 'fd'. Only uses async-signal-safe calls. Returns
+ * 0 on success, or EBUSY if the registry was locked for too long. */
+int lithe_sched_dump(int fd);
+
+/* Append a dump of the hierarchy to 'path' every time the process receives
+ * signal 'signum'. 'path' must stay valid for as long as the handler is
+ * installed. Setting LITHE_DUMP=<path> in the environment does the same for
+ * SIGUSR2. Returns 0 on success or an errno value on failure. */
+int lithe_sched_dump_on_signal(int signum, const char *path);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // LITHE_INTROSPECT_H
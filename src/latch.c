@@ -0,0 +1,52 @@
+/**
+ * Implementation of lithe countdown latches.
+ */
+
+#include <errno.h>
+#include "latch.h"
+
+int lithe_latch_init(lithe_latch_t *latch, int count)
+{
+  if(latch == NULL)
+    return EINVAL;
+  if(count < 0)
+    return EINVAL;
+
+  lithe_waitgroup_init(&latch->wg);
+  latch->wg.state = (uint32_t)count;
+  return 0;
+}
+
+int lithe_latch_count_down(lithe_latch_t *latch, int n)
+{
+  if(latch == NULL)
+    return EINVAL;
+  if(n < 0)
+    return EINVAL;
+
+  return lithe_waitgroup_add(&latch->wg, -n);
+}
+
+int lithe_latch_try_wait(lithe_latch_t *latch)
+{
+  if(latch == NULL)
+    return 0;
+  /* Only report the latch open once its release has let go of the latch,
+   * so that the caller may destroy it straight away */
+  return latch->wg.state == 0;
+}
+
+int lithe_latch_wait(lithe_latch_t *latch)
+{
+  if(latch == NULL)
+    return EINVAL;
+  return lithe_waitgroup_wait(&latch->wg);
+}
+
+int lithe_latch_arrive_and_wait(lithe_latch_t *latch, int n)
+{
+  int ret = lithe_latch_count_down(latch, n);
+  if(ret != 0)
+    return ret;
+  return lithe_waitgroup_wait(&latch->wg);
+}
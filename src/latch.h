@@ -0,0 +1,48 @@
+/**
+ * Interface of lithe countdown latches.
+ */
+
+#ifndef LITHE_LATCH_H
+#define LITHE_LATCH_H
+
+#include "waitgroup.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* A lithe latch struct. A single-use countdown built on top of a waitgroup
+ * whose count is fixed when the latch is initialized. */
+typedef struct lithe_latch {
+  lithe_waitgroup_t wg;
+} lithe_latch_t;
+#define LITHE_LATCH_INITIALIZER(latch, n) { \
+  .wg = { \
+    .state = (uint32_t)(n), \
+    .lock = MCS_PDRLOCK_INIT, \
+    .qnode = NULL, \
+    .queue = TAILQ_HEAD_INITIALIZER((latch).wg.queue) \
+  } \
+}
+
+/* Initialize a latch that opens after 'count' arrivals. */
+int lithe_latch_init(lithe_latch_t *latch, int count);
+
+/* Count the latch down by 'n', opening it (and releasing all waiters) once it
+ * reaches zero. Returns EINVAL if that would take the count below zero. */
+int lithe_latch_count_down(lithe_latch_t *latch, int n);
+
+/* Returns whether the latch has opened, without blocking. */
+int lithe_latch_try_wait(lithe_latch_t *latch);
+
+/* Block the calling context until the latch opens. */
+int lithe_latch_wait(lithe_latch_t *latch);
+
+/* Count the latch down by 'n' and then wait for it to open. */
+int lithe_latch_arrive_and_wait(lithe_latch_t *latch, int n);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // LITHE_LATCH_H
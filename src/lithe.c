@@ -20,8 +20,14 @@
 #include <parlib/parlib.h>
 #include "lithe.h"
 #include "fatal.h"
+#include "qsbr.h"
 #include "internal/assert.h"
 #include "internal/vcore.h"
+#include "internal/notifier.h"
+#include "internal/introspect.h"
+#include "internal/profile.h"
+#include "internal/stats.h"
+#include "internal/trace.h"
 
 #ifndef __linux__
 #ifndef __ros__
@@ -121,10 +127,15 @@ static __thread struct {
    * functions without using arguments */
   void *vcore_data;
 
-} lithe_tls = {NULL, NULL, NULL};
+  /* Set while lithe_context_unblock_many() marks a batch of contexts runnable
+   * so their scheduler can be notified of the whole batch at once */
+  bool unblocking_batch;
+
+} lithe_tls = {NULL, NULL, NULL, false};
 #define next_context     (lithe_tls.next_context)
 #define current_sched    (lithe_tls.current_sched)
 #define vcore_data       (lithe_tls.vcore_data)
+#define unblocking_batch (lithe_tls.unblocking_batch)
 #define current_context  ((lithe_context_t*)current_uthread)
 
 void __attribute__((constructor)) lithe_lib_init()
@@ -155,6 +166,28 @@ void __attribute__((constructor)) lithe_lib_init()
   /* Initialize vcore request/yield data structures */
   lithe_vcore_init();
 
+  /* Initialize memory reclamation state. The main context may read shared
+   * data long before vcore 0 first passes through lithe_vcore_entry(), so
+   * its hart has to be tracked from the start. */
+  lithe_qsbr_init();
+  lithe_qsbr_online();
+
+  /* Initialize the doorbell for notifiers signaled from outside of lithe */
+  __lithe_notifier_init();
+
+  /* Start keeping statistics right away if LITHE_STATS is set */
+  __lithe_stats_init(&base_sched);
+
+  /* Start tracing right away if LITHE_TRACE is set */
+  __lithe_trace_init();
+
+  /* Start profiling right away if LITHE_PROFILE is set */
+  __lithe_profile_init();
+
+  /* Register the base scheduler, and dump the hierarchy on SIGUSR2 if
+   * LITHE_DUMP is set */
+  __lithe_registry_init(&base_sched);
+
   /* Now that the library is initialized, a TLS should be set up for this
    * context, so set some of it */
   uthread_set_tls_var(&context->uth, current_sched, &base_sched);
@@ -166,7 +199,12 @@ static void __attribute__((noreturn)) __lithe_sched_reenter()
   assert(current_sched);
   assert(current_sched->funcs);
 
+  /* Entering a scheduler is a quiescent state for this hart */
+  lithe_qsbr_quiescent();
+
   /* Enter current scheduler. */
+  __lithe_stats_inc(current_sched, hart_enters);
+  __lithe_trace(HART_ENTER, current_sched, 0);
   assert(current_sched->funcs->hart_enter);
   current_sched->funcs->hart_enter(current_sched);
   fatal("lithe: returned from enter");
@@ -183,14 +221,28 @@ static void __attribute__((noreturn)) lithe_vcore_entry()
     /* Set the current scheduler as the base scheduler */
     current_sched = &base_sched;
     atomic_add(&base_sched.harts, 1);
+    lithe_qsbr_online();
   }
 
+  /* Every context switch passes through here, so it's a quiescent state */
+  lithe_qsbr_quiescent();
+
+  /* The hart was either running a context, or was just (re)started by the
+   * system. Either way, it's now running scheduler code. */
+  __lithe_account(LITHE_HART_SCHED, current_sched);
+  __lithe_profile_hart_enter();
+
+  /* Unblock any contexts whose notifiers were signaled */
+  if (__lithe_notifier_pending())
+    __lithe_notifier_drain();
+
   /* If current_context is set, then just resume it. This will happen in one of 2
    * cases: 1) It is the first, i.e. main thread, or 2) The current vcore was
    * taken over to run a signal handler from the kernel, and is now being
    * restarted */
   if(current_context) {
     current_sched = current_context->sched;
+    __lithe_account(LITHE_HART_CONTEXT, current_sched);
     run_current_uthread();
     assert(0); // Should never return from running context
   }
@@ -200,6 +252,10 @@ static void __attribute__((noreturn)) lithe_vcore_entry()
     lithe_context_t *context = next_context;
     current_sched = context->sched;
     next_context = NULL;
+    __lithe_stats_inc(current_sched, contexts_run);
+    __lithe_trace(CONTEXT_RUN, context->id, current_sched);
+    __lithe_latency_run(context);
+    __lithe_account(LITHE_HART_CONTEXT, current_sched);
     run_uthread(&context->uth);
     assert(0); // Should never return from running context
   }
@@ -213,6 +269,12 @@ static void lithe_thread_runnable(uthread_t *uthread)
 {
   assert(uthread);
   assert(current_sched);
+
+  /* The scheduler is told about the whole batch once it has been marked
+   * runnable (see lithe_context_unblock_many()). */
+  if (unblocking_batch)
+    return;
+
   assert(current_sched->funcs->context_unblock);
 
   lithe_context_t *context = (lithe_context_t*)uthread;
@@ -237,6 +299,9 @@ static void lithe_blockon_sysc(struct uthread* uthread, void *sysc)
   assert(current_sched);
   assert(current_sched->funcs);
   assert(current_sched->funcs->context_block);
+  __lithe_stats_inc(current_sched, contexts_blocked);
+  atomic_add(&current_sched->blocked_contexts, 1);
+  __lithe_trace(CONTEXT_BLOCK, ((lithe_context_t*)uthread)->id, current_sched);
   current_sched->funcs->context_block(current_sched, (lithe_context_t*)uthread);
 }
 
@@ -293,10 +358,16 @@ static void base_hart_enter(lithe_sched_t *__this)
     // to the root scheduler again
     atomic_add(&__this->harts, -1);
     current_sched = NULL;
-    maybe_vcore_yield();
+    lithe_qsbr_offline();
+    maybe_vcore_yield(__this);
+    lithe_qsbr_online();
     current_sched = &base_sched;
+    __lithe_account(LITHE_HART_SCHED, __this);
     atomic_add(&__this->harts, 1);
 
+    if (__lithe_notifier_pending())
+      __lithe_notifier_drain();
+
     handle_events();
     cpu_relax();
   }
@@ -370,7 +441,10 @@ lithe_sched_t *lithe_sched_current()
 
 static void __lithe_hart_grant(lithe_sched_t *child, void (*unlock_func) (void *), void *lock)
 {
+  __lithe_account(LITHE_HART_SCHED, child);
   current_sched = child;
+  __lithe_stats_inc(child, harts_granted);
+  __lithe_trace(HART_GRANT, child, 0);
   if(unlock_func != NULL)
     unlock_func(lock);
   vcore_reenter(__lithe_sched_reenter);
@@ -403,13 +477,17 @@ void lithe_hart_yield()
   lithe_sched_t *child = current_sched;
 
   /* Switch to parent scheduler and notify it of the hart return */
+  __lithe_account(LITHE_HART_SCHED, parent);
   current_sched = parent;
   assert(current_sched);
   assert(current_sched->funcs);
   assert(current_sched->funcs->hart_return);
   current_sched->funcs->hart_return(current_sched, child);
 
-  /* Leave child, reenter on parent. */
+  /* Leave child, reenter on parent. Count the yield first, since the child
+   * may exit (and free its statistics) as soon as it owns no more harts. */
+  __lithe_stats_inc(child, harts_yielded);
+  __lithe_trace(HART_YIELD, child, parent);
   atomic_add(&child->harts, -1);
   atomic_add(&parent->harts, 1);
 
@@ -435,6 +513,7 @@ static void __lithe_sched_enter(uthread_t *uthread, void *__arg)
   assert(child);
 
   /* Officially grant the hart to the child */
+  __lithe_account(LITHE_HART_SCHED, child);
   atomic_add(&parent->harts, -1);
   atomic_add(&child->harts, 1);
 
@@ -442,6 +521,8 @@ static void __lithe_sched_enter(uthread_t *uthread, void *__arg)
   context->sched = child;
   uthread_set_tls_var(&context->uth, current_sched, child);
 
+  __lithe_trace(SCHED_ENTER, child, parent);
+
   /* Inform parent. */
   assert(parent->funcs->child_enter);
   parent->funcs->child_enter(parent, child);
@@ -473,6 +554,11 @@ void lithe_sched_enter(lithe_sched_t *child)
   /* Set-up child scheduler */
   child->harts = ATOMIC_INITIALIZER(0);
   child->parent = parent;
+  child->stats = __lithe_stats_alloc();
+  child->latency = __lithe_latency_alloc();
+  child->hart_demand = ATOMIC_INITIALIZER(0);
+  child->blocked_contexts = ATOMIC_INITIALIZER(0);
+  __lithe_registry_add(child);
 
   /* Set up a function to run in vcore context to inform the parent that the
    * child has taken over */
@@ -510,6 +596,7 @@ void __lithe_sched_exit(uthread_t *uthread, void *arg)
   assert(child);
 
   /* Update child's hart count to 0 */
+  __lithe_account(LITHE_HART_SCHED, parent);
   atomic_add(&child->harts, -1);
   atomic_add(&parent->harts, 1);
 
@@ -517,6 +604,8 @@ void __lithe_sched_exit(uthread_t *uthread, void *arg)
   context->sched = parent;
   uthread_set_tls_var(&context->uth, current_sched, parent);
 
+  __lithe_trace(SCHED_EXIT, child, parent);
+
   /* Inform the child. */
   assert(child->funcs->sched_exit);
   child->funcs->sched_exit(child);
@@ -565,6 +654,12 @@ void lithe_sched_exit()
     assert(n >= 0);
     lithe_context_yield();
   }
+
+  __lithe_registry_remove(child);
+  __lithe_stats_free(child->stats);
+  child->stats = NULL;
+  __lithe_latency_free(child->latency);
+  child->latency = NULL;
 }
 
 void lithe_hart_request(int h)
@@ -573,6 +668,13 @@ void lithe_hart_request(int h)
   lithe_sched_t *parent = current_sched->parent;
   lithe_sched_t *child = current_sched;
 
+  if (h > 0)
+    __lithe_stats_add(child, harts_requested, h);
+  else
+    __lithe_stats_add(child, harts_released, -h);
+  atomic_add(&child->hart_demand, h);
+  __lithe_trace(HART_REQUEST, child, (int64_t)h);
+
   current_sched = parent;
   assert(parent->funcs->hart_request);
   parent->funcs->hart_request(parent, child, h);
@@ -587,6 +689,8 @@ static void __lithe_context_yield(uthread_t *uthread, void *arg)
   assert(in_vcore_context());
 
   lithe_context_t *context = (lithe_context_t*)uthread;
+  __lithe_stats_inc(current_sched, contexts_yielded);
+  __lithe_trace(CONTEXT_YIELD, context->id, current_sched);
   assert(current_sched->funcs->context_yield);
   current_sched->funcs->context_yield(current_sched, context);
 }
@@ -599,12 +703,20 @@ static void __lithe_context_finished(uthread_t *uthread, void *__arg)
   assert(in_vcore_context());
 
   lithe_context_t *context = (lithe_context_t*)uthread;
+  __lithe_stats_inc(current_sched, contexts_exited);
+  __lithe_trace(CONTEXT_EXIT, context->id, current_sched);
   assert(current_sched->funcs->context_exit);
   current_sched->funcs->context_exit(current_sched, context);
 }
 
 static void __lithe_context_start()
 {
+#if defined(__x86_64__) && defined(__GCC_HAVE_DWARF2_CFI_ASM)
+  /* Mark this as the outermost frame of the context's stack, the way glibc
+   * does for new threads, so unwinders (e.g. backtrace() in the profiler's
+   * SIGPROF handler) stop here rather than walk off the end of the stack */
+  asm volatile(".cfi_undefined rip");
+#endif
   assert(current_context);
   assert(current_context->start_func);
   current_context->start_func(current_context->start_func_arg);
@@ -617,6 +729,7 @@ static inline void __lithe_context_fields_init(lithe_context_t *context, lithe_s
   context->start_func = NULL;
   context->start_func_arg = NULL;
   context->sched = sched;
+  context->unblock_time = 0;
   uthread_set_tls_var(&context->uth, current_sched, sched);
 }
 
@@ -726,6 +839,9 @@ void __lithe_context_block(uthread_t *uthread, void *__arg)
   assert(current_sched);
   assert(current_sched->funcs);
   assert(current_sched->funcs->context_block);
+  __lithe_stats_inc(current_sched, contexts_blocked);
+  atomic_add(&current_sched->blocked_contexts, 1);
+  __lithe_trace(CONTEXT_BLOCK, ((lithe_context_t*)uthread)->id, current_sched);
   current_sched->funcs->context_block(current_sched, (lithe_context_t*)uthread);
 
   /* Then carry out the call-site specific callback to do the blocking. */
@@ -754,10 +870,54 @@ void lithe_context_unblock(lithe_context_t *context)
   assert(context);
   lithe_sched_t *sched = current_sched;
   current_sched = context->sched;
+  __lithe_stats_inc(current_sched, contexts_unblocked);
+  atomic_add(&current_sched->blocked_contexts, -1);
+  __lithe_trace(CONTEXT_UNBLOCK, context->id, current_sched);
+  __lithe_latency_unblock(context);
   uthread_runnable(&context->uth);
   current_sched = sched;
 }
 
+void lithe_context_unblock_many(lithe_context_t **contexts, size_t n)
+{
+  assert(contexts || n == 0);
+  lithe_sched_t *sched = current_sched;
+
+  size_t i = 0;
+  while (i < n) {
+    /* Find the run of contexts that share a scheduler with contexts[i] */
+    lithe_sched_t *target = contexts[i]->sched;
+    size_t j = i + 1;
+    while (j < n && contexts[j]->sched == target)
+      j++;
+
+    current_sched = target;
+    __lithe_stats_add(current_sched, contexts_unblocked, j - i);
+    atomic_add(&current_sched->blocked_contexts, -(long)(j - i));
+    assert(current_sched->funcs);
+    if (current_sched->funcs->context_unblock_batch) {
+      unblocking_batch = true;
+      for (size_t k = i; k < j; k++) {
+        __lithe_trace(CONTEXT_UNBLOCK, contexts[k]->id, current_sched);
+        __lithe_latency_unblock(contexts[k]);
+        uthread_runnable(&contexts[k]->uth);
+      }
+      unblocking_batch = false;
+      current_sched->funcs->context_unblock_batch(current_sched,
+                                                  &contexts[i], j - i);
+    }
+    else {
+      for (size_t k = i; k < j; k++) {
+        __lithe_trace(CONTEXT_UNBLOCK, contexts[k]->id, current_sched);
+        __lithe_latency_unblock(contexts[k]);
+        uthread_runnable(&contexts[k]->uth);
+      }
+    }
+    i = j;
+  }
+  current_sched = sched;
+}
+
 void lithe_context_yield()
 {
   assert(!in_vcore_context());
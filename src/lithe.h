@@ -158,6 +158,16 @@ void lithe_context_block(void (*func) (lithe_context_t *, void *), void *arg);
  */
 void lithe_context_unblock(lithe_context_t *context);
 
+/**
+ * Notifies the schedulers of 'n' contexts, all previously blocked via a call
+ * to lithe_context_block(), that they are now resumable. Runs of consecutive
+ * contexts belonging to the same scheduler are handed to that scheduler's
+ * context_unblock_batch() callback in one go (if it has one), so callers
+ * releasing many waiters at once should group them by scheduler where
+ * possible.
+ */
+void lithe_context_unblock_many(lithe_context_t **contexts, size_t n);
+
 /**
  * Cooperatively yield the current context to the current scheduler.  The
  * scheduler receives a callback notifiying it that the context has yielded and
@@ -0,0 +1,237 @@
+/**
+ * Implementation of lithe notifiers.
+ *
+ * Each notifier moves through the states below. Only the transition out of
+ * QUEUED is made by a hart; everything else is a single CAS by the waiter or
+ * by a signaler, so signalers never block and never call into lithe.
+ *
+ *   IDLE     -- signal --> SIGNALED -- wait ---------------------> IDLE
+ *   IDLE     -- wait ----> WAITING  -- signal (push on inbox) ---> QUEUED
+ *   QUEUED   -- drain (unblock the waiter) ----------------------> IDLE
+ */
+
+#include <errno.h>
+#include <stdint.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/eventfd.h>
+#endif
+#include "internal/assert.h"
+
+#include <parlib/parlib.h>
+#include "notifier.h"
+#include "internal/notifier.h"
+
+#define NOTIFIER_UNBLOCK_BATCH 64
+
+/* States of the doorbell. A ringer claims the parked hart before waking it,
+ * so two ringers never both count on waking the same hart. */
+enum {
+  DOORBELL_EMPTY,
+  DOORBELL_PARKED,
+  DOORBELL_CLAIMED,
+};
+
+enum {
+  NOTIFIER_IDLE,
+  NOTIFIER_SIGNALED,
+  NOTIFIER_WAITING,
+  NOTIFIER_QUEUED,
+};
+
+lithe_notifier_t *volatile __lithe_notifier_inbox CACHE_LINE_ALIGNED = NULL;
+
+static struct {
+  /* Number of contexts currently blocked on a notifier */
+  volatile int nwaiting CACHE_LINE_ALIGNED;
+  /* One of DOORBELL_*: whether a hart is parked, and if it has been claimed
+   * by a ringer */
+  volatile int parked CACHE_LINE_ALIGNED;
+  int efd;
+} doorbell = {0, DOORBELL_EMPTY, -1};
+
+void __lithe_notifier_init()
+{
+#ifdef __linux__
+  doorbell.efd = eventfd(0, EFD_CLOEXEC);
+#endif
+}
+
+int lithe_notifier_init(lithe_notifier_t *notifier)
+{
+  if(notifier == NULL)
+    return EINVAL;
+
+  notifier->state = NOTIFIER_IDLE;
+  notifier->waiter = NULL;
+  notifier->next = NULL;
+  return 0;
+}
+
+static void block(lithe_context_t *context, void *arg)
+{
+  lithe_notifier_t *notifier = (lithe_notifier_t *) arg;
+  assert(notifier);
+
+  notifier->waiter = context;
+  __sync_fetch_and_add(&doorbell.nwaiting, 1);
+  if (!__sync_bool_compare_and_swap(&notifier->state, NOTIFIER_IDLE,
+                                    NOTIFIER_WAITING)) {
+    /* Signaled while we were on our way in */
+    assert(notifier->state == NOTIFIER_SIGNALED);
+    __sync_fetch_and_add(&doorbell.nwaiting, -1);
+    notifier->state = NOTIFIER_IDLE;
+    lithe_context_unblock(context);
+  }
+}
+
+int lithe_notifier_wait(lithe_notifier_t *notifier)
+{
+  if(notifier == NULL)
+    return EINVAL;
+
+  int state = notifier->state;
+  if (state == NOTIFIER_WAITING || state == NOTIFIER_QUEUED)
+    return EBUSY;
+  if (state == NOTIFIER_SIGNALED &&
+      __sync_bool_compare_and_swap(&notifier->state, NOTIFIER_SIGNALED,
+                                   NOTIFIER_IDLE))
+    return 0;
+
+  lithe_context_block(block, notifier);
+  return 0;
+}
+
+static void inbox_push(lithe_notifier_t *notifier)
+{
+  lithe_notifier_t *head;
+  do {
+    head = __lithe_notifier_inbox;
+    notifier->next = head;
+  } while (!__sync_bool_compare_and_swap(&__lithe_notifier_inbox, head,
+                                         notifier));
+}
+
+int lithe_notifier_signal(lithe_notifier_t *notifier)
+{
+  if(notifier == NULL)
+    return EINVAL;
+
+  while (1) {
+    int state = notifier->state;
+    switch (state) {
+      case NOTIFIER_SIGNALED:
+      case NOTIFIER_QUEUED:
+        return 0;
+      case NOTIFIER_IDLE:
+        if (__sync_bool_compare_and_swap(&notifier->state, state,
+                                         NOTIFIER_SIGNALED))
+          return 0;
+        break;
+      case NOTIFIER_WAITING:
+        if (__sync_bool_compare_and_swap(&notifier->state, state,
+                                         NOTIFIER_QUEUED)) {
+          inbox_push(notifier);
+          /* The push is a full barrier, pairing with the one in
+           * __lithe_notifier_park() */
+          __lithe_notifier_ring();
+          return 0;
+        }
+        break;
+    }
+    cpu_relax();
+  }
+}
+
+void __lithe_notifier_drain()
+{
+  lithe_notifier_t *list = __sync_lock_test_and_set(&__lithe_notifier_inbox,
+                                                    NULL);
+
+  /* The inbox is LIFO, so reverse it to wake contexts in signal order */
+  lithe_notifier_t *fifo = NULL;
+  while (list) {
+    lithe_notifier_t *next = list->next;
+    list->next = fifo;
+    fifo = list;
+    list = next;
+  }
+
+  lithe_context_t *batch[NOTIFIER_UNBLOCK_BATCH];
+  size_t nbatch = 0;
+  while (fifo) {
+    lithe_notifier_t *next = fifo->next;
+    assert(fifo->state == NOTIFIER_QUEUED);
+    batch[nbatch++] = fifo->waiter;
+    /* The waiter can't wait again until it runs, so it's safe to let signalers
+     * at the notifier before we unblock it */
+    fifo->state = NOTIFIER_IDLE;
+    if (nbatch == NOTIFIER_UNBLOCK_BATCH) {
+      __sync_fetch_and_add(&doorbell.nwaiting, -(int)nbatch);
+      lithe_context_unblock_many(batch, nbatch);
+      nbatch = 0;
+    }
+    fifo = next;
+  }
+  __sync_fetch_and_add(&doorbell.nwaiting, -(int)nbatch);
+  lithe_context_unblock_many(batch, nbatch);
+}
+
+bool __lithe_notifier_park()
+{
+#ifdef __linux__
+  if (doorbell.efd < 0 || doorbell.nwaiting == 0)
+    return false;
+  if (!__sync_bool_compare_and_swap(&doorbell.parked, DOORBELL_EMPTY,
+                                    DOORBELL_PARKED))
+    return false;
+
+  mb();
+  uint64_t count;
+  bool consumed = false;
+  if (!__lithe_notifier_pending()) {
+    if (read(doorbell.efd, &count, sizeof(count)) == sizeof(count))
+      consumed = true;
+    else
+      assert(errno == EINTR);
+  }
+
+  /* If a ringer claimed us, it counted on waking us and has written (or is
+   * about to write) exactly once. Consume that write, so the next hart to
+   * park doesn't return straight away. */
+  if (!__sync_bool_compare_and_swap(&doorbell.parked, DOORBELL_PARKED,
+                                    DOORBELL_EMPTY)) {
+    assert(doorbell.parked == DOORBELL_CLAIMED);
+    while (!consumed) {
+      if (read(doorbell.efd, &count, sizeof(count)) == sizeof(count))
+        consumed = true;
+      else
+        assert(errno == EINTR);
+    }
+    doorbell.parked = DOORBELL_EMPTY;
+  }
+  return true;
+#else
+  return false;
+#endif
+}
+
+bool __lithe_notifier_ring()
+{
+#ifdef __linux__
+  if (doorbell.efd < 0 || doorbell.parked != DOORBELL_PARKED)
+    return false;
+  if (!__sync_bool_compare_and_swap(&doorbell.parked, DOORBELL_PARKED,
+                                    DOORBELL_CLAIMED))
+    return false;
+
+  /* The parked hart waits for this write before parking again, so it can't
+   * be lost */
+  uint64_t one = 1;
+  while (write(doorbell.efd, &one, sizeof(one)) != sizeof(one))
+    assert(errno == EINTR);
+  return true;
+#else
+  return false;
+#endif
+}
@@ -0,0 +1,49 @@
+/**
+ * Interface of lithe notifiers.
+ *
+ * A notifier lets code running outside of lithe, e.g. a plain pthread, wake a
+ * lithe context. Signaling a notifier never takes a lock or touches lithe
+ * state: a notifier with a waiting context is pushed onto a lock-free inbox
+ * that harts drain as they pass through the runtime, and an idle hart parked
+ * on an eventfd is woken only when there is one.
+ */
+
+#ifndef LITHE_NOTIFIER_H
+#define LITHE_NOTIFIER_H
+
+#include "lithe.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* A lithe notifier struct. At most one context may wait on a notifier at a
+ * time, but any number of threads may signal it. */
+typedef struct lithe_notifier {
+  volatile int state;
+  lithe_context_t *waiter;
+  struct lithe_notifier *next;
+} lithe_notifier_t;
+#define LITHE_NOTIFIER_INITIALIZER { \
+  .state = 0, \
+  .waiter = NULL, \
+  .next = NULL \
+}
+
+/* Initialize a notifier. */
+int lithe_notifier_init(lithe_notifier_t *notifier);
+
+/* Wait for the notifier to be signaled, blocking the calling context if it
+ * hasn't been already. Signals do not accumulate: any number of signals since
+ * the last wait are consumed by a single wait. Returns EBUSY if another
+ * context is already waiting on the notifier. */
+int lithe_notifier_wait(lithe_notifier_t *notifier);
+
+/* Signal a notifier. Safe to call from any thread, lithe or not. */
+int lithe_notifier_signal(lithe_notifier_t *notifier);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // LITHE_NOTIFIER_H
@@ -0,0 +1,363 @@
+/**
+ * Implementation of lithe's sampling profiler.
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <dlfcn.h>
+#include <errno.h>
+#include <execinfo.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#include <parlib/parlib.h>
+#include "lithe.h"
+#include "profile.h"
+#include "internal/assert.h"
+#include "internal/profile.h"
+
+#define DEFAULT_BUFFER_SAMPLES 4096
+#define NSEC_PER_SEC 1000000000L
+
+/* Deepest scheduler hierarchy and stack recorded per sample */
+#define MAX_SCHEDS 8
+#define MAX_FRAMES 32
+
+/* Frames of the signal handler and the kernel's signal trampoline at the top
+ * of every backtrace taken in the handler */
+#define HANDLER_FRAMES 2
+
+struct sample {
+  /* The hart's scheduler and its ancestors, innermost first */
+  lithe_sched_t *scheds[MAX_SCHEDS];
+  int nscheds;
+
+  /* Id of the context the hart was running, or -1 if it was running
+   * scheduler code in vcore context */
+  int context;
+
+  /* Return addresses, innermost first */
+  void *frames[MAX_FRAMES];
+  int nframes;
+};
+
+enum {
+  TIMER_NONE,
+  TIMER_ARMING,
+  TIMER_ARMED,
+  TIMER_DELETING,
+  TIMER_FAILED,
+};
+
+/* A hart's timer and samples. Only ever written by that hart, except for the
+ * timer, which lithe_profile_stop() deletes. */
+struct profile_hart {
+  struct sample *samples;
+  uint64_t nsamples;
+  uint64_t lost;
+  volatile int timer_state;
+  timer_t timer;
+} __attribute__((aligned(ARCH_CL_SIZE)));
+
+volatile bool __lithe_profile_enabled = false;
+static struct profile_hart *harts = NULL;
+static uint64_t capacity = 0;
+static int profile_hz = LITHE_PROFILE_DEFAULT_HZ;
+
+/* Where to write the profile on exit, if profiling was started by
+ * LITHE_PROFILE */
+static const char *exit_dump_path = NULL;
+
+static void sigprof_handler(int signum, siginfo_t *info, void *uctx)
+{
+  if (!__lithe_profile_enabled || harts == NULL)
+    return;
+
+  int saved_errno = errno;
+  struct profile_hart *h = &harts[vcore_id()];
+  if (h->nsamples == capacity) {
+    h->lost++;
+    errno = saved_errno;
+    return;
+  }
+
+  struct sample *s = &h->samples[h->nsamples];
+  memset(s, 0, sizeof(*s));
+  for (lithe_sched_t *sched = lithe_sched_current();
+       sched && s->nscheds < MAX_SCHEDS; sched = sched->parent)
+    s->scheds[s->nscheds++] = sched;
+
+  s->context = -1;
+  if (!in_vcore_context() && current_uthread)
+    s->context = ((lithe_context_t*)current_uthread)->id;
+
+  /* See profile.h about unwinding context stacks */
+  void *frames[MAX_FRAMES + HANDLER_FRAMES];
+  int n = backtrace(frames, MAX_FRAMES + HANDLER_FRAMES);
+  if (n > HANDLER_FRAMES) {
+    s->nframes = n - HANDLER_FRAMES;
+    memcpy(s->frames, &frames[HANDLER_FRAMES], s->nframes * sizeof(void*));
+  }
+
+  h->nsamples++;
+  errno = saved_errno;
+}
+
+static void dump_on_exit()
+{
+  lithe_profile_stop();
+  int ret = lithe_profile_dump(exit_dump_path);
+  if (ret)
+    fprintf(stderr, "lithe: unable to write profile to %s: %s\n",
+            exit_dump_path, strerror(ret));
+}
+
+void __lithe_profile_init()
+{
+  exit_dump_path = getenv("LITHE_PROFILE");
+  if (exit_dump_path == NULL || exit_dump_path[0] == '\0')
+    return;
+
+  int hz = LITHE_PROFILE_DEFAULT_HZ;
+  const char *s = getenv("LITHE_PROFILE_HZ");
+  if (s != NULL && atoi(s) > 0)
+    hz = atoi(s);
+
+  if (lithe_profile_start(hz) == 0)
+    atexit(dump_on_exit);
+}
+
+static void delete_timer(struct profile_hart *h)
+{
+  while (h->timer_state == TIMER_ARMING)
+    cpu_relax();
+  /* Both the hart and lithe_profile_stop() may get here for the same timer,
+   * so only whoever claims it deletes it. The hart can't arm a new timer
+   * until the claimed one is gone. */
+  if (__sync_bool_compare_and_swap(&h->timer_state, TIMER_ARMED,
+                                   TIMER_DELETING)) {
+    timer_delete(h->timer);
+    wmb();
+    h->timer_state = TIMER_NONE;
+  }
+  while (h->timer_state == TIMER_DELETING)
+    cpu_relax();
+}
+
+void __lithe_profile_arm()
+{
+  struct profile_hart *h = &harts[vcore_id()];
+  if (h->timer_state != TIMER_NONE)
+    return;
+  if (!__sync_bool_compare_and_swap(&h->timer_state, TIMER_NONE, TIMER_ARMING))
+    return;
+
+  /* Tick with the CPU time of this hart's thread only, and signal it alone */
+  struct sigevent sev;
+  memset(&sev, 0, sizeof(sev));
+  sev.sigev_notify = SIGEV_THREAD_ID;
+  sev.sigev_signo = SIGPROF;
+  sev._sigev_un._tid = syscall(SYS_gettid);
+
+  /* At 1 Hz the period is a whole second, one more than tv_nsec can hold */
+  long period = NSEC_PER_SEC / profile_hz;
+  struct itimerspec its;
+  its.it_interval.tv_sec = period / NSEC_PER_SEC;
+  its.it_interval.tv_nsec = period % NSEC_PER_SEC;
+  its.it_value = its.it_interval;
+
+  if (timer_create(CLOCK_THREAD_CPUTIME_ID, &sev, &h->timer) != 0) {
+    h->timer_state = TIMER_FAILED;
+    return;
+  }
+  if (timer_settime(h->timer, 0, &its, NULL) != 0) {
+    timer_delete(h->timer);
+    h->timer_state = TIMER_FAILED;
+    return;
+  }
+  h->timer_state = TIMER_ARMED;
+
+  /* If the profiler was stopped while we were arming, it may have missed our
+   * timer, so delete it ourselves */
+  mb();
+  if (!__lithe_profile_enabled)
+    delete_timer(h);
+}
+
+static int alloc_harts()
+{
+  capacity = DEFAULT_BUFFER_SAMPLES;
+  const char *s = getenv("LITHE_PROFILE_BUFFER");
+  if (s != NULL && atol(s) > 0)
+    capacity = atol(s);
+
+  struct profile_hart *h = parlib_aligned_alloc(ARCH_CL_SIZE,
+    sizeof(struct profile_hart) * max_harts());
+  if (h == NULL)
+    return ENOMEM;
+  memset(h, 0, sizeof(struct profile_hart) * max_harts());
+  for (int i = 0; i < max_harts(); i++) {
+    h[i].samples = malloc(sizeof(struct sample) * capacity);
+    if (h[i].samples == NULL) {
+      while (--i >= 0)
+        free(h[i].samples);
+      free(h);
+      return ENOMEM;
+    }
+  }
+
+  harts = h;
+  return 0;
+}
+
+int lithe_profile_start(int hz)
+{
+  if (hz <= 0 || hz > NSEC_PER_SEC)
+    return EINVAL;
+  if (__lithe_profile_enabled)
+    return EALREADY;
+
+  if (harts == NULL) {
+    int ret = alloc_harts();
+    if (ret)
+      return ret;
+  }
+  else {
+    for (int i = 0; i < max_harts(); i++) {
+      harts[i].nsamples = 0;
+      harts[i].lost = 0;
+      if (harts[i].timer_state == TIMER_FAILED)
+        harts[i].timer_state = TIMER_NONE;
+    }
+  }
+
+  /* backtrace() may allocate the first time it is called, which it must not
+   * do in the signal handler */
+  void *frame;
+  backtrace(&frame, 1);
+
+  struct sigaction sa;
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_sigaction = sigprof_handler;
+  sa.sa_flags = SA_SIGINFO | SA_RESTART;
+  sigemptyset(&sa.sa_mask);
+  if (sigaction(SIGPROF, &sa, NULL) != 0)
+    return errno;
+
+  profile_hz = hz;
+  wmb();
+  __lithe_profile_enabled = true;
+  return 0;
+}
+
+void lithe_profile_stop()
+{
+  __lithe_profile_enabled = false;
+  mb();
+  if (harts == NULL)
+    return;
+  for (int i = 0; i < max_harts(); i++)
+    delete_timer(&harts[i]);
+}
+
+/* Order samples so that identical stacks are adjacent, ignoring which context
+ * they were taken in */
+static int compare_samples(const void *a, const void *b)
+{
+  const struct sample *x = *(const struct sample **)a;
+  const struct sample *y = *(const struct sample **)b;
+  if (x->nscheds != y->nscheds)
+    return x->nscheds - y->nscheds;
+  int c = memcmp(x->scheds, y->scheds, sizeof(x->scheds));
+  if (c)
+    return c;
+  if ((x->context < 0) != (y->context < 0))
+    return (x->context < 0) - (y->context < 0);
+  if (x->nframes != y->nframes)
+    return x->nframes - y->nframes;
+  return memcmp(x->frames, y->frames, x->nframes * sizeof(void*));
+}
+
+static void print_frame(FILE *f, void *pc)
+{
+  Dl_info info;
+  memset(&info, 0, sizeof(info));
+  if (dladdr(pc, &info) && info.dli_sname)
+    fprintf(f, ";%s", info.dli_sname);
+  else if (info.dli_fname) {
+    const char *name = strrchr(info.dli_fname, '/');
+    fprintf(f, ";%s+%#lx", name ? name + 1 : info.dli_fname,
+            (unsigned long)((char*)pc - (char*)info.dli_fbase));
+  }
+  else
+    fprintf(f, ";%p", pc);
+}
+
+static void print_stack(FILE *f, const struct sample *s, uint64_t count)
+{
+  /* Root first: the scheduler hierarchy, then the stack from its outermost
+   * frame in */
+  fprintf(f, "lithe");
+  for (int i = s->nscheds - 1; i >= 0; i--)
+    fprintf(f, ";sched@%p", (void*)s->scheds[i]);
+  if (s->context < 0)
+    fprintf(f, ";[vcore]");
+  for (int i = s->nframes - 1; i >= 0; i--)
+    print_frame(f, s->frames[i]);
+  fprintf(f, " %llu\n", (unsigned long long)count);
+}
+
+int lithe_profile_dump(const char *path)
+{
+  if (path == NULL)
+    return EINVAL;
+  if (harts == NULL)
+    return ENODATA;
+
+  uint64_t total = 0;
+  for (int i = 0; i < max_harts(); i++)
+    total += harts[i].nsamples;
+
+  const struct sample **samples = malloc(sizeof(*samples) * (total ? total : 1));
+  if (samples == NULL)
+    return ENOMEM;
+  uint64_t n = 0;
+  for (int i = 0; i < max_harts(); i++)
+    for (uint64_t j = 0; j < harts[i].nsamples; j++)
+      samples[n++] = &harts[i].samples[j];
+  qsort(samples, n, sizeof(*samples), compare_samples);
+
+  FILE *f = fopen(path, "w");
+  if (f == NULL) {
+    int ret = errno;
+    free(samples);
+    return ret;
+  }
+
+  for (uint64_t i = 0; i < n; ) {
+    uint64_t j = i + 1;
+    while (j < n && compare_samples(&samples[i], &samples[j]) == 0)
+      j++;
+    print_stack(f, samples[i], j - i);
+    i = j;
+  }
+
+  uint64_t lost = 0;
+  for (int i = 0; i < max_harts(); i++)
+    lost += harts[i].lost;
+  if (lost)
+    fprintf(f, "lithe;[lost] %llu\n", (unsigned long long)lost);
+
+  free(samples);
+  int ret = ferror(f) ? EIO : 0;
+  if (fclose(f) != 0 && ret == 0)
+    ret = errno;
+  return ret;
+}
@@ -0,0 +1,53 @@
+/**
+ * Interface of lithe's sampling profiler.
+ *
+ * While started, every hart gets a SIGPROF timer ticking with the CPU time it
+ * consumes. Each tick records the scheduler the hart is running for (and that
+ * scheduler's ancestors), the id of the context it is running, if any, and a
+ * stack sample into a buffer of that hart's own. Dumps are folded stacks, one
+ * line per distinct stack with its number of samples, rooted at the scheduler
+ * hierarchy, ready for flamegraph.pl or speedscope. Profiling is started either
+ * by setting LITHE_PROFILE=<file> in the environment (the profile is then
+ * written to <file> when the program exits) or by calling
+ * lithe_profile_start().
+ *
+ * Stack samples are taken with backtrace(), which unwinds using the unwind
+ * tables of the code on the stack. On x86_64 a context's entry frame is marked
+ * as outermost, so unwinding stops there, as long as everything on the stack
+ * has unwind info. Elsewhere, or with code built without it (e.g.
+ * -fno-asynchronous-unwind-tables) or which corrupts its stack, the handler
+ * may read past the end of the context's stack and crash. Profile such
+ * programs with perf instead.
+ */
+
+#ifndef LITHE_PROFILE_H
+#define LITHE_PROFILE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Default sampling frequency, per hart, in samples per second of CPU time.
+ * Can be overridden with LITHE_PROFILE_HZ. */
+#define LITHE_PROFILE_DEFAULT_HZ 99
+
+/* Start sampling every hart 'hz' times per second of CPU time it uses,
+ * clearing any samples taken before. Harts start being sampled the next time
+ * they enter lithe. Returns 0 on success, EINVAL if 'hz' isn't positive
+ * or is more than 1000000000,
+ * EALREADY if the profiler is already running, or another errno value if
+ * setting it up failed. */
+int lithe_profile_start(int hz);
+
+/* Stop sampling. */
+void lithe_profile_stop();
+
+/* Write the samples taken so far to 'path' as folded stacks. Profiling should
+ * be stopped first. Returns 0 on success or an errno value on failure. */
+int lithe_profile_dump(const char *path);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // LITHE_PROFILE_H
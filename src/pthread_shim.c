@@ -0,0 +1,864 @@
+/**
+ * Implementation of an interposition layer that maps pthread mutexes,
+ * condition variables and POSIX semaphores onto lithe primitives.
+ *
+ * Built as a separate library (libithe_pthread) meant to be preloaded (or
+ * linked ahead of libpthread). Calls made from a lithe context running under
+ * a user level scheduler are routed to lithe_mutex_* and lithe_sem_*, and to
+ * queues of contexts parked on lithe notifiers for condition variables, so
+ * they block only the calling context instead of the entire hart. Calls made from ordinary OS threads or from vcore context fall through
+ * to the real implementations found with dlsym(RTLD_NEXT, ...).
+ *
+ * The lithe object backing each pthread object lives in a side table keyed on
+ * the address of the pthread object, and is created the first time a lithe
+ * context touches it (so statically initialized objects work too). Since the
+ * two implementations don't share state, an object claimed by lithe contexts
+ * must never be used from OS threads and vice versa; the table remembers who
+ * used each object and aborts as soon as it sees both.
+ *
+ * Lithe primitives have no timeouts, so timed waiters queue on the shim entry
+ * itself and park on a notifier. Whoever releases the object signals the
+ * first of them, and a single timer thread signals those whose deadline
+ * passes first. Condition variables queue all of their waiters this way.
+ */
+
+#define _GNU_SOURCE
+#include <dlfcn.h>
+#include <errno.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/queue.h>
+#include <sys/timerfd.h>
+#include "internal/assert.h"
+
+#include <parlib/parlib.h>
+#include <parlib/spinlock.h>
+#include "lithe.h"
+#include "mutex.h"
+#include "semaphore.h"
+#include "notifier.h"
+
+#define SHIM_NBUCKETS 1024
+
+enum {
+  SHIM_MUTEX,
+  SHIM_COND,
+  SHIM_SEM,
+};
+
+/* Who has used the pthread object behind an entry */
+enum {
+  SHIM_OWNER_NONE,
+  SHIM_OWNER_LITHE,
+  SHIM_OWNER_OS,
+};
+
+/* A context parked on a shim entry, and possibly on the timer. Lives on the
+ * waiting context's stack, and is only ever signaled under the lock of the
+ * queue it is on, so it may go away once it is off both queues. */
+struct shim_waiter {
+  TAILQ_ENTRY(shim_waiter) link;
+  TAILQ_ENTRY(shim_waiter) timer_link;
+  lithe_notifier_t notifier;
+  const struct timespec *abstime;
+  volatile bool queued;
+  bool armed;
+};
+TAILQ_HEAD(shim_waiter_queue, shim_waiter);
+
+struct shim_entry {
+  struct shim_entry *next;
+  const void *key;
+  int type;
+  int owner;
+  /* Number of wakers that may still touch the entry after the object they
+   * released can be taken, and so keep it from being freed */
+  volatile int busy;
+  /* Contexts parked on the entry: timed waiters, or condvar waiters */
+  spin_pdr_lock_t lock;
+  volatile int nwaiters;
+  struct shim_waiter_queue waiters;
+  union {
+    lithe_mutex_t mutex;
+    lithe_sem_t sem;
+  };
+};
+
+static struct shim_bucket {
+  spin_pdr_lock_t lock;
+  struct shim_entry *head;
+} shim_table[SHIM_NBUCKETS];
+
+/* Number of entries claimed by lithe contexts. Calls from OS threads only
+ * check the table for mixed use while there are any. */
+static volatile int shim_nlithe = 0;
+
+enum {
+  SHIM_TIMER_STOPPED,
+  SHIM_TIMER_STARTING,
+  SHIM_TIMER_RUNNING,
+};
+
+/* Deadlines of all timed waiters, earliest first, served by a single thread
+ * sleeping on a timerfd armed for the earliest of them */
+static struct {
+  volatile int state;
+  int tfd;
+  spin_pdr_lock_t lock;
+  struct shim_waiter_queue queue;
+} shim_timer = {
+  .state = SHIM_TIMER_STOPPED,
+  .tfd = -1,
+  .queue = TAILQ_HEAD_INITIALIZER(shim_timer.queue),
+};
+
+/* Pointers to the functions we interpose on */
+static int (*real_pthread_mutex_init)(pthread_mutex_t *,
+                                      const pthread_mutexattr_t *);
+static int (*real_pthread_mutex_destroy)(pthread_mutex_t *);
+static int (*real_pthread_mutex_lock)(pthread_mutex_t *);
+static int (*real_pthread_mutex_trylock)(pthread_mutex_t *);
+static int (*real_pthread_mutex_timedlock)(pthread_mutex_t *,
+                                           const struct timespec *);
+static int (*real_pthread_mutex_unlock)(pthread_mutex_t *);
+static int (*real_pthread_cond_init)(pthread_cond_t *,
+                                     const pthread_condattr_t *);
+static int (*real_pthread_cond_destroy)(pthread_cond_t *);
+static int (*real_pthread_cond_wait)(pthread_cond_t *, pthread_mutex_t *);
+static int (*real_pthread_cond_timedwait)(pthread_cond_t *, pthread_mutex_t *,
+                                          const struct timespec *);
+static int (*real_pthread_cond_signal)(pthread_cond_t *);
+static int (*real_pthread_cond_broadcast)(pthread_cond_t *);
+static int (*real_sem_init)(sem_t *, int, unsigned int);
+static int (*real_sem_destroy)(sem_t *);
+static int (*real_sem_wait)(sem_t *);
+static int (*real_sem_trywait)(sem_t *);
+static int (*real_sem_timedwait)(sem_t *, const struct timespec *);
+static int (*real_sem_post)(sem_t *);
+static int (*real_sem_getvalue)(sem_t *, int *);
+
+static volatile bool shim_initialized = false;
+
+static void *shim_dlsym(const char *name, const char *version)
+{
+  void *sym = NULL;
+#ifdef __GLIBC__
+  /* Plain dlsym() hands back the oldest version of versioned symbols, which
+   * for the condition variable functions is the pre-NPTL ABI. */
+  if (version)
+    sym = dlvsym(RTLD_NEXT, name, version);
+#endif
+  if (sym == NULL)
+    sym = dlsym(RTLD_NEXT, name);
+  if (sym == NULL)
+    abort();
+  return sym;
+}
+
+#define SHIM_RESOLVE(name, version) \
+  real_##name = shim_dlsym(#name, version)
+
+static void __attribute__((constructor)) shim_init()
+{
+  if (shim_initialized)
+    return;
+
+  for (int i = 0; i < SHIM_NBUCKETS; i++)
+    spin_pdr_init(&shim_table[i].lock);
+  spin_pdr_init(&shim_timer.lock);
+
+  SHIM_RESOLVE(pthread_mutex_init, NULL);
+  SHIM_RESOLVE(pthread_mutex_destroy, NULL);
+  SHIM_RESOLVE(pthread_mutex_lock, NULL);
+  SHIM_RESOLVE(pthread_mutex_trylock, NULL);
+  SHIM_RESOLVE(pthread_mutex_timedlock, NULL);
+  SHIM_RESOLVE(pthread_mutex_unlock, NULL);
+  SHIM_RESOLVE(pthread_cond_init, "GLIBC_2.3.2");
+  SHIM_RESOLVE(pthread_cond_destroy, "GLIBC_2.3.2");
+  SHIM_RESOLVE(pthread_cond_wait, "GLIBC_2.3.2");
+  SHIM_RESOLVE(pthread_cond_timedwait, "GLIBC_2.3.2");
+  SHIM_RESOLVE(pthread_cond_signal, "GLIBC_2.3.2");
+  SHIM_RESOLVE(pthread_cond_broadcast, "GLIBC_2.3.2");
+  SHIM_RESOLVE(sem_init, NULL);
+  SHIM_RESOLVE(sem_destroy, NULL);
+  SHIM_RESOLVE(sem_wait, NULL);
+  SHIM_RESOLVE(sem_trywait, NULL);
+  SHIM_RESOLVE(sem_timedwait, NULL);
+  SHIM_RESOLVE(sem_post, NULL);
+  SHIM_RESOLVE(sem_getvalue, NULL);
+
+  wmb();
+  shim_initialized = true;
+}
+
+/* Other constructors may call into us before our own constructor has run */
+static inline void shim_ensure_init()
+{
+  if (!shim_initialized)
+    shim_init();
+}
+
+/* Only calls from a lithe context running under a real (non-base) scheduler
+ * are routed to lithe; anything else gets the original behavior. */
+static inline bool shim_routed()
+{
+  if (in_vcore_context())
+    return false;
+  if (lithe_context_self() == NULL)
+    return false;
+  lithe_sched_t *sched = lithe_sched_current();
+  return sched != NULL && sched->parent != NULL;
+}
+
+static inline struct shim_bucket *shim_bucket(const void *key)
+{
+  return &shim_table[((uintptr_t)key >> 4) % SHIM_NBUCKETS];
+}
+
+static void __attribute__((noreturn)) shim_fatal(const char *what,
+                                                 const void *key)
+{
+  fprintf(stderr, "libithe_pthread: %s %p\n", what, key);
+  abort();
+}
+
+static void __attribute__((noreturn)) shim_mixed_use(const void *key)
+{
+  shim_fatal("object used from both lithe contexts and OS threads:", key);
+}
+
+/* Passed as the mutex type of mutexes we never saw initialized */
+#define SHIM_MUTEX_TYPE_UNKNOWN -1
+
+/* Make sure no OS thread holds the pthread mutex behind an entry lithe is
+ * about to claim. A mutex that never went through pthread_mutex_init(), i.e.
+ * one statically initialized with PTHREAD_MUTEX_INITIALIZER or one of its
+ * variants, records its type nowhere we can ask for it, so for those also
+ * find out whether it is recursive by trying to lock it twice. */
+static int shim_probe_mutex(pthread_mutex_t *m, int mutex_type)
+{
+  int ret = real_pthread_mutex_trylock(m);
+  if (ret == EBUSY)
+    shim_mixed_use(m);
+  if (ret != 0)
+    return mutex_type;
+
+  if (mutex_type == SHIM_MUTEX_TYPE_UNKNOWN) {
+    mutex_type = PTHREAD_MUTEX_DEFAULT;
+    if (real_pthread_mutex_trylock(m) == 0) {
+      mutex_type = PTHREAD_MUTEX_RECURSIVE;
+      real_pthread_mutex_unlock(m);
+    }
+  }
+  real_pthread_mutex_unlock(m);
+  return mutex_type;
+}
+
+static void shim_entry_init(struct shim_entry *e, int type, const void *key,
+                            int mutex_type)
+{
+  e->busy = 0;
+  spin_pdr_init(&e->lock);
+  e->nwaiters = 0;
+  TAILQ_INIT(&e->waiters);
+  switch (type) {
+    case SHIM_MUTEX: {
+      lithe_mutexattr_t attr;
+      lithe_mutexattr_init(&attr);
+      if (mutex_type == PTHREAD_MUTEX_RECURSIVE)
+        lithe_mutexattr_settype(&attr, LITHE_MUTEX_RECURSIVE);
+      lithe_mutex_init(&e->mutex, &attr);
+      break;
+    }
+    case SHIM_COND:
+      break;
+    case SHIM_SEM: {
+      int value = 0;
+      real_sem_getvalue((sem_t *) key, &value);
+      lithe_sem_init(&e->sem, value < 0 ? 0 : value);
+      break;
+    }
+  }
+}
+
+/* Find the lithe object backing 'key', creating it on first use. For mutexes,
+ * 'mutex_type' is the type given to pthread_mutex_init(), if known. With
+ * 'owner' set to SHIM_OWNER_LITHE, the entry is claimed for lithe. If 'hold'
+ * is set, the entry can't be freed until shim_release() is called on it. */
+static struct shim_entry *shim_find(const void *key, int type,
+                                    int mutex_type, int owner, bool hold)
+{
+  struct shim_bucket *b = shim_bucket(key);
+  struct shim_entry *e;
+
+  spin_pdr_lock(&b->lock);
+  for (e = b->head; e != NULL; e = e->next)
+    if (e->key == key)
+      break;
+  if (e == NULL) {
+    if (type == SHIM_MUTEX && owner == SHIM_OWNER_LITHE)
+      mutex_type = shim_probe_mutex((pthread_mutex_t *) key, mutex_type);
+    e = malloc(sizeof(struct shim_entry));
+    assert(e);
+    e->key = key;
+    e->type = type;
+    e->owner = SHIM_OWNER_NONE;
+    shim_entry_init(e, type, key, mutex_type);
+    e->next = b->head;
+    b->head = e;
+  } else if (e->owner == SHIM_OWNER_NONE && owner == SHIM_OWNER_LITHE &&
+             type == SHIM_MUTEX) {
+    /* Its type was recorded when it was initialized */
+    shim_probe_mutex((pthread_mutex_t *) key, PTHREAD_MUTEX_DEFAULT);
+  }
+  if (owner == SHIM_OWNER_LITHE && e->owner != SHIM_OWNER_LITHE) {
+    if (e->owner == SHIM_OWNER_OS)
+      shim_mixed_use(key);
+    e->owner = SHIM_OWNER_LITHE;
+    __sync_fetch_and_add(&shim_nlithe, 1);
+  }
+  if (hold)
+    __sync_fetch_and_add(&e->busy, 1);
+  spin_pdr_unlock(&b->lock);
+
+  assert(e->type == type);
+  return e;
+}
+
+static inline struct shim_entry *shim_lookup(const void *key, int type)
+{
+  return shim_find(key, type, SHIM_MUTEX_TYPE_UNKNOWN, SHIM_OWNER_LITHE,
+                   false);
+}
+
+/* Like shim_lookup(), for callers that keep using the entry after releasing
+ * the object, when a waiter may already be on its way to destroy it. */
+static inline struct shim_entry *shim_lookup_hold(const void *key, int type)
+{
+  return shim_find(key, type, SHIM_MUTEX_TYPE_UNKNOWN, SHIM_OWNER_LITHE,
+                   true);
+}
+
+static inline void shim_release(struct shim_entry *e)
+{
+  __sync_fetch_and_add(&e->busy, -1);
+}
+
+/* Record a call made from outside lithe on 'key', aborting if lithe contexts
+ * have claimed it. Only bothers while lithe has claimed anything at all. */
+static void shim_check_unrouted(const void *key)
+{
+  if (shim_nlithe == 0)
+    return;
+
+  struct shim_bucket *b = shim_bucket(key);
+  spin_pdr_lock(&b->lock);
+  for (struct shim_entry *e = b->head; e != NULL; e = e->next) {
+    if (e->key == key) {
+      if (e->owner == SHIM_OWNER_LITHE)
+        shim_mixed_use(key);
+      e->owner = SHIM_OWNER_OS;
+      break;
+    }
+  }
+  spin_pdr_unlock(&b->lock);
+}
+
+/* Drop any lithe object backing 'key', e.g. when it is (re)initialized or
+ * destroyed, so a later object at the same address starts out fresh. */
+static void shim_forget(const void *key)
+{
+  struct shim_bucket *b = shim_bucket(key);
+  struct shim_entry *e = NULL;
+
+  spin_pdr_lock(&b->lock);
+  for (struct shim_entry **pe = &b->head; *pe != NULL; pe = &(*pe)->next) {
+    if ((*pe)->key == key) {
+      e = *pe;
+      *pe = e->next;
+      break;
+    }
+  }
+  spin_pdr_unlock(&b->lock);
+  if (e == NULL)
+    return;
+
+  if (e->owner == SHIM_OWNER_LITHE)
+    __sync_fetch_and_add(&shim_nlithe, -1);
+  /* Wakers are done with the entry in a handful of instructions */
+  while (e->busy != 0)
+    cpu_relax();
+  free(e);
+}
+
+static bool shim_expired(const struct timespec *abstime)
+{
+  struct timespec now;
+  clock_gettime(CLOCK_REALTIME, &now);
+  if (now.tv_sec != abstime->tv_sec)
+    return now.tv_sec > abstime->tv_sec;
+  return now.tv_nsec >= abstime->tv_nsec;
+}
+
+static inline bool shim_valid_abstime(const struct timespec *abstime)
+{
+  return abstime->tv_nsec >= 0 && abstime->tv_nsec < 1000000000;
+}
+
+/* Point the timerfd at the earliest deadline, or disarm it if there is none.
+ * Called with the timer lock held. */
+static void shim_timer_rearm()
+{
+  struct itimerspec its = {{0, 0}, {0, 0}};
+  struct shim_waiter *first = TAILQ_FIRST(&shim_timer.queue);
+  if (first)
+    its.it_value = *first->abstime;
+  timerfd_settime(shim_timer.tfd, TFD_TIMER_ABSTIME, &its, NULL);
+}
+
+static void *shim_timer_thread(void *arg)
+{
+  while (1) {
+    uint64_t expirations;
+    if (read(shim_timer.tfd, &expirations, sizeof(expirations)) < 0) {
+      assert(errno == EINTR);
+      continue;
+    }
+
+    spin_pdr_lock(&shim_timer.lock);
+    struct shim_waiter *w;
+    while ((w = TAILQ_FIRST(&shim_timer.queue)) && shim_expired(w->abstime)) {
+      TAILQ_REMOVE(&shim_timer.queue, w, timer_link);
+      w->armed = false;
+      lithe_notifier_signal(&w->notifier);
+    }
+    shim_timer_rearm();
+    spin_pdr_unlock(&shim_timer.lock);
+  }
+  return NULL;
+}
+
+/* Start the timer thread the first time anybody needs it */
+static void shim_timer_start()
+{
+  if (shim_timer.state == SHIM_TIMER_RUNNING)
+    return;
+  if (!__sync_bool_compare_and_swap(&shim_timer.state, SHIM_TIMER_STOPPED,
+                                    SHIM_TIMER_STARTING)) {
+    while (shim_timer.state != SHIM_TIMER_RUNNING)
+      cpu_relax();
+    return;
+  }
+
+  shim_timer.tfd = timerfd_create(CLOCK_REALTIME, TFD_CLOEXEC);
+  if (shim_timer.tfd < 0)
+    shim_fatal("failed to create the timeout timerfd:", NULL);
+  pthread_attr_t attr;
+  pthread_t thread;
+  pthread_attr_init(&attr);
+  pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+  if (pthread_create(&thread, &attr, shim_timer_thread, NULL) != 0)
+    shim_fatal("failed to start the timeout thread:", NULL);
+  pthread_attr_destroy(&attr);
+
+  wmb();
+  shim_timer.state = SHIM_TIMER_RUNNING;
+}
+
+/* Have the timer thread signal 'w' once 'abstime' has passed */
+static void shim_timer_arm(struct shim_waiter *w,
+                           const struct timespec *abstime)
+{
+  shim_timer_start();
+  w->abstime = abstime;
+
+  spin_pdr_lock(&shim_timer.lock);
+  struct shim_waiter *before;
+  TAILQ_FOREACH(before, &shim_timer.queue, timer_link) {
+    if (abstime->tv_sec < before->abstime->tv_sec ||
+        (abstime->tv_sec == before->abstime->tv_sec &&
+         abstime->tv_nsec < before->abstime->tv_nsec))
+      break;
+  }
+  if (before)
+    TAILQ_INSERT_BEFORE(before, w, timer_link);
+  else
+    TAILQ_INSERT_TAIL(&shim_timer.queue, w, timer_link);
+  w->armed = true;
+  if (TAILQ_FIRST(&shim_timer.queue) == w)
+    shim_timer_rearm();
+  spin_pdr_unlock(&shim_timer.lock);
+}
+
+/* Make sure the timer thread is done with 'w'. A timerfd left armed for it
+ * just wakes the timer thread once for nothing. */
+static void shim_timer_disarm(struct shim_waiter *w)
+{
+  spin_pdr_lock(&shim_timer.lock);
+  if (w->armed) {
+    TAILQ_REMOVE(&shim_timer.queue, w, timer_link);
+    w->armed = false;
+  }
+  spin_pdr_unlock(&shim_timer.lock);
+}
+
+static void shim_waiter_init(struct shim_waiter *w)
+{
+  lithe_notifier_init(&w->notifier);
+  w->abstime = NULL;
+  w->queued = false;
+  w->armed = false;
+}
+
+/* Queue 'w' on the entry, unless it is queued already. The queueing is a full
+ * barrier, so a waker releasing the object after it sees 'w', and a waker
+ * releasing it before has its release seen by our next attempt to acquire. */
+static void shim_waiter_enqueue(struct shim_entry *e, struct shim_waiter *w)
+{
+  spin_pdr_lock(&e->lock);
+  if (!w->queued) {
+    TAILQ_INSERT_TAIL(&e->waiters, w, link);
+    w->queued = true;
+    __sync_fetch_and_add(&e->nwaiters, 1);
+  }
+  spin_pdr_unlock(&e->lock);
+}
+
+/* Take 'w' off the entry. Returns whether it was still queued, i.e. no waker
+ * got to it first. */
+static bool shim_waiter_dequeue(struct shim_entry *e, struct shim_waiter *w)
+{
+  spin_pdr_lock(&e->lock);
+  bool queued = w->queued;
+  if (queued) {
+    TAILQ_REMOVE(&e->waiters, w, link);
+    w->queued = false;
+    __sync_fetch_and_add(&e->nwaiters, -1);
+  }
+  spin_pdr_unlock(&e->lock);
+  return queued;
+}
+
+/* Take the first (or every) waiter off the entry and signal it, after
+ * releasing the object it waits for. */
+static void shim_wake(struct shim_entry *e, bool all)
+{
+  mb();
+  if (e->nwaiters == 0)
+    return;
+
+  spin_pdr_lock(&e->lock);
+  struct shim_waiter *w;
+  while ((w = TAILQ_FIRST(&e->waiters))) {
+    TAILQ_REMOVE(&e->waiters, w, link);
+    w->queued = false;
+    __sync_fetch_and_add(&e->nwaiters, -1);
+    lithe_notifier_signal(&w->notifier);
+    if (!all)
+      break;
+  }
+  spin_pdr_unlock(&e->lock);
+}
+
+/* Wait until 'try_acquire' stops returning 'busy' or 'abstime' passes,
+ * parking on a notifier in between. Whoever releases the object wakes the
+ * first timed waiter, which then tries again. */
+static int shim_timed_acquire(struct shim_entry *e,
+                              int (*try_acquire)(struct shim_entry *),
+                              int busy, const struct timespec *abstime)
+{
+  int ret = try_acquire(e);
+  if (ret != busy)
+    return ret;
+  if (!shim_valid_abstime(abstime))
+    return EINVAL;
+
+  struct shim_waiter w;
+  shim_waiter_init(&w);
+  shim_timer_arm(&w, abstime);
+  while (1) {
+    shim_waiter_enqueue(e, &w);
+    if ((ret = try_acquire(e)) != busy)
+      break;
+    if (shim_expired(abstime)) {
+      ret = ETIMEDOUT;
+      break;
+    }
+    lithe_notifier_wait(&w.notifier);
+  }
+  /* If a waker picked us but we are leaving without the object, hand its
+   * wakeup on to the next waiter */
+  if (!shim_waiter_dequeue(e, &w) && ret != 0)
+    shim_wake(e, false);
+  shim_timer_disarm(&w);
+  return ret;
+}
+
+static inline lithe_mutex_t *shim_mutex(pthread_mutex_t *m)
+{
+  return &shim_lookup(m, SHIM_MUTEX)->mutex;
+}
+
+int pthread_mutex_init(pthread_mutex_t *m, const pthread_mutexattr_t *attr)
+{
+  shim_ensure_init();
+  shim_forget(m);
+  int ret = real_pthread_mutex_init(m, attr);
+  if (ret)
+    return ret;
+
+  /* Record the mutex's type now, while we have it from its attributes */
+  int type = PTHREAD_MUTEX_DEFAULT;
+  if (attr)
+    pthread_mutexattr_gettype(attr, &type);
+  shim_find(m, SHIM_MUTEX, type, SHIM_OWNER_NONE, false);
+  return 0;
+}
+
+int pthread_mutex_destroy(pthread_mutex_t *m)
+{
+  shim_ensure_init();
+  shim_forget(m);
+  return real_pthread_mutex_destroy(m);
+}
+
+int pthread_mutex_lock(pthread_mutex_t *m)
+{
+  shim_ensure_init();
+  if (shim_routed())
+    return lithe_mutex_lock(shim_mutex(m));
+  shim_check_unrouted(m);
+  return real_pthread_mutex_lock(m);
+}
+
+int pthread_mutex_trylock(pthread_mutex_t *m)
+{
+  shim_ensure_init();
+  if (shim_routed())
+    return lithe_mutex_trylock(shim_mutex(m));
+  shim_check_unrouted(m);
+  return real_pthread_mutex_trylock(m);
+}
+
+static int shim_mutex_trylock(struct shim_entry *e)
+{
+  return lithe_mutex_trylock(&e->mutex);
+}
+
+int pthread_mutex_timedlock(pthread_mutex_t *m, const struct timespec *abstime)
+{
+  shim_ensure_init();
+  if (!shim_routed()) {
+    shim_check_unrouted(m);
+    return real_pthread_mutex_timedlock(m, abstime);
+  }
+
+  struct shim_entry *e = shim_lookup(m, SHIM_MUTEX);
+  return shim_timed_acquire(e, shim_mutex_trylock, EBUSY, abstime);
+}
+
+int pthread_mutex_unlock(pthread_mutex_t *m)
+{
+  shim_ensure_init();
+  if (!shim_routed()) {
+    shim_check_unrouted(m);
+    return real_pthread_mutex_unlock(m);
+  }
+
+  struct shim_entry *e = shim_lookup_hold(m, SHIM_MUTEX);
+  int ret = lithe_mutex_unlock(&e->mutex);
+  if (ret == 0)
+    shim_wake(e, false);
+  shim_release(e);
+  return ret;
+}
+
+int pthread_cond_init(pthread_cond_t *c, const pthread_condattr_t *attr)
+{
+  shim_ensure_init();
+  shim_forget(c);
+  return real_pthread_cond_init(c, attr);
+}
+
+int pthread_cond_destroy(pthread_cond_t *c)
+{
+  shim_ensure_init();
+  shim_forget(c);
+  return real_pthread_cond_destroy(c);
+}
+
+/* Condition variables don't use lithe_condvar_wait(), which would unlock the
+ * mutex behind the back of its timed waiters. Instead every waiter, timed or
+ * not, queues on the shim entry in FIFO order and parks on its notifier. */
+static int shim_cond_wait(pthread_cond_t *c, pthread_mutex_t *m,
+                          const struct timespec *abstime)
+{
+  struct shim_entry *e = shim_lookup(c, SHIM_COND);
+  struct shim_entry *me = shim_lookup(m, SHIM_MUTEX);
+  struct shim_waiter w;
+  shim_waiter_init(&w);
+  shim_waiter_enqueue(e, &w);
+  if (abstime)
+    shim_timer_arm(&w, abstime);
+
+  int ret = lithe_mutex_unlock(&me->mutex);
+  if (ret != 0) {
+    shim_waiter_dequeue(e, &w);
+    shim_timer_disarm(&w);
+    return ret;
+  }
+  shim_wake(me, false);
+  while (w.queued && !(abstime && shim_expired(abstime)))
+    lithe_notifier_wait(&w.notifier);
+  /* A signal that got to us first wins over the timeout */
+  if (shim_waiter_dequeue(e, &w))
+    ret = ETIMEDOUT;
+  shim_timer_disarm(&w);
+
+  lithe_mutex_lock(&me->mutex);
+  return ret;
+}
+
+int pthread_cond_wait(pthread_cond_t *c, pthread_mutex_t *m)
+{
+  shim_ensure_init();
+  if (shim_routed())
+    return shim_cond_wait(c, m, NULL);
+  shim_check_unrouted(c);
+  shim_check_unrouted(m);
+  return real_pthread_cond_wait(c, m);
+}
+
+int pthread_cond_timedwait(pthread_cond_t *c, pthread_mutex_t *m,
+                           const struct timespec *abstime)
+{
+  shim_ensure_init();
+  if (!shim_routed()) {
+    shim_check_unrouted(c);
+    shim_check_unrouted(m);
+    return real_pthread_cond_timedwait(c, m, abstime);
+  }
+  if (!shim_valid_abstime(abstime))
+    return EINVAL;
+  return shim_cond_wait(c, m, abstime);
+}
+
+int pthread_cond_signal(pthread_cond_t *c)
+{
+  shim_ensure_init();
+  if (!shim_routed()) {
+    shim_check_unrouted(c);
+    return real_pthread_cond_signal(c);
+  }
+
+  struct shim_entry *e = shim_lookup_hold(c, SHIM_COND);
+  shim_wake(e, false);
+  shim_release(e);
+  return 0;
+}
+
+int pthread_cond_broadcast(pthread_cond_t *c)
+{
+  shim_ensure_init();
+  if (!shim_routed()) {
+    shim_check_unrouted(c);
+    return real_pthread_cond_broadcast(c);
+  }
+
+  struct shim_entry *e = shim_lookup_hold(c, SHIM_COND);
+  shim_wake(e, true);
+  shim_release(e);
+  return 0;
+}
+
+/* The semaphore functions report errors through errno */
+static inline int shim_sem_retval(int retval)
+{
+  if (retval == 0)
+    return 0;
+  errno = retval;
+  return -1;
+}
+
+int sem_init(sem_t *s, int pshared, unsigned int value)
+{
+  shim_ensure_init();
+  shim_forget(s);
+  return real_sem_init(s, pshared, value);
+}
+
+int sem_destroy(sem_t *s)
+{
+  shim_ensure_init();
+  shim_forget(s);
+  return real_sem_destroy(s);
+}
+
+int sem_wait(sem_t *s)
+{
+  shim_ensure_init();
+  if (shim_routed())
+    return shim_sem_retval(lithe_sem_wait(&shim_lookup(s, SHIM_SEM)->sem));
+  shim_check_unrouted(s);
+  return real_sem_wait(s);
+}
+
+int sem_trywait(sem_t *s)
+{
+  shim_ensure_init();
+  if (shim_routed())
+    return shim_sem_retval(lithe_sem_trywait(&shim_lookup(s, SHIM_SEM)->sem));
+  shim_check_unrouted(s);
+  return real_sem_trywait(s);
+}
+
+static int shim_sem_trywait(struct shim_entry *e)
+{
+  return lithe_sem_trywait(&e->sem);
+}
+
+int sem_timedwait(sem_t *s, const struct timespec *abstime)
+{
+  shim_ensure_init();
+  if (!shim_routed()) {
+    shim_check_unrouted(s);
+    return real_sem_timedwait(s, abstime);
+  }
+
+  struct shim_entry *e = shim_lookup(s, SHIM_SEM);
+  return shim_sem_retval(shim_timed_acquire(e, shim_sem_trywait, EAGAIN,
+                                            abstime));
+}
+
+int sem_post(sem_t *s)
+{
+  shim_ensure_init();
+  if (!shim_routed()) {
+    shim_check_unrouted(s);
+    return real_sem_post(s);
+  }
+
+  struct shim_entry *e = shim_lookup_hold(s, SHIM_SEM);
+  int ret = lithe_sem_post(&e->sem);
+  if (ret == 0)
+    shim_wake(e, false);
+  shim_release(e);
+  return shim_sem_retval(ret);
+}
+
+int sem_getvalue(sem_t *s, int *value)
+{
+  shim_ensure_init();
+  if (shim_routed()) {
+    return shim_sem_retval(lithe_sem_getvalue(&shim_lookup(s, SHIM_SEM)->sem,
+                                              value));
+  }
+  shim_check_unrouted(s);
+  return real_sem_getvalue(s, value);
+}
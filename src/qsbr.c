@@ -0,0 +1,137 @@
+/**
+ * Implementation of quiescent-state-based memory reclamation.
+ *
+ * A global epoch advances once every online hart has observed its current
+ * value. Memory retired in epoch e can no longer be referenced by anybody
+ * once the global epoch has reached e + 2, since every hart has gone through
+ * a quiescent state after the memory was unlinked. Each hart keeps its retired
+ * memory in one bag per epoch (modulo 3) and frees whole bags at a time.
+ */
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include "internal/assert.h"
+
+#include <parlib/parlib.h>
+#include "hart.h"
+#include "qsbr.h"
+
+/* Number of quiescent states a hart with pending garbage goes through between
+ * attempts to advance the global epoch */
+#define QSBR_ADVANCE_INTERVAL 64
+
+struct qsbr_item {
+  void *ptr;
+  void (*free_func) (void *);
+};
+
+struct qsbr_bag {
+  unsigned long epoch;
+  size_t size;
+  size_t capacity;
+  struct qsbr_item *items;
+};
+
+struct qsbr_hart {
+  volatile unsigned long epoch;
+  volatile bool online;
+  unsigned int nquiescent;
+  size_t pending;
+  struct qsbr_bag bags[3];
+} __attribute__((aligned(ARCH_CL_SIZE)));
+
+static volatile unsigned long global_epoch CACHE_LINE_ALIGNED = 1;
+static struct qsbr_hart *qsbr_harts;
+
+void lithe_qsbr_init()
+{
+  qsbr_harts = parlib_aligned_alloc(ARCH_CL_SIZE,
+                 sizeof(struct qsbr_hart) * max_harts());
+  assert(qsbr_harts);
+  memset(qsbr_harts, 0, sizeof(struct qsbr_hart) * max_harts());
+}
+
+static void free_bag(struct qsbr_hart *h, struct qsbr_bag *bag)
+{
+  for (size_t i = 0; i < bag->size; i++)
+    bag->items[i].free_func(bag->items[i].ptr);
+  h->pending -= bag->size;
+  bag->size = 0;
+}
+
+/* Free every bag on this hart that has outlived its grace period */
+static void reclaim(struct qsbr_hart *h, unsigned long epoch)
+{
+  for (int i = 0; i < 3; i++) {
+    struct qsbr_bag *bag = &h->bags[i];
+    if (bag->size && bag->epoch + 2 <= epoch)
+      free_bag(h, bag);
+  }
+}
+
+/* Move the global epoch on if every online hart has observed it */
+static void try_advance(unsigned long epoch)
+{
+  for (int i = 0; i < max_harts(); i++) {
+    struct qsbr_hart *h = &qsbr_harts[i];
+    if (h->online && h->epoch != epoch)
+      return;
+  }
+  __sync_bool_compare_and_swap(&global_epoch, epoch, epoch + 1);
+}
+
+void lithe_qsbr_retire(void *ptr, void (*free_func) (void *))
+{
+  assert(free_func);
+  struct qsbr_hart *h = &qsbr_harts[hart_id()];
+  unsigned long epoch = global_epoch;
+  struct qsbr_bag *bag = &h->bags[epoch % 3];
+
+  /* Anything left in this bag is from at least 3 epochs ago */
+  if (bag->epoch != epoch) {
+    free_bag(h, bag);
+    bag->epoch = epoch;
+  }
+
+  if (bag->size == bag->capacity) {
+    bag->capacity = bag->capacity ? 2 * bag->capacity : 64;
+    bag->items = realloc(bag->items, bag->capacity * sizeof(struct qsbr_item));
+    assert(bag->items);
+  }
+  bag->items[bag->size].ptr = ptr;
+  bag->items[bag->size].free_func = free_func;
+  bag->size++;
+  h->pending++;
+}
+
+void lithe_qsbr_quiescent()
+{
+  struct qsbr_hart *h = &qsbr_harts[hart_id()];
+  unsigned long epoch = global_epoch;
+  if (h->epoch != epoch) {
+    /* Order all of our previous reads before announcing the epoch */
+    mb();
+    h->epoch = epoch;
+    if (h->pending)
+      reclaim(h, epoch);
+  }
+  if (h->pending && ++h->nquiescent % QSBR_ADVANCE_INTERVAL == 0)
+    try_advance(epoch);
+}
+
+void lithe_qsbr_offline()
+{
+  struct qsbr_hart *h = &qsbr_harts[hart_id()];
+  mb();
+  h->online = false;
+}
+
+void lithe_qsbr_online()
+{
+  struct qsbr_hart *h = &qsbr_harts[hart_id()];
+  h->epoch = global_epoch;
+  wmb();
+  h->online = true;
+  mb();
+}
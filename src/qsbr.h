@@ -0,0 +1,40 @@
+/**
+ * Interface of quiescent-state-based memory reclamation (QSBR).
+ *
+ * Memory that lock-free readers may still be looking at can be retired here
+ * instead of being freed directly. It is freed (in batches) once every hart
+ * has passed through a quiescent state, i.e. entered its scheduler or
+ * switched contexts, since the memory was retired. Readers must therefore not
+ * hold on to references to retired memory across a lithe_context_block(),
+ * lithe_context_yield() or any other call that switches contexts.
+ */
+
+#ifndef LITHE_QSBR_H
+#define LITHE_QSBR_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Retire 'ptr', which will be freed by calling 'free_func(ptr)' once every
+ * hart has passed through a quiescent state. */
+void lithe_qsbr_retire(void *ptr, void (*free_func) (void *));
+
+/* Announce a quiescent state for the calling hart. Called automatically by
+ * the lithe runtime on every hart entry and context switch, but may also be
+ * called by long-running contexts that hold no references to shared data. */
+void lithe_qsbr_quiescent();
+
+/* Take the calling hart out of (and back into) grace period tracking, e.g.
+ * while it is idle or yielded to the system. Called by the lithe runtime. */
+void lithe_qsbr_offline();
+void lithe_qsbr_online();
+
+/* Set up the per-hart reclamation state. Called from lithe_lib_init(). */
+void lithe_qsbr_init();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // LITHE_QSBR_H
@@ -64,6 +64,12 @@ void __context_exit(lithe_sched_t *__this, lithe_context_t *context)
   ((Scheduler*)__this)->context_exit(context);
 }
 
+void __context_unblock_batch(lithe_sched_t *__this,
+                             lithe_context_t **contexts, size_t n)
+{
+  ((Scheduler*)__this)->context_unblock_batch(contexts, n);
+}
+
 const lithe_sched_funcs_t Scheduler::static_funcs = {
   /*.hart_request          = */ __hart_request,
   /*.hart_enter            = */ __hart_enter,
@@ -75,7 +81,8 @@ const lithe_sched_funcs_t Scheduler::static_funcs = {
   /*.context_block         = */ __context_block,
   /*.context_unblock       = */ __context_unblock,
   /*.context_yield         = */ __context_yield,
-  /*.context_exit          = */ __context_exit
+  /*.context_exit          = */ __context_exit,
+  /*.context_unblock_batch = */ __context_unblock_batch
 };
  
 }
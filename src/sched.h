@@ -26,6 +26,11 @@ typedef struct lithe_sched_queue lithe_sched_queue_t;
  * schedulers */
 typedef struct lithe_sched lithe_sched_t;
 
+/* Per hart statistics counters and latency histograms, internal to lithe
+ * (see stats.h) */
+struct lithe_hart_stats;
+struct lithe_latency;
+
 /* Lithe scheduler callbacks/entrypoints. */
 typedef struct lithe_sched_funcs {
   /* Function ultimately responsible for granting hart requests from a child
@@ -79,6 +84,20 @@ typedef struct lithe_sched_funcs {
    * lithe_context_cleanup(). */
   void (*context_exit) (lithe_sched_t *__this, lithe_context_t *context);
 
+  /* Optional callback letting this scheduler know that a whole batch of its
+   * contexts has been unblocked at once via lithe_context_unblock_many(). It
+   * allows queue locks to be taken and harts to be requested once per batch
+   * rather than once per context. If left NULL, context_unblock() is called
+   * once for each context in the batch instead. */
+  void (*context_unblock_batch) (lithe_sched_t *__this,
+                                 lithe_context_t **contexts, size_t n);
+
+  /* Optional callback returning how many of this scheduler's contexts are
+   * runnable but waiting for a hart to run on. Used for introspection only
+   * (see introspect.h), so it may be approximate. Called from arbitrary
+   * harts, and possibly from a signal handler, so it must not take locks. */
+  long (*runnable_contexts) (lithe_sched_t *__this);
+
 } lithe_sched_funcs_t;
 
 /* Basic lithe scheduler structure. All derived schedulers MUST have this as
@@ -117,6 +136,21 @@ struct lithe_sched {
 
   /* Scheduler's parent scheduler */
   lithe_sched_t *parent;
+
+  /* Per hart statistics counters, or NULL if statistics are disabled */
+  struct lithe_hart_stats *stats;
+
+  /* Unblock-to-run latency histogram, or NULL if statistics are disabled */
+  struct lithe_latency *latency;
+
+  /* Net number of harts asked for through lithe_hart_request() */
+  atomic_t hart_demand;
+
+  /* Number of this scheduler's contexts currently blocked */
+  atomic_t blocked_contexts;
+
+  /* Link in lithe's registry of live schedulers */
+  TAILQ_ENTRY(lithe_sched) registry_link;
 };
 
 #ifdef __cplusplus
@@ -28,6 +28,8 @@ class Scheduler : public lithe_sched_t {
   friend void __context_unblock(lithe_sched_t *__this, lithe_context_t *context);
   friend void __context_yield(lithe_sched_t *__this, lithe_context_t *context);
   friend void __context_exit(lithe_sched_t *__this, lithe_context_t *context);
+  friend void __context_unblock_batch(lithe_sched_t *__this,
+                                      lithe_context_t **contexts, size_t n);
   
  protected:
   virtual void hart_enter() = 0;
@@ -52,12 +54,104 @@ class Scheduler : public lithe_sched_t {
     { return __context_yield_default(this, context); }
   virtual void context_exit(lithe_context_t *context)
     { return __context_exit_default(this, context); }
+  virtual void context_unblock_batch(lithe_context_t **contexts, size_t n)
+    { for (size_t i = 0; i < n; i++) context_unblock(contexts[i]); }
 
  public:
   Scheduler() {funcs = &Scheduler::static_funcs; }
   virtual ~Scheduler() {}
 };
 
+/* A scheduler base class that avoids virtual dispatch altogether. Each
+ * Derived class gets its own lithe_sched_funcs_t table, built at compile
+ * time, whose entries call straight into Derived's member functions. Derived
+ * must define hart_enter() and may hide any of the defaults below by defining
+ * a member with the same name. Callbacks that Derived keeps non-public must
+ * be made accessible with 'friend class lithe::StaticScheduler<Derived>;'.
+ *
+ *   class MySched : public lithe::StaticScheduler<MySched> {
+ *    public:
+ *     void hart_enter();
+ *   };
+ */
+template <typename Derived>
+class StaticScheduler : public lithe_sched_t {
+ protected:
+  static const lithe_sched_funcs_t static_funcs;
+
+  void hart_request(lithe_sched_t *child, int h)
+    { __hart_request_default(this, child, h); }
+  void hart_return(lithe_sched_t *child)
+    { __hart_return_default(this, child); }
+  void sched_enter()
+    { __sched_enter_default(this); }
+  void sched_exit()
+    { __sched_exit_default(this); }
+  void child_enter(lithe_sched_t *child)
+    { __child_enter_default(this, child); }
+  void child_exit(lithe_sched_t *child)
+    { __child_exit_default(this, child); }
+  void context_block(lithe_context_t *context)
+    { __context_block_default(this, context); }
+  void context_unblock(lithe_context_t *context)
+    { __context_unblock_default(this, context); }
+  void context_yield(lithe_context_t *context)
+    { __context_yield_default(this, context); }
+  void context_exit(lithe_context_t *context)
+    { __context_exit_default(this, context); }
+  void context_unblock_batch(lithe_context_t **contexts, size_t n)
+    { for (size_t i = 0; i < n; i++) self(this)->context_unblock(contexts[i]); }
+
+ private:
+  static Derived *self(lithe_sched_t *__this)
+    { return static_cast<Derived*>(static_cast<StaticScheduler*>(__this)); }
+
+  static void __hart_request(lithe_sched_t *__this, lithe_sched_t *child, int h)
+    { self(__this)->hart_request(child, h); }
+  static void __hart_enter(lithe_sched_t *__this)
+    { self(__this)->hart_enter(); }
+  static void __hart_return(lithe_sched_t *__this, lithe_sched_t *child)
+    { self(__this)->hart_return(child); }
+  static void __sched_enter(lithe_sched_t *__this)
+    { self(__this)->sched_enter(); }
+  static void __sched_exit(lithe_sched_t *__this)
+    { self(__this)->sched_exit(); }
+  static void __child_enter(lithe_sched_t *__this, lithe_sched_t *child)
+    { self(__this)->child_enter(child); }
+  static void __child_exit(lithe_sched_t *__this, lithe_sched_t *child)
+    { self(__this)->child_exit(child); }
+  static void __context_block(lithe_sched_t *__this, lithe_context_t *context)
+    { self(__this)->context_block(context); }
+  static void __context_unblock(lithe_sched_t *__this, lithe_context_t *context)
+    { self(__this)->context_unblock(context); }
+  static void __context_yield(lithe_sched_t *__this, lithe_context_t *context)
+    { self(__this)->context_yield(context); }
+  static void __context_exit(lithe_sched_t *__this, lithe_context_t *context)
+    { self(__this)->context_exit(context); }
+  static void __context_unblock_batch(lithe_sched_t *__this,
+                                      lithe_context_t **contexts, size_t n)
+    { self(__this)->context_unblock_batch(contexts, n); }
+
+ public:
+  StaticScheduler() { funcs = &StaticScheduler::static_funcs; }
+};
+
+template <typename Derived>
+const lithe_sched_funcs_t StaticScheduler<Derived>::static_funcs = {
+  /*.hart_request          = */ StaticScheduler<Derived>::__hart_request,
+  /*.hart_enter            = */ StaticScheduler<Derived>::__hart_enter,
+  /*.hart_return           = */ StaticScheduler<Derived>::__hart_return,
+  /*.sched_enter           = */ StaticScheduler<Derived>::__sched_enter,
+  /*.sched_exit            = */ StaticScheduler<Derived>::__sched_exit,
+  /*.child_enter           = */ StaticScheduler<Derived>::__child_enter,
+  /*.child_exit            = */ StaticScheduler<Derived>::__child_exit,
+  /*.context_block         = */ StaticScheduler<Derived>::__context_block,
+  /*.context_unblock       = */ StaticScheduler<Derived>::__context_unblock,
+  /*.context_yield         = */ StaticScheduler<Derived>::__context_yield,
+  /*.context_exit          = */ StaticScheduler<Derived>::__context_exit,
+  /*.context_unblock_batch = */ StaticScheduler<Derived>::__context_unblock_batch
+};
+
 }
 
 #endif  // LITHE_SCHED_HH
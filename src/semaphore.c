@@ -10,9 +10,29 @@
 #include <errno.h>
 #include <stdbool.h>
 #include <stdlib.h>
-#include "futex.h"
+#include "internal/assert.h"
+
+#include <parlib/parlib.h>
 #include "semaphore.h"
 
+#define SEM_UNBLOCK_BATCH 64
+
+/* Layout of the semaphore's state word: the value lives in the low 32 bits
+ * and the number of waiters in the upper 32 bits. While there are waiters,
+ * the state word is only ever changed with the lock held. */
+#define SEM_VALUE_MASK 0xffffffffULL
+#define SEM_WAITER     (1ULL << 32)
+
+static inline int sem_value(uint64_t state)
+{
+  return (int)(uint32_t)(state & SEM_VALUE_MASK);
+}
+
+static inline int sem_nwaiters(uint64_t state)
+{
+  return (int)(state >> 32);
+}
+
 int lithe_sem_init(lithe_sem_t *sem, int count)
 {
   if(sem == NULL)
@@ -20,50 +40,191 @@ int lithe_sem_init(lithe_sem_t *sem, int count)
   if(count < 0)
     return EINVAL;
 
-  sem->value = count;
-  sem->nwaiters = 0;
+  sem->state = (uint32_t)count;
+  mcs_pdr_init(&sem->lock);
+  sem->qnode = NULL;
+  sem->head = NULL;
+  sem->tail = NULL;
   return 0;
 }
 
-static int atomic_decrement_if_positive(int *pvalue)
+/* Atomically take 'count' permits if there are that many available. Unless
+ * 'queued' is set, only do so while nobody is waiting, so that permits handed
+ * out under the lock can't be taken before the poster has let go of it. */
+static bool take(lithe_sem_t *sem, int count, bool queued)
 {
+  uint64_t state = sem->state;
   while (true) {
-    int value = *pvalue;
-    if (value > 0 && !__sync_bool_compare_and_swap(pvalue, value, value-1))
-      continue;
-    return value;
+    if (sem_value(state) < count)
+      return false;
+    if (!queued && sem_nwaiters(state) != 0)
+      return false;
+    uint64_t seen = __sync_val_compare_and_swap(&sem->state, state,
+                                                state - count);
+    if (seen == state)
+      return true;
+    state = seen;
   }
 }
 
-int lithe_sem_wait(lithe_sem_t *sem)
+static void block(lithe_context_t *context, void *arg)
+{
+  lithe_sem_t *sem = (lithe_sem_t *) arg;
+  assert(sem);
+  sem->tail->context = context;
+  mcs_pdr_unlock(&sem->lock, sem->qnode);
+}
+
+int lithe_sem_wait_n(lithe_sem_t *sem, int count)
 {
   if(sem == NULL)
     return EINVAL;
+  if(count <= 0)
+    return EINVAL;
 
-  if (atomic_decrement_if_positive(&sem->value) > 0)
+  /* Fast path: nobody is queued ahead of us and there are enough permits */
+  if (take(sem, count, false))
     return 0;
 
-  __sync_fetch_and_add(&sem->nwaiters, 1);
+  mcs_lock_qnode_t qnode = {0};
+  mcs_pdr_lock(&sem->lock, &qnode);
 
-  do {
-    if (futex(&sem->value, FUTEX_WAIT, 0, NULL, NULL, 0))
-      return -1;
-  } while (atomic_decrement_if_positive(&sem->value) <= 0);
+  /* Announce ourselves before looking at the value one last time. From here
+   * on posters can no longer publish permits without taking the lock, so
+   * either we see their permits now or they find us on the queue. */
+  __sync_fetch_and_add(&sem->state, SEM_WAITER);
+  if (sem->head == NULL && take(sem, count, true)) {
+    __sync_fetch_and_sub(&sem->state, SEM_WAITER);
+    mcs_pdr_unlock(&sem->lock, &qnode);
+    return 0;
+  }
 
+  /* Queue up. Whoever dequeues us has already taken our permits for us. */
+  struct lithe_sem_waiter waiter = {NULL, NULL, count};
+  if (sem->tail)
+    sem->tail->next = &waiter;
+  else
+    sem->head = &waiter;
+  sem->tail = &waiter;
+  sem->qnode = &qnode;
+  lithe_context_block(block, sem);
   return 0;
 }
 
-int lithe_sem_post(lithe_sem_t *sem)
+int lithe_sem_wait(lithe_sem_t *sem)
+{
+  return lithe_sem_wait_n(sem, 1);
+}
+
+int lithe_sem_trywait(lithe_sem_t *sem)
 {
   if(sem == NULL)
     return EINVAL;
 
-  __sync_fetch_and_add(&sem->value, 1);
-  __sync_synchronize();
+  if (take(sem, 1, false))
+    return 0;
+  return EAGAIN;
+}
 
-  if (sem->nwaiters > 0)
-    return futex(&sem->value, FUTEX_WAKE, 1, NULL, NULL, 0);
+int lithe_sem_getvalue(lithe_sem_t *sem, int *value)
+{
+  if(sem == NULL || value == NULL)
+    return EINVAL;
+
+  *value = sem_value(sem->state);
+  return 0;
+}
+
+/* Hand out the available permits plus '*pending' more to waiters at the head
+ * of the queue, returning the list of waiters that were satisfied. Permits
+ * left over stay in the semaphore if anyone is still waiting; otherwise they
+ * are returned in '*pending' for the caller to publish once it has dropped
+ * the lock. Called with the lock held and at least one waiter. */
+static struct lithe_sem_waiter *handoff(lithe_sem_t *sem, int *pending)
+{
+  uint64_t state = sem->state;
+  int avail = sem_value(state) + *pending;
+  int nwaiters = sem_nwaiters(state);
+  struct lithe_sem_waiter *first = sem->head;
+  struct lithe_sem_waiter *last = NULL;
+
+  while (sem->head && sem->head->count <= avail) {
+    avail -= sem->head->count;
+    last = sem->head;
+    sem->head = sem->head->next;
+    nwaiters--;
+  }
+  if (last)
+    last->next = NULL;
+  if (sem->head == NULL)
+    sem->tail = NULL;
+
+  if (nwaiters > 0) {
+    sem->state = ((uint64_t) nwaiters << 32) | (uint32_t)avail;
+    *pending = 0;
+  } else {
+    sem->state = 0;
+    *pending = avail;
+  }
+  return last ? first : NULL;
+}
+
+int lithe_sem_post_n(lithe_sem_t *sem, int count)
+{
+  if(sem == NULL)
+    return EINVAL;
+  if(count <= 0)
+    return EINVAL;
+
+  /* Once our permits can be taken, a waiter may free the semaphore, so
+   * publishing them is the last thing we do to it. Without waiters that is
+   * a single atomic add. With waiters, we hand permits out under the lock and
+   * publish what is left over after dropping it, going around again should
+   * somebody have started waiting in the meantime. */
+  struct lithe_sem_waiter *released = NULL;
+  struct lithe_sem_waiter **tail = &released;
+  int pending = count;
+  uint64_t state = sem->state;
+  while (pending > 0) {
+    if (sem_nwaiters(state) == 0) {
+      uint64_t seen = __sync_val_compare_and_swap(&sem->state, state,
+                                                  state + pending);
+      if (seen == state)
+        break;
+      state = seen;
+      continue;
+    }
 
+    mcs_lock_qnode_t qnode = {0};
+    mcs_pdr_lock(&sem->lock, &qnode);
+    if (sem_nwaiters(sem->state) != 0) {
+      *tail = handoff(sem, &pending);
+      while (*tail)
+        tail = &(*tail)->next;
+    }
+    mcs_pdr_unlock(&sem->lock, &qnode);
+    if (pending > 0)
+      state = sem->state;
+  }
+
+  /* Each waiter lives on its context's stack, so grab the next pointer
+   * before the context can run again. */
+  lithe_context_t *batch[SEM_UNBLOCK_BATCH];
+  size_t nbatch = 0;
+  while (released) {
+    struct lithe_sem_waiter *next = released->next;
+    batch[nbatch++] = released->context;
+    if (nbatch == SEM_UNBLOCK_BATCH) {
+      lithe_context_unblock_many(batch, nbatch);
+      nbatch = 0;
+    }
+    released = next;
+  }
+  lithe_context_unblock_many(batch, nbatch);
   return 0;
 }
 
+int lithe_sem_post(lithe_sem_t *sem)
+{
+  return lithe_sem_post_n(sem, 1);
+}
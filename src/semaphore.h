@@ -10,6 +10,7 @@
 #ifndef LITHE_SEMAPHORE_H
 #define LITHE_SEMAPHORE_H
 
+#include <stdint.h>
 #include <parlib/mcs.h>
 #include "mutex.h"
 
@@ -17,12 +18,27 @@
 extern "C" {
 #endif
 
-/* A lithe semaphore struct */
+/* A context waiting on a semaphore, along with the number of permits it
+ * needs. Lives on the waiting context's stack. */
+struct lithe_sem_waiter {
+  struct lithe_sem_waiter *next;
+  lithe_context_t *context;
+  int count;
+};
+
+/* A lithe semaphore struct. The low 32 bits of 'state' hold the value and the
+ * upper 32 bits the number of waiters. Permits are taken and returned with
+ * atomic operations on 'state' alone as long as nobody is waiting; once
+ * someone is, posters take the lock and hand permits to the queue of waiters
+ * instead. */
 typedef struct lithe_sem {
-  int value;
-  int nwaiters;
+  volatile uint64_t state;
+  mcs_pdr_lock_t lock;
+  mcs_lock_qnode_t *qnode;
+  struct lithe_sem_waiter *head;
+  struct lithe_sem_waiter *tail;
 } lithe_sem_t;
-#define LITHE_SEM_INITIALIZER {0, 0}
+#define LITHE_SEM_INITIALIZER {0, MCS_PDRLOCK_INIT, NULL, NULL, NULL}
 
 /* Initialize a semaphore. */
 int lithe_sem_init(lithe_sem_t *sem, int count);
@@ -30,9 +46,24 @@ int lithe_sem_init(lithe_sem_t *sem, int count);
 /* Wait on a semaphore. */
 int lithe_sem_wait(lithe_sem_t *sem);
 
+/* Wait for 'count' permits from a semaphore at once. Waiters are served in
+ * FIFO order. */
+int lithe_sem_wait_n(lithe_sem_t *sem, int count);
+
+/* Try and wait on a semaphore without blocking. Returns EAGAIN if the
+ * semaphore's value is zero. */
+int lithe_sem_trywait(lithe_sem_t *sem);
+
+/* Get the number of permits currently available from a semaphore. */
+int lithe_sem_getvalue(lithe_sem_t *sem, int *value);
+
 /* Post on a semaphore. */
 int lithe_sem_post(lithe_sem_t *sem);
 
+/* Post 'count' permits to a semaphore at once, waking as many waiters as they
+ * satisfy with a single batched unblock. */
+int lithe_sem_post_n(lithe_sem_t *sem, int count);
+
 #ifdef __cplusplus
 }
 #endif
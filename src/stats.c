@@ -0,0 +1,186 @@
+/**
+ * Implementation of lithe's runtime statistics.
+ */
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <parlib/parlib.h>
+#include "hart.h"
+#include "stats.h"
+#include "internal/assert.h"
+#include "internal/stats.h"
+
+static volatile bool stats_enabled = false;
+static lithe_sched_t *base_sched = NULL;
+
+struct lithe_hart_account *__lithe_hart_accounts = NULL;
+
+void __lithe_stats_init(lithe_sched_t *base)
+{
+  base_sched = base;
+  const char *s = getenv("LITHE_STATS");
+  if (s != NULL && atoi(s) != 0)
+    lithe_stats_enable();
+}
+
+void lithe_stats_enable()
+{
+  /* Only the first caller sets up the accounts */
+  if (!__sync_bool_compare_and_swap(&stats_enabled, false, true))
+    return;
+  if (base_sched && base_sched->stats == NULL)
+    base_sched->stats = __lithe_stats_alloc();
+  if (base_sched && base_sched->latency == NULL)
+    base_sched->latency = __lithe_latency_alloc();
+
+  /* Harts start being accounted for from their next state transition on */
+  size_t size = sizeof(struct lithe_hart_account) * max_harts();
+  struct lithe_hart_account *accounts = parlib_aligned_alloc(ARCH_CL_SIZE, size);
+  assert(accounts);
+  memset(accounts, 0, size);
+  wmb();
+  __lithe_hart_accounts = accounts;
+}
+
+struct lithe_hart_stats *__lithe_stats_alloc()
+{
+  if (!stats_enabled)
+    return NULL;
+
+  size_t size = sizeof(struct lithe_hart_stats) * max_harts();
+  struct lithe_hart_stats *stats = parlib_aligned_alloc(ARCH_CL_SIZE, size);
+  assert(stats);
+  memset(stats, 0, size);
+  return stats;
+}
+
+void __lithe_stats_free(struct lithe_hart_stats *stats)
+{
+  free(stats);
+}
+
+struct lithe_latency *__lithe_latency_alloc()
+{
+  if (!stats_enabled)
+    return NULL;
+
+  struct lithe_latency *latency = parlib_aligned_alloc(ARCH_CL_SIZE,
+                                                       sizeof(*latency));
+  assert(latency);
+  memset(latency, 0, sizeof(*latency));
+  return latency;
+}
+
+void __lithe_latency_free(struct lithe_latency *latency)
+{
+  free(latency);
+}
+
+int lithe_stats_snapshot(lithe_sched_t *sched, lithe_stats_t *out)
+{
+  if (out == NULL)
+    return EINVAL;
+  if (sched == NULL)
+    sched = base_sched;
+
+  memset(out, 0, sizeof(*out));
+  out->harts = atomic_read(&sched->harts);
+
+  struct lithe_hart_stats *stats = sched->stats;
+  if (stats == NULL)
+    return ENOTSUP;
+
+  /* The counters are read while their harts may be updating them, so the
+   * totals are only approximately consistent with one another. */
+  for (int i = 0; i < max_harts(); i++) {
+    lithe_stats_t *c = &stats[i].counters;
+    out->harts_requested    += c->harts_requested;
+    out->harts_released     += c->harts_released;
+    out->harts_granted      += c->harts_granted;
+    out->harts_yielded      += c->harts_yielded;
+    out->hart_enters        += c->hart_enters;
+    out->contexts_run       += c->contexts_run;
+    out->contexts_blocked   += c->contexts_blocked;
+    out->contexts_unblocked += c->contexts_unblocked;
+    out->contexts_yielded   += c->contexts_yielded;
+    out->contexts_exited    += c->contexts_exited;
+    out->idle_spins         += c->idle_spins;
+    out->vcore_yields       += c->vcore_yields;
+    out->context_ns         += c->context_ns;
+    out->sched_ns           += c->sched_ns;
+    out->idle_ns            += c->idle_ns;
+    out->yielded_ns         += c->yielded_ns;
+  }
+
+  /* Add in the time harts currently charged to 'sched' have been in their
+   * current state, which only gets accounted for at their next transition */
+  struct lithe_hart_account *accounts = __lithe_hart_accounts;
+  if (accounts) {
+    uint64_t now = __lithe_stats_now();
+    for (int i = 0; i < max_harts(); i++) {
+      struct lithe_hart_account a = accounts[i];
+      if (a.sched == sched && a.since && a.since < now)
+        *__lithe_account_bucket(out, a.state) += now - a.since;
+    }
+  }
+  return 0;
+}
+
+int lithe_stats_latency(lithe_sched_t *sched, lithe_latency_t *out)
+{
+  if (out == NULL)
+    return EINVAL;
+  if (sched == NULL)
+    sched = base_sched;
+
+  memset(out, 0, sizeof(*out));
+  struct lithe_latency *latency = sched->latency;
+  if (latency == NULL)
+    return ENOTSUP;
+
+  /* Like the counters, only approximately consistent while harts record */
+  memcpy(out, latency, sizeof(*out));
+  return 0;
+}
+
+/* The largest value that falls into bucket 'i' */
+static uint64_t latency_bucket_max(int i)
+{
+  if (i < (1 << LITHE_LATENCY_SUB_BITS))
+    return i;
+  int shift = (i >> LITHE_LATENCY_SUB_BITS) - 1;
+  uint64_t sub = i & ((1 << LITHE_LATENCY_SUB_BITS) - 1);
+  uint64_t lowest = ((1ULL << LITHE_LATENCY_SUB_BITS) + sub) << shift;
+  return lowest + ((1ULL << shift) - 1);
+}
+
+uint64_t lithe_latency_percentile(const lithe_latency_t *latency,
+                                  double percentile)
+{
+  uint64_t total = 0;
+  for (int i = 0; i < LITHE_LATENCY_BUCKETS; i++)
+    total += latency->buckets[i];
+  if (total == 0)
+    return 0;
+
+  if (percentile < 0)
+    percentile = 0;
+  if (percentile > 100)
+    percentile = 100;
+  uint64_t rank = (uint64_t)(percentile / 100 * total + 0.5);
+  if (rank == 0)
+    rank = 1;
+
+  uint64_t seen = 0;
+  for (int i = 0; i < LITHE_LATENCY_BUCKETS; i++) {
+    seen += latency->buckets[i];
+    if (seen >= rank) {
+      uint64_t ns = latency_bucket_max(i);
+      return ns < latency->max_ns ? ns : latency->max_ns;
+    }
+  }
+  return latency->max_ns;
+}
@@ -0,0 +1,101 @@
+/**
+ * Interface of lithe's runtime statistics.
+ *
+ * Once enabled (by setting LITHE_STATS in the environment, or by calling
+ * lithe_stats_enable()), every scheduler entered from then on counts what its
+ * harts and contexts are doing. Each hart only ever updates its own
+ * cache-line-padded copy of the counters, without atomics, and
+ * lithe_stats_snapshot() adds them up. When disabled, the runtime only pays for
+ * a NULL check at each counting point.
+ */
+
+#ifndef LITHE_STATS_H
+#define LITHE_STATS_H
+
+#include <stdint.h>
+#include "sched.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct lithe_stats {
+  /* Number of harts the scheduler owns right now */
+  long harts;
+
+  /* Harts asked for (and given up on) through lithe_hart_request() */
+  uint64_t harts_requested;
+  uint64_t harts_released;
+
+  /* Harts granted to the scheduler by its parent, and yielded back */
+  uint64_t harts_granted;
+  uint64_t harts_yielded;
+
+  /* Calls to the scheduler's hart_enter() callback */
+  uint64_t hart_enters;
+
+  /* Contexts of the scheduler started or resumed on a hart, blocked,
+   * unblocked, cooperatively yielded, and run to completion */
+  uint64_t contexts_run;
+  uint64_t contexts_blocked;
+  uint64_t contexts_unblocked;
+  uint64_t contexts_yielded;
+  uint64_t contexts_exited;
+
+  /* Base scheduler only: times an idle hart started spinning waiting for
+   * work, and times one was handed back to the system after all */
+  uint64_t idle_spins;
+  uint64_t vcore_yields;
+
+  /* Time, in nanoseconds, the scheduler's harts spent running its contexts
+   * and running its own code in vcore context (hart_enter() and the other
+   * callbacks). For the base scheduler, also the time its harts spent idle,
+   * spinning or parked waiting for work, and yielded to the system. */
+  uint64_t context_ns;
+  uint64_t sched_ns;
+  uint64_t idle_ns;
+  uint64_t yielded_ns;
+} lithe_stats_t;
+
+/* Histogram of the time between a scheduler's contexts being unblocked and
+ * running again. Buckets are log-linear (as in HdrHistogram): values below
+ * 2^LITHE_LATENCY_SUB_BITS nanoseconds get a bucket each, and every power of
+ * two above that is split into 2^LITHE_LATENCY_SUB_BITS equal buckets, for a
+ * relative error of at most 1/16. */
+#define LITHE_LATENCY_SUB_BITS 4
+#define LITHE_LATENCY_BUCKETS \
+  ((64 - LITHE_LATENCY_SUB_BITS + 1) << LITHE_LATENCY_SUB_BITS)
+
+typedef struct lithe_latency {
+  /* Number of unblock-to-run intervals recorded, their sum and the longest */
+  uint64_t count;
+  uint64_t sum_ns;
+  uint64_t max_ns;
+
+  uint64_t buckets[LITHE_LATENCY_BUCKETS];
+} lithe_latency_t;
+
+/* Start keeping statistics for every scheduler entered from now on. */
+void lithe_stats_enable();
+
+/* Fill 'out' with the statistics of 'sched' (or of lithe's base scheduler,
+ * if NULL). Only possible while 'sched' is entered. Times include the time
+ * harts have spent in their current state so far. Returns ENOTSUP if no
+ * statistics were kept for it. */
+int lithe_stats_snapshot(lithe_sched_t *sched, lithe_stats_t *out);
+
+/* Copy the unblock-to-run latency histogram of 'sched' (or of lithe's base
+ * scheduler, if NULL) into 'out'. Same rules as lithe_stats_snapshot(). */
+int lithe_stats_latency(lithe_sched_t *sched, lithe_latency_t *out);
+
+/* Return the latency, in nanoseconds, below which 'percentile' percent (0 to
+ * 100) of the intervals in 'latency' fall, rounded up to the end of its
+ * bucket. Returns 0 for an empty histogram. */
+uint64_t lithe_latency_percentile(const lithe_latency_t *latency,
+                                  double percentile);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // LITHE_STATS_H
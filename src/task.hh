@@ -0,0 +1,439 @@
+/*
+ * Lithe Coroutine Tasks
+ *
+ * Stackless C++20 coroutines that run on the workers of a lithe::Executor.
+ * Suspending a task (on a Mutex, a channel, a JoinHandle, or to yield) only
+ * suspends its coroutine frame; the worker context running it moves straight on to the
+ * next piece of work and never blocks.
+ *
+ * Only available when compiling with coroutine support (e.g. -std=c++20).
+ */
+
+#ifndef LITHE_TASK_HH
+#define LITHE_TASK_HH
+
+#if defined(__cpp_impl_coroutine) && __has_include(<coroutine>)
+
+#include <atomic>
+#include <coroutine>
+#include <exception>
+#include <optional>
+#include <utility>
+#include <errno.h>
+#include <parlib/mcs.h>
+#include "chan.h"
+#include "executor.hh"
+#include "semaphore.h"
+
+namespace lithe {
+
+template<typename T = void>
+class task;
+
+namespace detail {
+
+/* Resumes a coroutine when run by an executor */
+struct ResumeItem : WorkItem {
+  std::coroutine_handle<> handle;
+
+  ResumeItem() { run = &ResumeItem::resume; }
+
+  static void resume(WorkItem *item)
+  {
+    static_cast<ResumeItem*>(item)->handle.resume();
+  }
+};
+
+struct promise_base {
+  /* Whoever co_awaited us, resumed directly when we finish */
+  std::coroutine_handle<> continuation = std::noop_coroutine();
+
+  struct final_awaiter {
+    bool await_ready() noexcept { return false; }
+    template<typename P>
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<P> h) noexcept
+      { return h.promise().continuation; }
+    void await_resume() noexcept {}
+  };
+
+  std::suspend_always initial_suspend() noexcept { return {}; }
+  final_awaiter final_suspend() noexcept { return {}; }
+  void unhandled_exception() { std::terminate(); }
+};
+
+template<typename T>
+struct promise : promise_base {
+  std::optional<T> value;
+
+  task<T> get_return_object();
+  template<typename U>
+  void return_value(U &&v) { value.emplace(std::forward<U>(v)); }
+  T result() { return std::move(*value); }
+};
+
+template<>
+struct promise<void> : promise_base {
+  task<void> get_return_object();
+  void return_void() {}
+  void result() {}
+};
+
+}
+
+/* A lazily started coroutine producing a T. It starts running when it is
+ * co_awaited (on the awaiting task's worker), or when handed to spawn(). */
+template<typename T>
+class task {
+public:
+  typedef detail::promise<T> promise_type;
+
+  task() : handle(nullptr) {}
+  explicit task(std::coroutine_handle<promise_type> h) : handle(h) {}
+  task(task &&other) noexcept : handle(std::exchange(other.handle, nullptr)) {}
+  task &operator=(task &&other) noexcept
+  {
+    if (this != &other) {
+      if (handle)
+        handle.destroy();
+      handle = std::exchange(other.handle, nullptr);
+    }
+    return *this;
+  }
+  ~task() { if (handle) handle.destroy(); }
+
+  task(const task&) = delete;
+  task &operator=(const task&) = delete;
+
+  bool await_ready() const noexcept { return !handle || handle.done(); }
+  std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept
+  {
+    handle.promise().continuation = awaiting;
+    return handle;
+  }
+  T await_resume() { return handle.promise().result(); }
+
+private:
+  std::coroutine_handle<promise_type> handle;
+};
+
+namespace detail {
+
+template<typename T>
+task<T> promise<T>::get_return_object()
+{
+  return task<T>(std::coroutine_handle<promise<T> >::from_promise(*this));
+}
+
+inline task<void> promise<void>::get_return_object()
+{
+  return task<void>(std::coroutine_handle<promise<void> >::from_promise(*this));
+}
+
+}
+
+/* Reschedule the calling task on 'executor', letting other queued work run
+ * first. Also used to move a task onto an executor's workers to begin with. */
+class yield {
+public:
+  explicit yield(Executor &executor) : executor(executor) {}
+
+  bool await_ready() const noexcept { return false; }
+  void await_suspend(std::coroutine_handle<> h) noexcept
+  {
+    item.handle = h;
+    /* May resume (and destroy) us on another worker right away */
+    executor.submit(&item);
+  }
+  void await_resume() const noexcept {}
+
+private:
+  Executor &executor;
+  detail::ResumeItem item;
+};
+
+/* A mutex for coroutine tasks. Contended lock() calls suspend the task and
+ * queue it; unlock() hands the mutex straight to the next queued task and
+ * resubmits it to the executor it was waiting on. */
+class Mutex {
+  struct LockAwaiter : detail::ResumeItem {
+    Mutex &mutex;
+    Executor &executor;
+    LockAwaiter *next_waiter;
+
+    LockAwaiter(Mutex &mutex, Executor &executor)
+      : mutex(mutex), executor(executor), next_waiter(nullptr) {}
+
+    bool await_ready() { return mutex.try_lock(); }
+    bool await_suspend(std::coroutine_handle<> h)
+    {
+      handle = h;
+      mcs_lock_qnode_t qnode = MCS_QNODE_INIT;
+      mcs_pdr_lock(&mutex.qlock, &qnode);
+      if (!mutex.locked) {
+        mutex.locked = true;
+        mcs_pdr_unlock(&mutex.qlock, &qnode);
+        return false;
+      }
+      if (mutex.tail)
+        mutex.tail->next_waiter = this;
+      else
+        mutex.head = this;
+      mutex.tail = this;
+      mcs_pdr_unlock(&mutex.qlock, &qnode);
+      return true;
+    }
+    void await_resume() {}
+  };
+
+public:
+  Mutex() : locked(false), head(nullptr), tail(nullptr) { mcs_pdr_init(&qlock); }
+  Mutex(const Mutex&) = delete;
+  Mutex &operator=(const Mutex&) = delete;
+
+  /* co_await mutex.lock(executor), where 'executor' is the one the calling
+   * task should be resumed on if it has to wait */
+  LockAwaiter lock(Executor &executor) { return LockAwaiter(*this, executor); }
+
+  bool try_lock()
+  {
+    mcs_lock_qnode_t qnode = MCS_QNODE_INIT;
+    mcs_pdr_lock(&qlock, &qnode);
+    bool acquired = !locked;
+    locked = true;
+    mcs_pdr_unlock(&qlock, &qnode);
+    return acquired;
+  }
+
+  void unlock()
+  {
+    mcs_lock_qnode_t qnode = MCS_QNODE_INIT;
+    mcs_pdr_lock(&qlock, &qnode);
+    LockAwaiter *next = head;
+    if (next) {
+      head = next->next_waiter;
+      if (head == nullptr)
+        tail = nullptr;
+    }
+    else {
+      locked = false;
+    }
+    mcs_pdr_unlock(&qlock, &qnode);
+
+    /* Ownership passes to 'next' without the mutex ever being released */
+    if (next)
+      next->executor.submit(next);
+  }
+
+private:
+  mcs_pdr_lock_t qlock;
+  bool locked;
+  LockAwaiter *head;
+  LockAwaiter *tail;
+};
+
+/* A send or receive on a lithe channel, for tasks. If it can't complete
+ * right away, the task is queued on the channel's own wait queues alongside
+ * any parked contexts, and resubmitted to 'executor' once a message has been
+ * passed or the channel closed. co_await yields what lithe_chan_send() or
+ * lithe_chan_recv() would have returned. */
+class ChanAwaiter : lithe_chan_waiter, detail::ResumeItem {
+public:
+  ChanAwaiter(lithe_chan_t &chan, void *msg, Executor &executor)
+    : chan(chan), executor(executor), sending(true), send_msg(msg),
+      recv_msg(nullptr), ret(0) { wake = &ChanAwaiter::wake_task; }
+  ChanAwaiter(lithe_chan_t &chan, void **msg, Executor &executor)
+    : chan(chan), executor(executor), sending(false), send_msg(nullptr),
+      recv_msg(msg), ret(0) { wake = &ChanAwaiter::wake_task; }
+
+  bool await_ready()
+  {
+    ret = sending ? lithe_chan_trysend(&chan, send_msg)
+                  : lithe_chan_tryrecv(&chan, recv_msg);
+    return ret != EAGAIN;
+  }
+  bool await_suspend(std::coroutine_handle<> h)
+  {
+    handle = h;
+    /* Once queued, we may be woken, resumed and destroyed on another worker
+     * before the call even returns, so 'this' is off limits afterwards */
+    ret = EINPROGRESS;
+    int r = sending ? lithe_chan_send_async(&chan, send_msg, this)
+                    : lithe_chan_recv_async(&chan, recv_msg, this);
+    if (r == EINPROGRESS)
+      return true;
+    ret = r;
+    return false;
+  }
+  int await_resume()
+  {
+    if (ret != EINPROGRESS)
+      return ret;
+    if (done) {
+      if (!sending)
+        *recv_msg = msg;
+      return 0;
+    }
+    /* Woken up by lithe_chan_close(), so this can't have to wait again */
+    return sending ? lithe_chan_trysend(&chan, send_msg)
+                   : lithe_chan_tryrecv(&chan, recv_msg);
+  }
+
+private:
+  static void wake_task(lithe_chan_waiter *w)
+  {
+    ChanAwaiter *self = static_cast<ChanAwaiter*>(w);
+    self->executor.submit(self);
+  }
+
+  lithe_chan_t &chan;
+  Executor &executor;
+  bool sending;
+  void *send_msg;
+  void **recv_msg;
+  int ret;
+};
+
+/* co_await chan_send(chan, msg, executor) and co_await chan_recv(chan, &msg,
+ * executor), where 'executor' is the one the calling task should be resumed
+ * on if it has to wait */
+inline ChanAwaiter chan_send(lithe_chan_t &chan, void *msg, Executor &executor)
+{
+  return ChanAwaiter(chan, msg, executor);
+}
+
+inline ChanAwaiter chan_recv(lithe_chan_t &chan, void **msg, Executor &executor)
+{
+  return ChanAwaiter(chan, msg, executor);
+}
+
+namespace detail {
+
+/* Somebody waiting for a spawned task to finish */
+struct JoinWaiter {
+  void (*wake)(JoinWaiter *waiter);
+};
+
+/* State shared between a spawned task and its JoinHandle. 'waiter' is null
+ * while the task runs unobserved, DONE once it has finished, and points at
+ * the JoinWaiter otherwise. */
+struct JoinState {
+  std::atomic<JoinWaiter*> waiter;
+  std::atomic<int> refs;
+
+  static JoinWaiter *done() { return reinterpret_cast<JoinWaiter*>(1); }
+
+  JoinState() : waiter(nullptr), refs(2) {}
+
+  void release() { if (refs.fetch_sub(1) == 1) delete this; }
+
+  void complete()
+  {
+    JoinWaiter *w = waiter.exchange(done());
+    if (w)
+      w->wake(w);
+  }
+
+  /* Returns false if the task had already finished */
+  bool wait(JoinWaiter *w)
+  {
+    JoinWaiter *expected = nullptr;
+    return waiter.compare_exchange_strong(expected, w);
+  }
+};
+
+/* A fire-and-forget coroutine that cleans up after itself */
+struct detached {
+  struct promise_type {
+    detached get_return_object() { return {}; }
+    std::suspend_never initial_suspend() noexcept { return {}; }
+    std::suspend_never final_suspend() noexcept { return {}; }
+    void return_void() {}
+    void unhandled_exception() { std::terminate(); }
+  };
+};
+
+inline detached run_spawned(Executor &executor, task<void> t, JoinState *state)
+{
+  co_await yield(executor);
+  co_await t;
+  state->complete();
+  state->release();
+}
+
+}
+
+/* A handle on a task started with spawn(). Can be co_awaited from another
+ * task, or join()ed from a stackful context. Dropping it detaches the task. */
+class JoinHandle {
+  struct Awaiter : detail::JoinWaiter, detail::ResumeItem {
+    detail::JoinState *state;
+    Executor &executor;
+
+    Awaiter(detail::JoinState *state, Executor &executor)
+      : state(state), executor(executor) { wake = &Awaiter::wake_task; }
+
+    static void wake_task(detail::JoinWaiter *w)
+    {
+      Awaiter *self = static_cast<Awaiter*>(w);
+      self->executor.submit(self);
+    }
+
+    bool await_ready() { return state->waiter.load() == detail::JoinState::done(); }
+    bool await_suspend(std::coroutine_handle<> h)
+    {
+      handle = h;
+      return state->wait(this);
+    }
+    void await_resume() {}
+  };
+
+  struct Blocker : detail::JoinWaiter {
+    lithe_sem_t sem;
+
+    Blocker() { lithe_sem_init(&sem, 0); wake = &Blocker::wake_context; }
+
+    static void wake_context(detail::JoinWaiter *w)
+    {
+      lithe_sem_post(&static_cast<Blocker*>(w)->sem);
+    }
+  };
+
+public:
+  JoinHandle(detail::JoinState *state, Executor &executor)
+    : state(state), executor(&executor) {}
+  JoinHandle(JoinHandle &&other) noexcept
+    : state(std::exchange(other.state, nullptr)), executor(other.executor) {}
+  ~JoinHandle() { if (state) state->release(); }
+
+  JoinHandle(const JoinHandle&) = delete;
+  JoinHandle &operator=(const JoinHandle&) = delete;
+
+  /* co_await handle: resumes the awaiting task on the spawning executor */
+  Awaiter operator co_await() { return Awaiter(state, *executor); }
+
+  /* Block the calling (stackful) lithe context until the task finishes */
+  void join()
+  {
+    Blocker blocker;
+    if (state->wait(&blocker))
+      lithe_sem_wait(&blocker.sem);
+  }
+
+private:
+  detail::JoinState *state;
+  Executor *executor;
+};
+
+/* Start running 't' on 'executor'. */
+inline JoinHandle spawn(Executor &executor, task<void> t)
+{
+  detail::JoinState *state = new detail::JoinState();
+  detail::run_spawned(executor, std::move(t), state);
+  return JoinHandle(state, executor);
+}
+
+}
+
+#endif // __cpp_impl_coroutine
+
+#endif // LITHE_TASK_HH
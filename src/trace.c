@@ -0,0 +1,167 @@
+/**
+ * Implementation of lithe's event tracer.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <parlib/parlib.h>
+#include "hart.h"
+#include "trace.h"
+#include "internal/assert.h"
+#include "internal/trace.h"
+
+#ifdef LITHE_TRACE
+
+#define DEFAULT_BUFFER_EVENTS 65536
+
+volatile bool __lithe_trace_enabled = false;
+struct lithe_trace_buffer *__lithe_trace_buffers = NULL;
+uint64_t __lithe_trace_mask = 0;
+
+/* Where to write the trace on exit, if tracing was started by LITHE_TRACE */
+static const char *exit_dump_path = NULL;
+
+static void dump_on_exit()
+{
+  lithe_trace_stop();
+  int ret = lithe_trace_dump(exit_dump_path);
+  if (ret)
+    fprintf(stderr, "lithe: unable to write trace to %s: %s\n",
+            exit_dump_path, strerror(ret));
+}
+
+void __lithe_trace_init()
+{
+  exit_dump_path = getenv("LITHE_TRACE");
+  if (exit_dump_path == NULL || exit_dump_path[0] == '\0')
+    return;
+
+  if (lithe_trace_start() == 0)
+    atexit(dump_on_exit);
+}
+
+static int alloc_buffers()
+{
+  uint64_t capacity = DEFAULT_BUFFER_EVENTS;
+  const char *s = getenv("LITHE_TRACE_BUFFER");
+  if (s != NULL && atol(s) > 0)
+    capacity = atol(s);
+
+  /* Round up to a power of 2, so the ring index is just a mask */
+  uint64_t size = 1;
+  while (size < capacity)
+    size *= 2;
+
+  struct lithe_trace_buffer *buffers = parlib_aligned_alloc(ARCH_CL_SIZE,
+    sizeof(struct lithe_trace_buffer) * max_harts());
+  if (buffers == NULL)
+    return ENOMEM;
+  for (int i = 0; i < max_harts(); i++) {
+    buffers[i].next = 0;
+    buffers[i].events = malloc(sizeof(struct lithe_trace_event) * size);
+    if (buffers[i].events == NULL) {
+      while (--i >= 0)
+        free(buffers[i].events);
+      free(buffers);
+      return ENOMEM;
+    }
+  }
+
+  __lithe_trace_mask = size - 1;
+  __lithe_trace_buffers = buffers;
+  return 0;
+}
+
+int lithe_trace_start()
+{
+  if (__lithe_trace_buffers == NULL) {
+    int ret = alloc_buffers();
+    if (ret)
+      return ret;
+  }
+  else {
+    for (int i = 0; i < max_harts(); i++)
+      __lithe_trace_buffers[i].next = 0;
+  }
+  wmb();
+  __lithe_trace_enabled = true;
+  return 0;
+}
+
+void lithe_trace_stop()
+{
+  __lithe_trace_enabled = false;
+  mb();
+}
+
+int lithe_trace_dump(const char *path)
+{
+  if (path == NULL)
+    return EINVAL;
+  if (__lithe_trace_buffers == NULL)
+    return ENODATA;
+
+  FILE *f = fopen(path, "wb");
+  if (f == NULL)
+    return errno;
+
+  struct lithe_trace_header header;
+  memcpy(header.magic, LITHE_TRACE_MAGIC, sizeof(header.magic));
+  header.version = LITHE_TRACE_VERSION;
+  header.nharts = max_harts();
+  fwrite(&header, sizeof(header), 1, f);
+
+  uint64_t size = __lithe_trace_mask + 1;
+  for (int i = 0; i < max_harts(); i++) {
+    struct lithe_trace_buffer *b = &__lithe_trace_buffers[i];
+    uint64_t next = b->next;
+    uint64_t n = next < size ? next : size;
+    uint64_t lost = next - n;
+
+    struct lithe_trace_hart hart;
+    hart.hart = i;
+    hart.lost = lost > UINT32_MAX ? UINT32_MAX : lost;
+    hart.nevents = n;
+    fwrite(&hart, sizeof(hart), 1, f);
+
+    /* Oldest first, which may mean wrapping around the end of the ring */
+    uint64_t first = (next - n) & __lithe_trace_mask;
+    uint64_t tail = n < size - first ? n : size - first;
+    fwrite(&b->events[first], sizeof(struct lithe_trace_event), tail, f);
+    fwrite(&b->events[0], sizeof(struct lithe_trace_event), n - tail, f);
+  }
+
+  int ret = ferror(f) ? EIO : 0;
+  if (fclose(f) != 0 && ret == 0)
+    ret = errno;
+  return ret;
+}
+
+#else
+
+void __lithe_trace_init()
+{
+  const char *path = getenv("LITHE_TRACE");
+  if (path != NULL && path[0] != '\0')
+    fprintf(stderr, "lithe: LITHE_TRACE is set, but lithe was built without "
+                    "tracing (configure with --enable-trace)\n");
+}
+
+int lithe_trace_start()
+{
+  return ENOTSUP;
+}
+
+void lithe_trace_stop()
+{
+}
+
+int lithe_trace_dump(const char *path)
+{
+  return ENOTSUP;
+}
+
+#endif // LITHE_TRACE
@@ -0,0 +1,94 @@
+/**
+ * Interface of lithe's event tracer.
+ *
+ * When lithe is configured with --enable-trace, the runtime records scheduling
+ * events into a ring buffer per hart while tracing is started, either by
+ * setting LITHE_TRACE=<file> in the environment (the trace is then written to
+ * <file> when the program exits) or by calling lithe_trace_start(). Each hart
+ * only writes to its own buffer, so recording an event costs a timestamp and a
+ * few stores. Without --enable-trace, the tracepoints compile away entirely.
+ *
+ * Dumps are converted to the Chrome trace event format (which Perfetto also
+ * loads) by the lithe-trace tool.
+ *
+ * Independently of --enable-trace, every tracepoint is also a USDT probe named
+ * lithe:<EVENT> whenever <sys/sdt.h> is found at configure time.
+ */
+
+#ifndef LITHE_TRACE_H
+#define LITHE_TRACE_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Every traced event, with what its two arguments hold. Schedulers are
+ * identified by their address and contexts by their id. */
+#define LITHE_TRACE_EVENTS(X)                                              \
+  X(HART_ENTER,      "sched",   "unused")  /* hart enters sched */          \
+  X(HART_GRANT,      "sched",   "unused")  /* hart granted to sched */      \
+  X(HART_YIELD,      "sched",   "parent")  /* hart yielded to parent */     \
+  X(HART_REQUEST,    "sched",   "harts")   /* sched asked for more harts */ \
+  X(SCHED_ENTER,     "sched",   "parent")                                   \
+  X(SCHED_EXIT,      "sched",   "parent")                                   \
+  X(CONTEXT_RUN,     "context", "sched")                                    \
+  X(CONTEXT_BLOCK,   "context", "sched")                                    \
+  X(CONTEXT_UNBLOCK, "context", "sched")                                    \
+  X(CONTEXT_YIELD,   "context", "sched")                                    \
+  X(CONTEXT_EXIT,    "context", "sched")                                    \
+  X(STEAL,           "victim",  "count")   /* fork-join steal from hart */  \
+  X(VCORE_REQUEST,   "vcores",  "unused")  /* vcores asked of the system */ \
+  X(VCORE_YIELD,     "unused",  "unused")  /* hart handed to the system */
+
+enum lithe_trace_event_type {
+#define __LITHE_TRACE_ENUM(name, arg0, arg1) LITHE_TRACE_##name,
+  LITHE_TRACE_EVENTS(__LITHE_TRACE_ENUM)
+#undef __LITHE_TRACE_ENUM
+  LITHE_TRACE_NUM_EVENTS
+};
+
+/* A single event, as recorded and as written to a dump */
+struct lithe_trace_event {
+  uint64_t time;      /* CLOCK_MONOTONIC, in nanoseconds */
+  uint32_t type;
+  uint32_t hart;
+  uint64_t arg0;
+  uint64_t arg1;
+};
+
+/* A dump starts with this header, followed by one lithe_trace_hart header per
+ * hart, each followed by that hart's events from oldest to newest. */
+#define LITHE_TRACE_MAGIC "LITHETRC"
+#define LITHE_TRACE_VERSION 1
+
+struct lithe_trace_header {
+  char magic[8];
+  uint32_t version;
+  uint32_t nharts;
+};
+
+struct lithe_trace_hart {
+  uint32_t hart;
+  uint32_t lost;      /* events overwritten before the dump, capped */
+  uint64_t nevents;
+};
+
+/* Start recording events, allocating the ring buffers on first use. Each
+ * holds the last LITHE_TRACE_BUFFER (from the environment, default 65536)
+ * events of its hart. Returns ENOTSUP if lithe was built without tracing. */
+int lithe_trace_start();
+
+/* Stop recording events. Buffers keep their contents until the next start. */
+void lithe_trace_stop();
+
+/* Write the events recorded so far to 'path'. Tracing should be stopped
+ * first. Returns 0 on success or an errno value on failure. */
+int lithe_trace_dump(const char *path);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // LITHE_TRACE_H
@@ -0,0 +1,143 @@
+/**
+ * Implementation of lithe wait groups.
+ */
+
+#include <errno.h>
+#include "internal/assert.h"
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include <parlib/parlib.h>
+#include "waitgroup.h"
+
+/* Maximum number of waiters woken with a single call to
+ * lithe_context_unblock_many() */
+#define WAITGROUP_UNBLOCK_BATCH 64
+
+/* Layout of the waitgroup's state word: the count lives in the low 32 bits,
+ * one bit records that a context is parked on the queue, and the remaining
+ * bits count the releases that may still touch the waitgroup. */
+#define WG_COUNT_MASK 0xffffffffULL
+#define WG_WAITERS    (1ULL << 32)
+#define WG_RELEASING  (1ULL << 33)
+
+static inline int wg_count(uint64_t state)
+{
+  return (int)(uint32_t)(state & WG_COUNT_MASK);
+}
+
+int lithe_waitgroup_init(lithe_waitgroup_t *wg)
+{
+  if(wg == NULL)
+    return EINVAL;
+
+  wg->state = 0;
+  mcs_pdr_init(&wg->lock);
+  wg->qnode = NULL;
+  TAILQ_INIT(&wg->queue);
+  return 0;
+}
+
+static void block(lithe_context_t *context, void *arg)
+{
+  lithe_waitgroup_t *wg = (lithe_waitgroup_t *) arg;
+  assert(wg);
+  TAILQ_INSERT_TAIL(&wg->queue, context, link);
+  mcs_pdr_unlock(&wg->lock, wg->qnode);
+}
+
+/* Release every context waiting on the waitgroup in as few batches as
+ * possible. The caller has registered this release in the state word, and
+ * dropping that registration is the last time the waitgroup is touched:
+ * from then on waiters may return and destroy it. */
+static void release(lithe_waitgroup_t *wg)
+{
+  struct lithe_context_queue queue = TAILQ_HEAD_INITIALIZER(queue);
+  mcs_lock_qnode_t qnode = {0};
+  mcs_pdr_lock(&wg->lock, &qnode);
+  TAILQ_CONCAT(&queue, &wg->queue, link);
+  mcs_pdr_unlock(&wg->lock, &qnode);
+  __sync_fetch_and_sub(&wg->state, WG_RELEASING);
+
+  lithe_context_t *batch[WAITGROUP_UNBLOCK_BATCH];
+  int nbatch = 0;
+  lithe_context_t *context, *next;
+  for (context = TAILQ_FIRST(&queue); context != NULL; context = next) {
+    /* The link is free for reuse once the context has been unblocked */
+    next = TAILQ_NEXT(context, link);
+    batch[nbatch++] = context;
+    if (nbatch == WAITGROUP_UNBLOCK_BATCH) {
+      lithe_context_unblock_many(batch, nbatch);
+      nbatch = 0;
+    }
+  }
+  lithe_context_unblock_many(batch, nbatch);
+}
+
+int lithe_waitgroup_add(lithe_waitgroup_t *wg, int delta)
+{
+  if(wg == NULL)
+    return EINVAL;
+
+  /* Only take the lock if bringing the count to zero finds someone parked,
+   * handing the waiters flag over to a registered release in the same step */
+  uint64_t state, new_state, seen = wg->state;
+  int count;
+  do {
+    state = seen;
+    count = wg_count(state) + delta;
+    if (count < 0)
+      return EINVAL;
+    new_state = (state & ~WG_COUNT_MASK) | (uint32_t)count;
+    if (count == 0 && (state & WG_WAITERS))
+      new_state = (new_state & ~WG_WAITERS) + WG_RELEASING;
+    seen = __sync_val_compare_and_swap(&wg->state, state, new_state);
+  } while (seen != state);
+
+  if (count == 0 && (state & WG_WAITERS))
+    release(wg);
+  return 0;
+}
+
+int lithe_waitgroup_done(lithe_waitgroup_t *wg)
+{
+  return lithe_waitgroup_add(wg, -1);
+}
+
+int lithe_waitgroup_wait(lithe_waitgroup_t *wg)
+{
+  if(wg == NULL)
+    return EINVAL;
+
+  mcs_lock_qnode_t qnode = {0};
+  for (;;) {
+    /* With the count at zero, only return once no release can touch the
+     * waitgroup anymore. Releases never block, so just spin them out. */
+    uint64_t state = wg->state;
+    if (wg_count(state) == 0) {
+      if (state == 0)
+        return 0;
+      cpu_relax();
+      continue;
+    }
+
+    /* Flag ourselves as parked while the count is still up, so whoever
+     * brings it down to zero knows to take the lock and release us */
+    mcs_pdr_lock(&wg->lock, &qnode);
+    uint64_t seen = wg->state;
+    do {
+      state = seen;
+      if (wg_count(state) == 0)
+        break;
+      seen = __sync_val_compare_and_swap(&wg->state, state,
+                                         state | WG_WAITERS);
+    } while (seen != state);
+    if (wg_count(state) == 0) {
+      mcs_pdr_unlock(&wg->lock, &qnode);
+      continue;
+    }
+    wg->qnode = &qnode;
+    lithe_context_block(block, wg);
+    return 0;
+  }
+}
@@ -0,0 +1,52 @@
+/**
+ * Interface of lithe wait groups.
+ */
+
+#ifndef LITHE_WAITGROUP_H
+#define LITHE_WAITGROUP_H
+
+#include <stdint.h>
+#include <parlib/mcs.h>
+#include "lithe.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* A lithe waitgroup struct. The low 32 bits of 'state' hold the count, the
+ * upper bits record whether any context is parked and how many releases are
+ * still in progress. Adding to and completing work only ever touches 'state';
+ * the lock and the queue of waiting contexts are only used by waiters and by
+ * whoever brings the count down to zero while someone is parked. */
+typedef struct lithe_waitgroup {
+  volatile uint64_t state;
+  mcs_pdr_lock_t lock;
+  mcs_lock_qnode_t *qnode;
+  struct lithe_context_queue queue;
+} lithe_waitgroup_t;
+#define LITHE_WAITGROUP_INITIALIZER(wg) { \
+  .state = 0, \
+  .lock = MCS_PDRLOCK_INIT, \
+  .qnode = NULL, \
+  .queue = TAILQ_HEAD_INITIALIZER((wg).queue) \
+}
+
+/* Initialize a waitgroup with a count of zero. */
+int lithe_waitgroup_init(lithe_waitgroup_t *wg);
+
+/* Add 'delta' (which may be negative) to the waitgroup's count. Bringing the
+ * count down to zero releases all waiters at once. Returns EINVAL (leaving
+ * the count untouched) if the count would drop below zero. */
+int lithe_waitgroup_add(lithe_waitgroup_t *wg, int delta);
+
+/* Mark one unit of work as done. Equivalent to lithe_waitgroup_add(wg, -1) */
+int lithe_waitgroup_done(lithe_waitgroup_t *wg);
+
+/* Block the calling context until the waitgroup's count reaches zero. */
+int lithe_waitgroup_wait(lithe_waitgroup_t *wg);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // LITHE_WAITGROUP_H
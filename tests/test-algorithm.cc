@@ -0,0 +1,56 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+
+#include <parlib/parlib.h>
+#include <src/lithe.hh>
+#include <src/algorithm.hh>
+
+#define N 1000003
+
+int main()
+{
+  printf("main start\n");
+
+  std::vector<long> v(N), w(N), out(2 * N);
+  for (long i = 0; i < N; i++)
+    v[i] = rand() % 1000;
+
+  long sum = lithe::reduce(lithe::par, v.begin(), v.end(), 0L);
+  long expected = 0;
+  for (long i = 0; i < N; i++)
+    expected += v[i];
+  assert(sum == expected);
+
+  lithe::transform(lithe::par, v.begin(), v.end(), w.begin(),
+                   [](long x) { return 2 * x; });
+  assert(lithe::reduce(lithe::par, w.begin(), w.end(), 0L) == 2 * expected);
+
+  lithe::inclusive_scan(lithe::par, v.begin(), v.end(), w.begin());
+  assert(w[N - 1] == expected);
+  lithe::exclusive_scan(lithe::par, v.begin(), v.end(), w.begin(), 0L);
+  assert(w[0] == 0 && w[N - 1] == expected - v[N - 1]);
+
+  w = v;
+  lithe::sort(lithe::par, v.begin(), v.end());
+  lithe::sort(lithe::par, w.begin(), w.end(), std::greater<long>());
+  for (long i = 1; i < N; i++) {
+    assert(v[i - 1] <= v[i]);
+    assert(w[i - 1] >= w[i]);
+  }
+
+  std::reverse(w.begin(), w.end());
+  lithe::merge(lithe::par, v.begin(), v.end(), w.begin(), w.end(), out.begin());
+  for (long i = 1; i < 2 * N; i++)
+    assert(out[i - 1] <= out[i]);
+
+  long count = 0;
+  lithe::for_each(lithe::par, out.begin(), out.end(),
+                  [&](long x) { __sync_fetch_and_add(&count, 1); });
+  assert(count == 2 * N);
+
+  printf("sum %ld\n", sum);
+  printf("main finish\n");
+  return 0;
+}
@@ -0,0 +1,57 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <parlib/parlib.h>
+#include <src/lithe.h>
+#include <src/fork_join_sched.h>
+#include <src/barrier.h>
+
+#define NUM_ITERATIONS 1000
+
+static int num_contexts;
+static int *arrivals;
+static lithe_barrier_t barrier;
+static lithe_tree_barrier_t tree_barrier;
+
+static void work(void *arg)
+{
+  int id = (int)(long)arg;
+  for (int i = 0; i < NUM_ITERATIONS; i++) {
+    __sync_fetch_and_add(&arrivals[i], 1);
+
+    /* Alternate between the flat and the tree barrier */
+    if (i % 2)
+      lithe_tree_barrier_wait(&tree_barrier, id);
+    else
+      lithe_barrier_wait(&barrier);
+
+    /* Nobody gets past the barrier before everyone has arrived */
+    assert(arrivals[i] == num_contexts);
+  }
+}
+
+int main()
+{
+  printf("main start\n");
+
+  /* Use more contexts than harts, so some waiters have to block */
+  num_contexts = 2 * max_harts();
+  arrivals = calloc(NUM_ITERATIONS, sizeof(int));
+  lithe_barrier_init(&barrier, num_contexts);
+  lithe_tree_barrier_init(&tree_barrier, num_contexts);
+
+  lithe_fork_join_sched_t *sched = lithe_fork_join_sched_create();
+  lithe_sched_enter((lithe_sched_t*)sched);
+  for (long i = 0; i < num_contexts; i++)
+    lithe_fork_join_context_create(sched, 262144, work, (void*)i);
+  lithe_fork_join_sched_join_all(sched);
+  lithe_sched_exit();
+  lithe_fork_join_sched_destroy(sched);
+
+  lithe_tree_barrier_destroy(&tree_barrier);
+  lithe_barrier_destroy(&barrier);
+  free(arrivals);
+  printf("main finish\n");
+  return 0;
+}
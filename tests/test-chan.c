@@ -0,0 +1,77 @@
+#include <assert.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <parlib/parlib.h>
+#include <src/lithe.h>
+#include <src/fork_join_sched.h>
+#include <src/chan.h>
+
+#define CHAN_CAPACITY 4
+#define NUM_MESSAGES 10000
+
+static lithe_chan_t chan;
+static int num_producers;
+static int num_consumers;
+static int producers_left;
+static long received_count;
+static long received_sum;
+
+static void producer(void *arg)
+{
+  for (long i = 1; i <= NUM_MESSAGES; i++) {
+    int ret = lithe_chan_send(&chan, (void*)i);
+    assert(ret == 0);
+  }
+
+  /* The last producer to finish closes the channel */
+  if (__sync_add_and_fetch(&producers_left, -1) == 0)
+    lithe_chan_close(&chan);
+}
+
+static void consumer(void *arg)
+{
+  long count = 0, sum = 0;
+  void *msg;
+  int ret;
+  while ((ret = lithe_chan_recv(&chan, &msg)) == 0) {
+    count++;
+    sum += (long)msg;
+  }
+  assert(ret == EPIPE);
+  __sync_fetch_and_add(&received_count, count);
+  __sync_fetch_and_add(&received_sum, sum);
+}
+
+int main()
+{
+  printf("main start\n");
+
+  /* Use a tiny channel and more contexts than harts, so both senders and
+   * receivers have to park */
+  num_producers = max_harts();
+  num_consumers = max_harts();
+  producers_left = num_producers;
+  lithe_chan_init(&chan, CHAN_CAPACITY);
+
+  lithe_fork_join_sched_t *sched = lithe_fork_join_sched_create();
+  lithe_sched_enter((lithe_sched_t*)sched);
+  for (int i = 0; i < num_consumers; i++)
+    lithe_fork_join_context_create(sched, 262144, consumer, NULL);
+  for (int i = 0; i < num_producers; i++)
+    lithe_fork_join_context_create(sched, 262144, producer, NULL);
+  lithe_fork_join_sched_join_all(sched);
+  lithe_sched_exit();
+  lithe_fork_join_sched_destroy(sched);
+
+  /* Every message was received exactly once */
+  long expected_sum = (long)NUM_MESSAGES * (NUM_MESSAGES + 1) / 2;
+  assert(received_count == (long)num_producers * NUM_MESSAGES);
+  assert(received_sum == expected_sum * num_producers);
+  printf("received %ld messages\n", received_count);
+
+  lithe_chan_destroy(&chan);
+  printf("main finish\n");
+  return 0;
+}
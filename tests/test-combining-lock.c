@@ -0,0 +1,51 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <parlib/parlib.h>
+#include <src/lithe.h>
+#include <src/fork_join_sched.h>
+#include <src/combining_lock.h>
+
+#define NUM_INCREMENTS 10000
+
+static int num_contexts;
+static lithe_combining_lock_t lock;
+static long counter;
+
+static void increment(void *arg)
+{
+  /* Deliberately non-atomic: the lock is what keeps this safe */
+  long *c = (long*)arg;
+  *c = *c + 1;
+}
+
+static void work(void *arg)
+{
+  for (int i = 0; i < NUM_INCREMENTS; i++)
+    lithe_combining_lock_apply(&lock, increment, &counter);
+}
+
+int main()
+{
+  printf("main start\n");
+
+  /* Use more contexts than harts, so some of them have to park */
+  num_contexts = 2 * max_harts();
+  lithe_combining_lock_init(&lock);
+
+  lithe_fork_join_sched_t *sched = lithe_fork_join_sched_create();
+  lithe_sched_enter((lithe_sched_t*)sched);
+  for (int i = 0; i < num_contexts; i++)
+    lithe_fork_join_context_create(sched, 262144, work, NULL);
+  lithe_fork_join_sched_join_all(sched);
+  lithe_sched_exit();
+  lithe_fork_join_sched_destroy(sched);
+
+  printf("counter = %ld\n", counter);
+  assert(counter == (long)num_contexts * NUM_INCREMENTS);
+
+  lithe_combining_lock_destroy(&lock);
+  printf("main finish\n");
+  return 0;
+}
@@ -0,0 +1,87 @@
+#include <assert.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <parlib/parlib.h>
+#include <src/lithe.h>
+#include <src/mutex.h>
+#include <src/condvar.h>
+#include <src/fork_join_sched.h>
+
+/* Well over the 64 contexts lithe unblocks in a single batch, so a broadcast
+ * moves several batches' worth of waiters onto the mutex queue at once */
+#define WAITERS (4 * 64 + 37)
+
+static lithe_mutex_t mutex;
+static lithe_condvar_t condvar;
+static int generation;
+static int waiting;
+static int passed[WAITERS];
+
+static void waiter(void *arg)
+{
+  long i = (long)arg;
+  lithe_mutex_lock(&mutex);
+  int my_generation = generation;
+  waiting++;
+  while (generation == my_generation)
+    lithe_condvar_wait(&condvar, &mutex);
+  /* Everybody gets through with the mutex held */
+  assert(mutex.owner == lithe_context_self());
+  passed[i]++;
+  waiting--;
+  lithe_mutex_unlock(&mutex);
+}
+
+/* Broadcast to a full house of waiters, either with the mutex held (so all
+ * of them are requeued behind us) or with it free (so one of them is woken
+ * straight away), and check that each of them gets through exactly once */
+static void broadcast_round(lithe_fork_join_sched_t *sched, bool held)
+{
+  for (long i = 0; i < WAITERS; i++) {
+    passed[i] = 0;
+    lithe_fork_join_context_create(sched, 65536, waiter, (void*)i);
+  }
+
+  /* Waiters are queued on the condvar before they let go of the mutex, so
+   * once we hold it and count them all, they are all waiting */
+  lithe_mutex_lock(&mutex);
+  while (waiting < WAITERS) {
+    lithe_mutex_unlock(&mutex);
+    lithe_context_yield();
+    lithe_mutex_lock(&mutex);
+  }
+  generation++;
+  if (held) {
+    lithe_condvar_broadcast(&condvar);
+    lithe_mutex_unlock(&mutex);
+  } else {
+    lithe_mutex_unlock(&mutex);
+    lithe_condvar_broadcast(&condvar);
+  }
+
+  lithe_fork_join_sched_join_all(sched);
+  assert(waiting == 0);
+  for (int i = 0; i < WAITERS; i++)
+    assert(passed[i] == 1);
+  printf("broadcast with the mutex %s released %d waiters\n",
+         held ? "held" : "free", WAITERS);
+}
+
+int main()
+{
+  printf("main start\n");
+  lithe_mutex_init(&mutex, NULL);
+  lithe_condvar_init(&condvar);
+
+  lithe_fork_join_sched_t *sched = lithe_fork_join_sched_create();
+  lithe_sched_enter((lithe_sched_t*)sched);
+  broadcast_round(sched, true);
+  broadcast_round(sched, false);
+  lithe_sched_exit();
+  lithe_fork_join_sched_destroy(sched);
+
+  printf("main finish\n");
+  return 0;
+}
@@ -0,0 +1,144 @@
+#include <assert.h>
+#include <stdio.h>
+
+#include <parlib/parlib.h>
+#include <src/lithe.hh>
+#include <src/context.hh>
+
+using namespace lithe;
+
+#define STACK_SIZE 65536
+#define OTHER_STACK_SIZE 32768
+#define MAX_SIZE 5
+
+static int constructed;
+static int live;
+
+class CountedContext : public Context {
+public:
+  static const int MAGIC = 0x5eed;
+  int magic;
+  int reinits;
+
+  CountedContext(size_t stack_size, void (*start_routine)(void*), void *arg)
+    : Context(stack_size, start_routine, arg), magic(MAGIC), reinits(0)
+  {
+    constructed++;
+    live++;
+  }
+
+  ~CountedContext()
+  {
+    magic = 0;
+    live--;
+  }
+
+  void reinit(size_t stack_size, void (*start_routine)(void*), void *arg)
+  {
+    Context::reinit(stack_size, start_routine, arg);
+    reinits++;
+  }
+};
+
+static void start(void *arg)
+{
+}
+
+/* More contexts than fit in every hart's free list (16 each), so some have to
+ * go through the shared depot */
+static int many()
+{
+  return 4 * 16 * max_harts() + 1;
+}
+
+static void test_reuse()
+{
+  ContextFactory<CountedContext> factory;
+
+  /* A fresh context comes straight from the constructor */
+  CountedContext *c = factory.create(STACK_SIZE, start, NULL);
+  assert(c->magic == CountedContext::MAGIC && c->reinits == 0);
+  assert(constructed == 1 && live == 1);
+  void *stack = c->stack.bottom;
+  factory.destroy(c);
+
+  /* Asking for the same stack size gets the same context and stack back */
+  CountedContext *d = factory.create(STACK_SIZE, start, NULL);
+  assert(d == c && d->stack.bottom == stack && d->stack.size == STACK_SIZE);
+  assert(d->magic == CountedContext::MAGIC && d->reinits == 1);
+  assert(constructed == 1);
+  factory.destroy(d);
+
+  /* A different size still recycles the context, with a new stack */
+  d = factory.create(OTHER_STACK_SIZE, start, NULL);
+  assert(d == c && d->stack.size == OTHER_STACK_SIZE);
+  assert(constructed == 1);
+  factory.destroy(d);
+}
+
+static void test_unbounded()
+{
+  int n = many();
+  CountedContext **contexts = new CountedContext*[n];
+  ContextFactory<CountedContext> *factory = new ContextFactory<CountedContext>();
+
+  constructed = 0;
+  for (int i = 0; i < n; i++)
+    contexts[i] = factory->create(STACK_SIZE, start, NULL);
+  assert(constructed == n && live == n);
+  for (int i = 0; i < n; i++)
+    factory->destroy(contexts[i]);
+
+  /* Nothing was deleted, so all of them come back without constructing any
+   * new ones */
+  assert(live == n);
+  for (int i = 0; i < n; i++) {
+    contexts[i] = factory->create(STACK_SIZE, start, NULL);
+    assert(contexts[i]->magic == CountedContext::MAGIC);
+  }
+  assert(constructed == n);
+  for (int i = 0; i < n; i++)
+    factory->destroy(contexts[i]);
+
+  delete factory;
+  assert(live == 0);
+  delete[] contexts;
+}
+
+static void test_bounded()
+{
+  int n = many();
+  CountedContext **contexts = new CountedContext*[n];
+  ContextFactory<CountedContext> *factory =
+    new ContextFactory<CountedContext>(MAX_SIZE);
+
+  for (int round = 0; round < 2; round++) {
+    for (int i = 0; i < n; i++) {
+      contexts[i] = factory->create(STACK_SIZE, start, NULL);
+      assert(contexts[i]->magic == CountedContext::MAGIC);
+    }
+    assert(live == n);
+
+    /* Everything beyond MAX_SIZE gets deleted as it is destroyed */
+    for (int i = 0; i < n; i++) {
+      factory->destroy(contexts[i]);
+      assert(live - (n - i - 1) <= MAX_SIZE);
+    }
+    assert(live <= MAX_SIZE);
+  }
+
+  delete factory;
+  assert(live == 0);
+  delete[] contexts;
+}
+
+int main()
+{
+  printf("main start\n");
+  test_reuse();
+  test_unbounded();
+  test_bounded();
+  printf("%d contexts recycled through the factory\n", many());
+  printf("main finish\n");
+  return 0;
+}
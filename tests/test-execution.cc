@@ -0,0 +1,65 @@
+#include <assert.h>
+#include <stdio.h>
+
+#include <parlib/parlib.h>
+#include <src/lithe.hh>
+#include <src/fork_join_sched.h>
+#include <src/executor.hh>
+#include <src/execution.hh>
+
+#if __cplusplus >= 201703L
+
+using namespace lithe;
+
+#define N 100000
+
+static int data[N];
+
+int main()
+{
+  printf("main start\n");
+  lithe_fork_join_sched_t *sched = lithe_fork_join_sched_create();
+  lithe_sched_enter((lithe_sched_t*)sched);
+  {
+    Executor ex(sched);
+    execution::scheduler s(ex);
+
+    /* schedule | bulk | then */
+    auto squares = execution::then(
+      execution::bulk(s.schedule(), N, [](int i) { data[i] = i; }),
+      []() {
+        long sum = 0;
+        for (int i = 0; i < N; i++)
+          sum += data[i];
+        return sum;
+      });
+    auto sum = execution::sync_wait(std::move(squares));
+    assert(sum && *sum == (long)N * (N - 1) / 2);
+
+    /* when_all of value and void senders */
+    auto both = execution::when_all(
+      execution::then(s.schedule(), []() { return 21; }),
+      s.schedule(),
+      execution::then(s.schedule(), []() { return 2; }));
+    auto result = execution::sync_wait(std::move(both));
+    assert(result);
+    assert(std::get<0>(*result) * std::get<1>(*result) == 42);
+    printf("sum %ld, product %d\n", *sum,
+           std::get<0>(*result) * std::get<1>(*result));
+  }
+  lithe_fork_join_sched_join_all(sched);
+  lithe_sched_exit();
+  lithe_fork_join_sched_destroy(sched);
+  printf("main finish\n");
+  return 0;
+}
+
+#else
+
+int main()
+{
+  printf("C++17 not supported by this compiler, skipping\n");
+  return 0;
+}
+
+#endif
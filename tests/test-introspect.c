@@ -0,0 +1,117 @@
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <parlib/parlib.h>
+#include <src/lithe.h>
+#include <src/fork_join_sched.h>
+#include <src/introspect.h>
+
+#define MAX_SCHEDS 8
+
+static lithe_fork_join_sched_t *outer, *inner;
+static lithe_sched_info_t seen[MAX_SCHEDS];
+static int num_seen;
+static char dumped[4096];
+
+static void collect(const lithe_sched_info_t *info, void *arg)
+{
+  assert(num_seen < MAX_SCHEDS);
+  seen[num_seen++] = *info;
+}
+
+static int count_lines(int fd)
+{
+  lseek(fd, 0, SEEK_SET);
+  ssize_t n = read(fd, dumped, sizeof(dumped) - 1);
+  assert(n > 0);
+  dumped[n] = '\0';
+  printf("%s", dumped);
+
+  int lines = 0;
+  for (ssize_t i = 0; i < n; i++)
+    lines += dumped[i] == '\n';
+  return lines;
+}
+
+static void check(void *arg)
+{
+  /* The base scheduler, then outer, then inner, each a child of the last */
+  num_seen = 0;
+  int n = lithe_sched_walk(collect, NULL);
+  assert(n == 3 && num_seen == 3);
+  assert(seen[0].parent == NULL && seen[0].depth == 0);
+  assert(seen[1].sched == (lithe_sched_t*)outer);
+  assert(seen[1].parent == seen[0].sched && seen[1].depth == 1);
+  assert(seen[2].sched == (lithe_sched_t*)inner);
+  assert(seen[2].parent == seen[1].sched && seen[2].depth == 2);
+  assert(seen[0].runnable_contexts == -1);
+  assert(seen[2].runnable_contexts >= 0);
+  assert(seen[2].harts >= 1);
+
+  /* The outer scheduler's main context is blocked in join_all() */
+  assert(seen[1].blocked_contexts >= 1);
+
+  char path[] = "/tmp/test-introspect-XXXXXX";
+  int fd = mkstemp(path);
+  assert(fd >= 0);
+  int ret = lithe_sched_dump(fd);
+  assert(ret == 0);
+  assert(count_lines(fd) == 4);
+  close(fd);
+
+  /* The dump is formatted by hand, but reads as if printed with stdio */
+  char expected[128];
+  assert(strstr(dumped, "lithe schedulers (") == dumped);
+  snprintf(expected, sizeof(expected), " of %zu harts online):\n",
+           max_harts());
+  assert(strstr(dumped, expected) != NULL);
+  snprintf(expected, sizeof(expected), "\n    %p: harts=", (void*)inner);
+  assert(strstr(dumped, expected) != NULL);
+  assert(strstr(dumped, " runnable=? blocked=") != NULL);
+
+  /* A signal appends another dump, preceded by a timestamp */
+  ret = lithe_sched_dump_on_signal(SIGUSR2, path);
+  assert(ret == 0);
+  raise(SIGUSR2);
+  fd = open(path, O_RDONLY);
+  assert(fd >= 0);
+  assert(count_lines(fd) == 9);
+  close(fd);
+  unlink(path);
+}
+
+static void inner_main(void *arg)
+{
+  inner = lithe_fork_join_sched_create();
+  lithe_sched_enter((lithe_sched_t*)inner);
+  lithe_fork_join_context_create(inner, 262144, check, NULL);
+  lithe_fork_join_sched_join_all(inner);
+  lithe_sched_exit();
+  lithe_fork_join_sched_destroy(inner);
+}
+
+int main()
+{
+  printf("main start\n");
+
+  outer = lithe_fork_join_sched_create();
+  lithe_sched_enter((lithe_sched_t*)outer);
+  lithe_fork_join_context_create(outer, 262144, inner_main, NULL);
+  lithe_fork_join_sched_join_all(outer);
+  lithe_sched_exit();
+  lithe_fork_join_sched_destroy(outer);
+
+  /* Only the base scheduler is left */
+  num_seen = 0;
+  assert(lithe_sched_walk(collect, NULL) == 1);
+  assert(lithe_sched_dump_on_signal(SIGUSR2, NULL) == EINVAL);
+
+  printf("main finish\n");
+  return 0;
+}
@@ -0,0 +1,66 @@
+#include <assert.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <parlib/parlib.h>
+#include <src/lithe.h>
+#include <src/fork_join_sched.h>
+#include <src/notifier.h>
+
+#define NUM_ROUNDS 100
+
+static int num_contexts;
+static lithe_notifier_t *notifiers;
+static lithe_notifier_t done_notifier = LITHE_NOTIFIER_INITIALIZER;
+static int rounds_done;
+
+static void work(void *arg)
+{
+  lithe_notifier_t *notifier = (lithe_notifier_t *) arg;
+  for (int i = 0; i < NUM_ROUNDS; i++)
+    lithe_notifier_wait(notifier);
+  if (__sync_add_and_fetch(&rounds_done, NUM_ROUNDS) == num_contexts * NUM_ROUNDS)
+    lithe_notifier_signal(&done_notifier);
+}
+
+/* A plain OS thread, which isn't allowed to touch any other lithe state */
+static void *signaler(void *arg)
+{
+  while (rounds_done < num_contexts * NUM_ROUNDS) {
+    for (int i = 0; i < num_contexts; i++)
+      lithe_notifier_signal(&notifiers[i]);
+    usleep(100);
+  }
+  return NULL;
+}
+
+int main()
+{
+  printf("main start\n");
+
+  num_contexts = 2 * max_harts();
+  notifiers = malloc(num_contexts * sizeof(lithe_notifier_t));
+  for (int i = 0; i < num_contexts; i++)
+    lithe_notifier_init(&notifiers[i]);
+
+  pthread_t thread;
+  pthread_create(&thread, NULL, signaler, NULL);
+
+  lithe_fork_join_sched_t *sched = lithe_fork_join_sched_create();
+  lithe_sched_enter((lithe_sched_t*)sched);
+  for (int i = 0; i < num_contexts; i++)
+    lithe_fork_join_context_create(sched, 262144, work, &notifiers[i]);
+  lithe_notifier_wait(&done_notifier);
+  lithe_fork_join_sched_join_all(sched);
+  lithe_sched_exit();
+  lithe_fork_join_sched_destroy(sched);
+
+  pthread_join(thread, NULL);
+  assert(rounds_done == num_contexts * NUM_ROUNDS);
+  printf("%d contexts woken %d times each\n", num_contexts, NUM_ROUNDS);
+  free(notifiers);
+  printf("main finish\n");
+  return 0;
+}
@@ -0,0 +1,88 @@
+#include <assert.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <parlib/parlib.h>
+#include <src/lithe.h>
+#include <src/fork_join_sched.h>
+#include <src/profile.h>
+
+#define BURN_NS 50000000
+
+static volatile uint64_t sink;
+
+static uint64_t cpu_now()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void burn(void *arg)
+{
+  /* Yield now and then, so harts pass through lithe and arm their timers */
+  for (int i = 0; i < 10; i++) {
+    uint64_t start = cpu_now();
+    while (cpu_now() - start < BURN_NS / 10)
+      sink++;
+    lithe_context_yield();
+  }
+}
+
+int main()
+{
+  printf("main start\n");
+
+  assert(lithe_profile_start(0) == EINVAL);
+  assert(lithe_profile_start(1000000001) == EINVAL);
+  int ret = lithe_profile_start(1000);
+  assert(ret == 0);
+  assert(lithe_profile_start(1000) == EALREADY);
+
+  lithe_fork_join_sched_t *sched = lithe_fork_join_sched_create();
+  lithe_sched_enter((lithe_sched_t*)sched);
+  for (int i = 0; i < max_harts(); i++)
+    lithe_fork_join_context_create(sched, 262144, burn, NULL);
+  lithe_fork_join_sched_join_all(sched);
+  lithe_sched_exit();
+
+  lithe_profile_stop();
+
+  char path[] = "/tmp/test-profile-XXXXXX";
+  int fd = mkstemp(path);
+  assert(fd >= 0);
+  close(fd);
+  ret = lithe_profile_dump(path);
+  assert(ret == 0);
+
+  /* Most samples were taken in the fork-join scheduler's contexts, under the
+   * base scheduler */
+  char prefix[64];
+  snprintf(prefix, sizeof(prefix), "lithe;sched@%p;sched@%p;",
+           (void*)lithe_sched_current(), (void*)sched);
+  FILE *f = fopen(path, "r");
+  assert(f);
+  char line[8192];
+  unsigned long total = 0, in_sched = 0;
+  while (fgets(line, sizeof(line), f)) {
+    char *count = strrchr(line, ' ');
+    assert(count);
+    total += strtoul(count + 1, NULL, 10);
+    if (strncmp(line, prefix, strlen(prefix)) == 0)
+      in_sched += strtoul(count + 1, NULL, 10);
+  }
+  fclose(f);
+  unlink(path);
+  printf("samples: %lu, in the fork-join scheduler: %lu\n", total, in_sched);
+  assert(in_sched > 0);
+  assert(in_sched <= total);
+
+  lithe_fork_join_sched_destroy(sched);
+
+  printf("main finish\n");
+  return 0;
+}
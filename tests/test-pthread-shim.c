@@ -0,0 +1,291 @@
+#define _GNU_SOURCE
+#include <assert.h>
+#include <errno.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <parlib/parlib.h>
+#include <src/lithe.h>
+#include <src/fork_join_sched.h>
+
+/* Built against libithe_pthread, so the pthread and semaphore calls below
+ * are routed to lithe whenever they are made from a fork-join context */
+
+#define ITEMS 256
+
+static int num_pairs;
+
+/* A single slot handed from producers to consumers, so both block often */
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t not_empty = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t not_full = PTHREAD_COND_INITIALIZER;
+static bool full;
+static long slot;
+static long consumed_sum;
+
+static sem_t done;
+static sem_t recursive_done;
+static pthread_mutex_t recursive;
+static pthread_mutex_t static_recursive = PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP;
+
+static void producer(void *arg)
+{
+  for (long i = 1; i <= ITEMS; i++) {
+    pthread_mutex_lock(&lock);
+    while (full)
+      pthread_cond_wait(&not_full, &lock);
+    slot = i;
+    full = true;
+    pthread_cond_signal(&not_empty);
+    pthread_mutex_unlock(&lock);
+  }
+}
+
+static void consumer(void *arg)
+{
+  for (int i = 0; i < ITEMS; i++) {
+    pthread_mutex_lock(&lock);
+    while (!full)
+      pthread_cond_wait(&not_empty, &lock);
+    consumed_sum += slot;
+    full = false;
+    pthread_cond_signal(&not_full);
+    pthread_mutex_unlock(&lock);
+  }
+  assert(sem_post(&done) == 0);
+}
+
+static void deadline(struct timespec *ts, long ms)
+{
+  clock_gettime(CLOCK_REALTIME, ts);
+  ts->tv_nsec += ms * 1000000;
+  ts->tv_sec += ts->tv_nsec / 1000000000;
+  ts->tv_nsec %= 1000000000;
+}
+
+static void test_timeouts()
+{
+  struct timespec ts;
+  pthread_mutex_t m;
+  pthread_cond_t c;
+  sem_t s;
+  pthread_mutex_init(&m, NULL);
+  pthread_cond_init(&c, NULL);
+  sem_init(&s, 0, 0);
+
+  pthread_mutex_lock(&m);
+  deadline(&ts, 10);
+  assert(pthread_cond_timedwait(&c, &m, &ts) == ETIMEDOUT);
+  /* The mutex is held again on return */
+  assert(pthread_mutex_trylock(&m) == EBUSY);
+  pthread_mutex_unlock(&m);
+
+  deadline(&ts, 10);
+  assert(sem_timedwait(&s, &ts) == -1 && errno == ETIMEDOUT);
+  sem_post(&s);
+  deadline(&ts, 10);
+  assert(sem_timedwait(&s, &ts) == 0);
+
+  sem_destroy(&s);
+  pthread_cond_destroy(&c);
+  pthread_mutex_destroy(&m);
+}
+
+/* Timed waiters far from their deadline, woken by the object being released */
+#define TIMED_WAITERS 8
+
+static pthread_mutex_t timed_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t timed_cond = PTHREAD_COND_INITIALIZER;
+static sem_t timed_sem;
+static int timed_waiting;
+static int timed_woken;
+static int timed_exited;
+
+static void timed_cond_waiter(void *arg)
+{
+  struct timespec ts;
+  deadline(&ts, 60000);
+  pthread_mutex_lock(&timed_lock);
+  timed_waiting++;
+  assert(pthread_cond_timedwait(&timed_cond, &timed_lock, &ts) == 0);
+  timed_woken++;
+  pthread_mutex_unlock(&timed_lock);
+  __sync_fetch_and_add(&timed_exited, 1);
+}
+
+static void timed_sem_waiter(void *arg)
+{
+  struct timespec ts;
+  deadline(&ts, 60000);
+  assert(sem_timedwait(&timed_sem, &ts) == 0);
+  __sync_fetch_and_add(&timed_exited, 1);
+}
+
+static void timed_mutex_waiter(void *arg)
+{
+  struct timespec ts;
+  deadline(&ts, 60000);
+  assert(pthread_mutex_timedlock(&timed_lock, &ts) == 0);
+  pthread_mutex_unlock(&timed_lock);
+  __sync_fetch_and_add(&timed_exited, 1);
+}
+
+static int timed_woken_now()
+{
+  pthread_mutex_lock(&timed_lock);
+  int woken = timed_woken;
+  pthread_mutex_unlock(&timed_lock);
+  return woken;
+}
+
+static void test_timed_wakeups(lithe_fork_join_sched_t *sched)
+{
+  /* Each signal lets exactly one timed waiter through */
+  for (int i = 0; i < TIMED_WAITERS; i++)
+    lithe_fork_join_context_create(sched, 262144, timed_cond_waiter, NULL);
+  for (int signaled = 1; signaled <= TIMED_WAITERS / 2; signaled++) {
+    /* Waiters queue up before they let go of the mutex, so once we hold it
+     * and count them all, they are all waiting */
+    pthread_mutex_lock(&timed_lock);
+    while (timed_waiting < TIMED_WAITERS) {
+      pthread_mutex_unlock(&timed_lock);
+      lithe_context_yield();
+      pthread_mutex_lock(&timed_lock);
+    }
+    pthread_cond_signal(&timed_cond);
+    pthread_mutex_unlock(&timed_lock);
+    while (timed_woken_now() < signaled)
+      lithe_context_yield();
+    for (int i = 0; i < 100; i++)
+      lithe_context_yield();
+    assert(timed_woken_now() == signaled);
+  }
+  pthread_cond_broadcast(&timed_cond);
+  while (timed_exited < TIMED_WAITERS)
+    lithe_context_yield();
+  assert(timed_woken == TIMED_WAITERS);
+
+  /* Posts and unlocks wake timed waiters long before their deadline */
+  timed_exited = 0;
+  sem_init(&timed_sem, 0, 0);
+  pthread_mutex_lock(&timed_lock);
+  for (int i = 0; i < TIMED_WAITERS; i++) {
+    lithe_fork_join_context_create(sched, 262144, timed_sem_waiter, NULL);
+    lithe_fork_join_context_create(sched, 262144, timed_mutex_waiter, NULL);
+  }
+  for (int i = 0; i < 100; i++)
+    lithe_context_yield();
+  pthread_mutex_unlock(&timed_lock);
+  for (int i = 0; i < TIMED_WAITERS; i++)
+    sem_post(&timed_sem);
+  while (timed_exited < 2 * TIMED_WAITERS)
+    lithe_context_yield();
+  sem_destroy(&timed_sem);
+}
+
+static void test_recursive(void *arg)
+{
+  /* Only recursive because of the attributes it was initialized with */
+  assert(pthread_mutex_lock(&recursive) == 0);
+  assert(pthread_mutex_lock(&recursive) == 0);
+  assert(pthread_mutex_unlock(&recursive) == 0);
+  assert(pthread_mutex_unlock(&recursive) == 0);
+  /* Only recursive because of its static initializer */
+  assert(pthread_mutex_lock(&static_recursive) == 0);
+  assert(pthread_mutex_lock(&static_recursive) == 0);
+  assert(pthread_mutex_unlock(&static_recursive) == 0);
+  assert(pthread_mutex_unlock(&static_recursive) == 0);
+  assert(sem_post(&recursive_done) == 0);
+}
+
+static void test_lithe()
+{
+  num_pairs = 2 * max_harts();
+  sem_init(&done, 0, 0);
+  sem_init(&recursive_done, 0, 0);
+
+  pthread_mutexattr_t attr;
+  pthread_mutexattr_init(&attr);
+  pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+  pthread_mutex_init(&recursive, &attr);
+  pthread_mutexattr_destroy(&attr);
+
+  lithe_fork_join_sched_t *sched = lithe_fork_join_sched_create();
+  lithe_sched_enter((lithe_sched_t*)sched);
+
+  /* More contexts than harts, so a call blocking its whole hart would never
+   * let the contexts it waits on run */
+  for (int i = 0; i < num_pairs; i++) {
+    lithe_fork_join_context_create(sched, 262144, consumer, NULL);
+    lithe_fork_join_context_create(sched, 262144, producer, NULL);
+  }
+  lithe_fork_join_context_create(sched, 262144, test_recursive, NULL);
+  test_timeouts();
+  test_timed_wakeups(sched);
+  for (int i = 0; i < num_pairs; i++)
+    assert(sem_wait(&done) == 0);
+  assert(sem_wait(&recursive_done) == 0);
+
+  lithe_fork_join_sched_join_all(sched);
+  lithe_sched_exit();
+  lithe_fork_join_sched_destroy(sched);
+
+  long expected = (long)num_pairs * ITEMS * (ITEMS + 1) / 2;
+  assert(consumed_sum == expected);
+  printf("%d producer/consumer pairs handed off %d items each\n",
+         num_pairs, ITEMS);
+}
+
+static pthread_mutex_t os_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t os_cond = PTHREAD_COND_INITIALIZER;
+static sem_t os_sem;
+static int os_turn;
+
+static void *os_thread(void *arg)
+{
+  pthread_mutex_lock(&os_lock);
+  while (os_turn == 0)
+    pthread_cond_wait(&os_cond, &os_lock);
+  os_turn = 0;
+  pthread_cond_signal(&os_cond);
+  pthread_mutex_unlock(&os_lock);
+
+  struct timespec ts;
+  deadline(&ts, 10);
+  assert(sem_timedwait(&os_sem, &ts) == -1 && errno == ETIMEDOUT);
+  assert(sem_post(&os_sem) == 0);
+  return NULL;
+}
+
+static void test_os_thread()
+{
+  pthread_t thread;
+  sem_init(&os_sem, 0, 0);
+  assert(pthread_create(&thread, NULL, os_thread, NULL) == 0);
+
+  pthread_mutex_lock(&os_lock);
+  os_turn = 1;
+  pthread_cond_signal(&os_cond);
+  while (os_turn == 1)
+    pthread_cond_wait(&os_cond, &os_lock);
+  pthread_mutex_unlock(&os_lock);
+
+  assert(pthread_join(thread, NULL) == 0);
+  int value;
+  assert(sem_getvalue(&os_sem, &value) == 0 && value == 1);
+  assert(sem_wait(&os_sem) == 0);
+  sem_destroy(&os_sem);
+}
+
+int main()
+{
+  printf("main start\n");
+  test_lithe();
+  test_os_thread();
+  printf("main finish\n");
+  return 0;
+}
@@ -0,0 +1,121 @@
+#include <assert.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <parlib/parlib.h>
+#include <src/lithe.h>
+#include <src/fork_join_sched.h>
+#include <src/qsbr.h>
+
+#define ROUNDS 4096
+#define READS_PER_YIELD 16
+#define LIVE 0x11
+#define DEAD 0xdd
+
+struct object {
+  volatile int state;
+};
+
+/* Never actually freed, so that a premature free shows up as a DEAD object
+ * rather than as a use after free */
+static struct object objects[ROUNDS + 1];
+static struct object *volatile shared;
+
+static int num_readers;
+static volatile long retired;
+static volatile long freed;
+static volatile bool writer_done;
+
+static void free_object(void *ptr)
+{
+  struct object *o = ptr;
+  assert(o->state == LIVE);
+  o->state = DEAD;
+  __sync_fetch_and_add(&freed, 1);
+}
+
+static void reader(void *arg)
+{
+  /* Keep reading until everything retired has been freed, which needs every
+   * hart to keep passing through quiescent states */
+  while (!writer_done || freed < retired) {
+    struct object *o = shared;
+    for (int i = 0; i < READS_PER_YIELD; i++) {
+      assert(o->state == LIVE);
+      cpu_relax();
+    }
+    assert(o->state == LIVE);
+    lithe_context_yield();
+  }
+}
+
+static void writer(void *arg)
+{
+  for (int i = 1; i <= ROUNDS; i++) {
+    struct object *old = shared;
+    objects[i].state = LIVE;
+    wmb();
+    shared = &objects[i];
+    lithe_qsbr_retire(old, free_object);
+    __sync_fetch_and_add(&retired, 1);
+    if (i % 8 == 0)
+      lithe_context_yield();
+  }
+  writer_done = true;
+}
+
+static uint64_t now_ns()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+int main()
+{
+  printf("main start\n");
+
+  objects[0].state = LIVE;
+  shared = &objects[0];
+
+  /* Hold a reference from the main context, on hart 0, before anything else
+   * has run on it */
+  struct object *held = shared;
+
+  num_readers = 2 * max_harts();
+  lithe_fork_join_sched_t *sched = lithe_fork_join_sched_create();
+  lithe_sched_enter((lithe_sched_t*)sched);
+  assert(held->state == LIVE);
+
+  lithe_fork_join_context_create(sched, 262144, writer, NULL);
+  for (int i = 0; i < num_readers; i++)
+    lithe_fork_join_context_create(sched, 262144, reader, NULL);
+
+  /* Pick up a fresh reference and hang on to it without passing through a
+   * quiescent state while the writer retires it (if it gets a hart of its
+   * own within a second) */
+  held = shared;
+  uint64_t deadline = now_ns() + 1000000000ULL;
+  long seen = retired;
+  while (retired < seen + 64 && now_ns() < deadline)
+    cpu_relax();
+  assert(held->state == LIVE);
+
+  lithe_fork_join_sched_join_all(sched);
+  lithe_sched_exit();
+  lithe_fork_join_sched_destroy(sched);
+
+  /* Every object but the one still shared was retired, and freed once the
+   * readers had yielded */
+  assert(retired == ROUNDS);
+  assert(freed == ROUNDS);
+  assert(shared->state == LIVE);
+  for (int i = 0; i < ROUNDS; i++)
+    assert(objects[i].state == DEAD);
+  printf("%d readers saw %ld objects retired and freed\n", num_readers, freed);
+
+  printf("main finish\n");
+  return 0;
+}
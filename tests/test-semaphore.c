@@ -0,0 +1,60 @@
+#include <assert.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <parlib/parlib.h>
+#include <src/lithe.h>
+#include <src/fork_join_sched.h>
+#include <src/semaphore.h>
+
+#define PERMITS 1024
+#define BATCH 8
+
+static int num_consumers;
+static lithe_sem_t items = LITHE_SEM_INITIALIZER;
+static lithe_sem_t done = LITHE_SEM_INITIALIZER;
+static int consumed;
+
+static void consumer(void *arg)
+{
+  /* Alternate between taking single permits and batches of them */
+  int count = (long) arg % 2 ? BATCH : 1;
+  for (int i = 0; i < PERMITS; i += count) {
+    lithe_sem_wait_n(&items, count);
+    __sync_fetch_and_add(&consumed, count);
+  }
+  lithe_sem_post(&done);
+}
+
+int main()
+{
+  printf("main start\n");
+
+  num_consumers = 2 * max_harts();
+  lithe_sem_init(&items, 0);
+  lithe_sem_init(&done, 0);
+
+  lithe_fork_join_sched_t *sched = lithe_fork_join_sched_create();
+  lithe_sched_enter((lithe_sched_t*)sched);
+  for (long i = 0; i < num_consumers; i++)
+    lithe_fork_join_context_create(sched, 262144, consumer, (void*)i);
+
+  /* Each consumer takes PERMITS permits in total */
+  int total = num_consumers * PERMITS;
+  for (int i = 0; i < total; i += BATCH) {
+    lithe_sem_post_n(&items, BATCH);
+    if (i % (16 * BATCH) == 0)
+      lithe_context_yield();
+  }
+  lithe_sem_wait_n(&done, num_consumers);
+  assert(consumed == total);
+  assert(lithe_sem_trywait(&items) == EAGAIN);
+  printf("%d consumers took %d permits\n", num_consumers, consumed);
+
+  lithe_fork_join_sched_join_all(sched);
+  lithe_sched_exit();
+  lithe_fork_join_sched_destroy(sched);
+  printf("main finish\n");
+  return 0;
+}
@@ -0,0 +1,76 @@
+#include <assert.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include <parlib/parlib.h>
+#include <parlib/spinlock.h>
+#include <src/lithe.hh>
+
+using namespace lithe;
+
+class TestScheduler : public StaticScheduler<TestScheduler> {
+  friend class StaticScheduler<TestScheduler>;
+
+ protected:
+  volatile int enters;
+  void hart_enter();
+
+ public:
+  TestScheduler();
+  ~TestScheduler();
+  int num_enters() const;
+};
+
+TestScheduler::TestScheduler()
+  : enters(0)
+{
+  this->main_context = new lithe_context_t();
+}
+
+TestScheduler::~TestScheduler()
+{
+  delete this->main_context;
+}
+
+int TestScheduler::num_enters() const
+{
+  return enters;
+}
+
+void TestScheduler::hart_enter()
+{
+  __sync_fetch_and_add(&enters, 1);
+  lithe_hart_request(-1);
+  lithe_hart_yield();
+}
+
+static void test_run(TestScheduler *sched)
+{
+  printf("TestScheduler Started!\n");
+  size_t limit = max_harts();
+  for(int i=0; i<100; i++) {
+    lithe_hart_request(limit - 1);
+    /* Make sure the first request actually gets us some harts */
+    if (i == 0 && limit > 1)
+      while (sched->num_enters() == 0)
+        cpu_relax();
+    while (num_harts() > 1)
+      cpu_relax();
+  }
+  printf("TestScheduler finishing!\n");
+}
+
+int main(int argc, char **argv)
+{
+  printf("CXX Lithe Static Scheduler test starting\n");
+  TestScheduler test_sched;
+  lithe_sched_enter(&test_sched);
+  test_run(&test_sched);
+  lithe_sched_exit();
+  /* Every hart granted to us was sent through hart_enter() */
+  if (max_harts() > 1)
+    assert(test_sched.num_enters() > 0);
+  printf("TestScheduler entered %d times\n", test_sched.num_enters());
+  printf("CXX Lithe Static Scheduler test finishing\n");
+  return 0;
+}
@@ -0,0 +1,98 @@
+#include <assert.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <parlib/parlib.h>
+#include <src/lithe.h>
+#include <src/fork_join_sched.h>
+#include <src/semaphore.h>
+#include <src/stats.h>
+
+#define NUM_YIELDS 10
+
+static int num_contexts;
+static lithe_sem_t sem = LITHE_SEM_INITIALIZER;
+
+static void work(void *arg)
+{
+  for (int i = 0; i < NUM_YIELDS; i++)
+    lithe_context_yield();
+
+  /* Half of the contexts wait for the other half */
+  if ((long)arg % 2)
+    lithe_sem_wait(&sem);
+  else
+    lithe_sem_post(&sem);
+}
+
+int main()
+{
+  printf("main start\n");
+
+  lithe_stats_enable();
+  num_contexts = 2 * max_harts();
+  lithe_sem_init(&sem, 0);
+
+  lithe_fork_join_sched_t *sched = lithe_fork_join_sched_create();
+  lithe_sched_enter((lithe_sched_t*)sched);
+  for (long i = 0; i < num_contexts; i++)
+    lithe_fork_join_context_create(sched, 262144, work, (void*)i);
+  lithe_fork_join_sched_join_all(sched);
+
+  lithe_fork_join_stats_t fjs;
+  int ret = lithe_fork_join_stats_snapshot(sched, &fjs);
+  assert(ret == 0);
+  lithe_stats_t *s = &fjs.sched;
+  printf("harts requested: %llu, granted: %llu, yielded: %llu\n",
+         (unsigned long long)s->harts_requested,
+         (unsigned long long)s->harts_granted,
+         (unsigned long long)s->harts_yielded);
+  printf("steals: %llu/%llu\n", (unsigned long long)fjs.steals,
+         (unsigned long long)fjs.steal_attempts);
+
+  /* Every context ran to completion, yielding along the way */
+  assert(s->harts >= 1);
+  assert(s->contexts_exited == num_contexts);
+  assert(s->contexts_yielded >= num_contexts * NUM_YIELDS);
+  assert(s->contexts_run >= s->contexts_yielded + s->contexts_exited);
+  assert(s->contexts_unblocked == s->contexts_blocked);
+  assert(s->harts_requested >= num_contexts);
+  assert(s->hart_enters > 0);
+  assert(s->context_ns > 0);
+  assert(s->sched_ns > 0);
+  assert(s->idle_ns == 0 && s->yielded_ns == 0);
+  assert(fjs.steals <= fjs.steal_attempts);
+  assert(fjs.queue_depth == 0);
+
+  /* Every unblocked context, including the main context waiting in
+   * join_all(), has run again since */
+  lithe_latency_t latency;
+  ret = lithe_stats_latency((lithe_sched_t*)sched, &latency);
+  assert(ret == 0);
+  uint64_t p50 = lithe_latency_percentile(&latency, 50);
+  uint64_t p99 = lithe_latency_percentile(&latency, 99);
+  printf("unblock to run: %llu intervals, p50 %llu ns, p99 %llu ns, max %llu ns\n",
+         (unsigned long long)latency.count, (unsigned long long)p50,
+         (unsigned long long)p99, (unsigned long long)latency.max_ns);
+  assert(latency.count == s->contexts_unblocked);
+  assert(p50 <= p99 && p99 <= latency.max_ns);
+  assert(lithe_latency_percentile(&latency, 100) == latency.max_ns);
+
+  lithe_sched_exit();
+  lithe_fork_join_sched_destroy(sched);
+
+  /* The base scheduler keeps statistics too */
+  lithe_stats_t base;
+  ret = lithe_stats_snapshot(NULL, &base);
+  assert(ret == 0);
+  printf("base: %llu ns scheduling, %llu ns idle, %llu ns yielded\n",
+         (unsigned long long)base.sched_ns, (unsigned long long)base.idle_ns,
+         (unsigned long long)base.yielded_ns);
+  assert(base.harts >= 1);
+  assert(lithe_stats_snapshot(NULL, NULL) == EINVAL);
+  assert(lithe_stats_latency(NULL, NULL) == EINVAL);
+
+  printf("main finish\n");
+  return 0;
+}
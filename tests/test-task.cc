@@ -0,0 +1,125 @@
+#include <assert.h>
+#include <stdio.h>
+
+#include <parlib/parlib.h>
+#include <src/lithe.hh>
+#include <src/fork_join_sched.h>
+#include <src/executor.hh>
+#include <src/task.hh>
+#include <src/chan.h>
+
+#if defined(__cpp_impl_coroutine) && __has_include(<coroutine>)
+
+using namespace lithe;
+
+#define NUM_TASKS 1000
+#define NUM_INCREMENTS 10
+#define NUM_RECEIVERS 16
+#define NUM_MESSAGES 10000
+
+static Mutex mutex;
+static int counter;
+
+static task<int> increment(Executor &ex)
+{
+  co_await mutex.lock(ex);
+  int value = ++counter;
+  mutex.unlock();
+  co_await yield(ex);
+  co_return value;
+}
+
+static task<void> worker(Executor &ex)
+{
+  for (int i = 0; i < NUM_INCREMENTS; i++) {
+    int value = co_await increment(ex);
+    assert(value > 0);
+  }
+}
+
+static task<void> parent(Executor &ex)
+{
+  JoinHandle child = spawn(ex, worker(ex));
+  co_await child;
+}
+
+/* Receivers share a tiny channel with the main context, so both sides keep
+ * having to wait on each other */
+static lithe_chan_t chan;
+static long received_sum;
+
+static task<void> receiver(Executor &ex)
+{
+  void *msg;
+  long sum = 0;
+  while (co_await chan_recv(chan, &msg, ex) == 0)
+    sum += (long)msg;
+  __sync_fetch_and_add(&received_sum, sum);
+}
+
+static task<void> sender(Executor &ex)
+{
+  for (long i = 1; i <= NUM_MESSAGES; i++) {
+    int ret = co_await chan_send(chan, (void*)i, ex);
+    assert(ret == 0);
+  }
+}
+
+static void test_chan(Executor &ex)
+{
+  lithe_chan_init(&chan, 2);
+  JoinHandle *handles[NUM_RECEIVERS];
+  for (int i = 0; i < NUM_RECEIVERS; i++)
+    handles[i] = new JoinHandle(spawn(ex, receiver(ex)));
+
+  /* One sender is a task, the other the (stackful) main context */
+  JoinHandle task_sender = spawn(ex, sender(ex));
+  for (long i = 1; i <= NUM_MESSAGES; i++)
+    assert(lithe_chan_send(&chan, (void*)i) == 0);
+  task_sender.join();
+
+  /* Closing the channel wakes up every receiver still waiting */
+  lithe_chan_close(&chan);
+  for (int i = 0; i < NUM_RECEIVERS; i++) {
+    handles[i]->join();
+    delete handles[i];
+  }
+  assert(received_sum == (long)NUM_MESSAGES * (NUM_MESSAGES + 1));
+  assert(lithe_chan_destroy(&chan) == 0);
+  printf("%d tasks received %d messages\n", NUM_RECEIVERS, 2 * NUM_MESSAGES);
+}
+
+int main()
+{
+  printf("main start\n");
+  lithe_fork_join_sched_t *sched = lithe_fork_join_sched_create();
+  lithe_sched_enter((lithe_sched_t*)sched);
+  {
+    Executor ex(sched);
+    JoinHandle *handles[NUM_TASKS];
+    for (int i = 0; i < NUM_TASKS; i++)
+      handles[i] = new JoinHandle(spawn(ex, parent(ex)));
+    for (int i = 0; i < NUM_TASKS; i++) {
+      handles[i]->join();
+      delete handles[i];
+    }
+    assert(counter == NUM_TASKS * NUM_INCREMENTS);
+    printf("%d tasks incremented the counter to %d\n", NUM_TASKS, counter);
+    test_chan(ex);
+  }
+  lithe_fork_join_sched_join_all(sched);
+  lithe_sched_exit();
+  lithe_fork_join_sched_destroy(sched);
+  printf("main finish\n");
+  return 0;
+}
+
+#else
+
+int main()
+{
+  printf("coroutines not supported by this compiler, skipping\n");
+  return 0;
+}
+
+#endif
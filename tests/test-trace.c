@@ -0,0 +1,157 @@
+#include <assert.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <parlib/parlib.h>
+#include <src/lithe.h>
+#include <src/fork_join_sched.h>
+#include <src/trace.h>
+
+#define NUM_YIELDS 10
+
+/* Built as test_trace against the library as configured, which skips
+ * everything unless lithe was configured with --enable-trace, and as
+ * test_trace_traced (with LITHE_TRACE defined) against a build of the library
+ * with the tracer always compiled in. */
+
+static void work(void *arg)
+{
+  for (int i = 0; i < NUM_YIELDS; i++)
+    lithe_context_yield();
+}
+
+/* Convert the dump at 'path' with the lithe-trace tool, from the build
+ * directory 'make check' runs tests in unless LITHE_TRACE_TOOL says otherwise,
+ * and check that every hart's context slices begin and end in pairs. */
+static void check_converted(const char *path, int nharts, int nruns)
+{
+  const char *tool = getenv("LITHE_TRACE_TOOL");
+  if (tool == NULL)
+    tool = "./lithe-trace";
+  if (access(tool, X_OK) != 0) {
+#ifdef LITHE_TRACE
+    fprintf(stderr, "%s not found\n", tool);
+    abort();
+#endif
+    printf("%s not found, not converting the trace\n", tool);
+    return;
+  }
+
+  char cmd[512];
+  snprintf(cmd, sizeof(cmd), "%s %s", tool, path);
+  FILE *json = popen(cmd, "r");
+  assert(json);
+
+  /* The tool writes every record on a line of its own */
+  int open_slices[nharts];
+  memset(open_slices, 0, sizeof(open_slices));
+  int begins = 0;
+  char line[1024];
+  assert(fgets(line, sizeof(line), json));
+  assert(strncmp(line, "{\"displayTimeUnit\"", 18) == 0);
+  while (fgets(line, sizeof(line), json)) {
+    const char *ph = strstr(line, "\"ph\": \"");
+    const char *tid = strstr(line, "\"tid\": ");
+    if (ph == NULL || tid == NULL)
+      continue;
+    int hart = atoi(tid + strlen("\"tid\": "));
+    assert(hart >= 0 && hart < nharts);
+    switch (ph[strlen("\"ph\": \"")]) {
+      case 'B':
+        assert(open_slices[hart] == 0);
+        open_slices[hart]++;
+        begins++;
+        break;
+      case 'E':
+        assert(open_slices[hart] == 1);
+        open_slices[hart]--;
+        break;
+    }
+  }
+  assert(strcmp(line, "]}\n") == 0);
+  assert(pclose(json) == 0);
+
+  for (int i = 0; i < nharts; i++)
+    assert(open_slices[i] == 0);
+  assert(begins == nruns);
+  printf("lithe-trace converted %d context slices\n", begins);
+}
+
+int main()
+{
+  printf("main start\n");
+
+  int ret = lithe_trace_start();
+#ifdef LITHE_TRACE
+  assert(ret != ENOTSUP);
+#endif
+  if (ret == ENOTSUP) {
+    printf("lithe built without tracing, skipping\n");
+    printf("main finish\n");
+    return 0;
+  }
+  assert(ret == 0);
+
+  int num_contexts = 2 * max_harts();
+  lithe_fork_join_sched_t *sched = lithe_fork_join_sched_create();
+  lithe_sched_enter((lithe_sched_t*)sched);
+  for (long i = 0; i < num_contexts; i++)
+    lithe_fork_join_context_create(sched, 262144, work, NULL);
+  lithe_fork_join_sched_join_all(sched);
+  lithe_sched_exit();
+  lithe_fork_join_sched_destroy(sched);
+  lithe_trace_stop();
+
+  char path[] = "/tmp/lithe-trace-XXXXXX";
+  int fd = mkstemp(path);
+  assert(fd >= 0);
+  close(fd);
+  ret = lithe_trace_dump(path);
+  assert(ret == 0);
+
+  /* Read the dump back in and count what we saw */
+  FILE *f = fopen(path, "rb");
+  assert(f);
+  struct lithe_trace_header header;
+  ret = fread(&header, sizeof(header), 1, f);
+  assert(ret == 1);
+  assert(memcmp(header.magic, LITHE_TRACE_MAGIC, sizeof(header.magic)) == 0);
+  assert(header.version == LITHE_TRACE_VERSION);
+  assert(header.nharts == max_harts());
+
+  int counts[LITHE_TRACE_NUM_EVENTS] = {0};
+  for (int i = 0; i < header.nharts; i++) {
+    struct lithe_trace_hart hart;
+    ret = fread(&hart, sizeof(hart), 1, f);
+    assert(ret == 1);
+    assert(hart.hart == i);
+    assert(hart.lost == 0);
+
+    uint64_t last = 0;
+    for (uint64_t j = 0; j < hart.nevents; j++) {
+      struct lithe_trace_event e;
+      ret = fread(&e, sizeof(e), 1, f);
+      assert(ret == 1);
+      assert(e.type < LITHE_TRACE_NUM_EVENTS);
+      assert(e.hart == i);
+      assert(e.time >= last);
+      last = e.time;
+      counts[e.type]++;
+    }
+  }
+  fclose(f);
+  check_converted(path, header.nharts, counts[LITHE_TRACE_CONTEXT_RUN]);
+  unlink(path);
+
+  assert(counts[LITHE_TRACE_SCHED_ENTER] == 1);
+  assert(counts[LITHE_TRACE_SCHED_EXIT] == 1);
+  assert(counts[LITHE_TRACE_CONTEXT_EXIT] == num_contexts);
+  assert(counts[LITHE_TRACE_CONTEXT_YIELD] >= num_contexts * NUM_YIELDS);
+  assert(counts[LITHE_TRACE_CONTEXT_RUN] >= num_contexts * (NUM_YIELDS + 1));
+
+  printf("main finish\n");
+  return 0;
+}
@@ -0,0 +1,106 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <parlib/parlib.h>
+#include <parlib/spinlock.h>
+#include <src/lithe.h>
+#include <src/fork_join_sched.h>
+
+/* Every other context blocks again as soon as it is woken up, ROUNDS times
+ * over, so contexts keep re-blocking while the rest of their batch is still
+ * being queued */
+#define ROUNDS 50
+
+static int num_contexts;
+static int total_blocks;
+static volatile int wakeups;
+static int *woken;
+
+static spin_pdr_lock_t lock;
+static lithe_context_t **blocked;
+static volatile int nblocked;
+
+static void publish_blocked(lithe_context_t *context, void *arg)
+{
+  spin_pdr_lock(&lock);
+  blocked[nblocked++] = context;
+  spin_pdr_unlock(&lock);
+}
+
+static void work(void *arg)
+{
+  long i = (long)arg;
+  int rounds = i % 2 ? ROUNDS : 1;
+  for (int r = 0; r < rounds; r++) {
+    lithe_context_block(publish_blocked, NULL);
+    __sync_fetch_and_add(&woken[i], 1);
+    __sync_fetch_and_add(&wakeups, 1);
+  }
+}
+
+/* Take everything blocked so far and unblock it in one go */
+static int unblock_all(lithe_context_t **batch)
+{
+  spin_pdr_lock(&lock);
+  int n = nblocked;
+  for (int i = 0; i < n; i++)
+    batch[i] = blocked[i];
+  nblocked = 0;
+  spin_pdr_unlock(&lock);
+
+  lithe_context_unblock_many(batch, n);
+  return n;
+}
+
+int main()
+{
+  printf("main start\n");
+
+  /* Well over the batch sizes used elsewhere in lithe */
+  num_contexts = 64 * max_harts() + 100;
+  total_blocks = 0;
+  for (int i = 0; i < num_contexts; i++)
+    total_blocks += i % 2 ? ROUNDS : 1;
+  woken = calloc(num_contexts, sizeof(int));
+  blocked = malloc(num_contexts * sizeof(lithe_context_t*));
+  lithe_context_t **batch = malloc(num_contexts * sizeof(lithe_context_t*));
+  assert(woken && blocked && batch);
+  spin_pdr_init(&lock);
+
+  lithe_fork_join_sched_t *sched = lithe_fork_join_sched_create();
+  lithe_sched_enter((lithe_sched_t*)sched);
+  for (long i = 0; i < num_contexts; i++)
+    lithe_fork_join_context_create(sched, 65536, work, (void*)i);
+
+  /* Start with one batch of every context */
+  while (nblocked < num_contexts)
+    lithe_context_yield();
+  int largest = unblock_all(batch);
+  assert(largest == num_contexts);
+
+  /* Then keep waking whoever has blocked again, while the others run */
+  int batches = 1;
+  while (wakeups < total_blocks) {
+    if (unblock_all(batch) > 0)
+      batches++;
+    lithe_context_yield();
+  }
+
+  lithe_fork_join_sched_join_all(sched);
+  lithe_sched_exit();
+  lithe_fork_join_sched_destroy(sched);
+
+  assert(nblocked == 0);
+  assert(wakeups == total_blocks);
+  for (int i = 0; i < num_contexts; i++)
+    assert(woken[i] == (i % 2 ? ROUNDS : 1));
+  printf("%d contexts woken %d times in %d batches\n", num_contexts, wakeups,
+         batches);
+
+  free(batch);
+  free(blocked);
+  free(woken);
+  printf("main finish\n");
+  return 0;
+}
@@ -0,0 +1,53 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <parlib/parlib.h>
+#include <src/lithe.h>
+#include <src/fork_join_sched.h>
+#include <src/waitgroup.h>
+#include <src/latch.h>
+
+static int num_contexts;
+static int work_done;
+static int arrived;
+static lithe_waitgroup_t wg;
+static lithe_latch_t latch;
+
+static void work(void *arg)
+{
+  __sync_fetch_and_add(&work_done, 1);
+  lithe_waitgroup_done(&wg);
+
+  /* Nobody gets past the latch before everyone has arrived */
+  __sync_fetch_and_add(&arrived, 1);
+  lithe_latch_arrive_and_wait(&latch, 1);
+  assert(arrived == num_contexts);
+  assert(lithe_latch_try_wait(&latch));
+}
+
+int main()
+{
+  printf("main start\n");
+
+  /* Use more contexts than harts, so some of them have to block */
+  num_contexts = 2 * max_harts();
+  lithe_waitgroup_init(&wg);
+  lithe_latch_init(&latch, num_contexts);
+
+  lithe_fork_join_sched_t *sched = lithe_fork_join_sched_create();
+  lithe_sched_enter((lithe_sched_t*)sched);
+  lithe_waitgroup_add(&wg, num_contexts);
+  for (int i = 0; i < num_contexts; i++)
+    lithe_fork_join_context_create(sched, 262144, work, NULL);
+  lithe_waitgroup_wait(&wg);
+  assert(work_done == num_contexts);
+  printf("waitgroup released after %d contexts\n", work_done);
+
+  lithe_latch_wait(&latch);
+  lithe_fork_join_sched_join_all(sched);
+  lithe_sched_exit();
+  lithe_fork_join_sched_destroy(sched);
+  printf("main finish\n");
+  return 0;
+}
@@ -0,0 +1,165 @@
+/**
+ * Convert a lithe trace dump (see src/trace.h) to the Chrome trace event
+ * format, which can be loaded into chrome://tracing or Perfetto.
+ *
+ * Every hart becomes a thread track. The time a context spends running on a
+ * hart is shown as a slice named after the context, and every other event as
+ * an instant on the hart it happened on.
+ *
+ * Usage: lithe-trace <dump> [<output.json>]
+ */
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <src/trace.h>
+
+static const struct {
+  const char *name;
+  const char *arg0;
+  const char *arg1;
+} events[] = {
+#define __LITHE_TRACE_INFO(name, arg0, arg1) { #name, arg0, arg1 },
+  LITHE_TRACE_EVENTS(__LITHE_TRACE_INFO)
+#undef __LITHE_TRACE_INFO
+};
+
+static FILE *out;
+static bool first_record = true;
+
+static void begin_record()
+{
+  fprintf(out, first_record ? "\n  " : ",\n  ");
+  first_record = false;
+}
+
+/* Schedulers are addresses, so print those in hex */
+static void print_arg(const char *name, uint64_t value)
+{
+  if (strcmp(name, "sched") == 0 || strcmp(name, "parent") == 0)
+    fprintf(out, "\"%s\": \"0x%" PRIx64 "\"", name, value);
+  else
+    fprintf(out, "\"%s\": %" PRId64, name, (int64_t)value);
+}
+
+/* Events recorded from a running context, rather than after it stopped */
+static bool in_context(uint32_t type)
+{
+  return type == LITHE_TRACE_HART_REQUEST ||
+         type == LITHE_TRACE_CONTEXT_UNBLOCK ||
+         type == LITHE_TRACE_VCORE_REQUEST;
+}
+
+static void convert_hart(struct lithe_trace_hart *hart,
+                         struct lithe_trace_event *e, uint64_t t0)
+{
+  begin_record();
+  fprintf(out, "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 0, "
+               "\"tid\": %u, \"args\": {\"name\": \"hart %u\"}}",
+          hart->hart, hart->hart);
+
+  bool running = false;
+  for (uint64_t i = 0; i < hart->nevents; i++, e++) {
+    if (e->type >= LITHE_TRACE_NUM_EVENTS)
+      continue;
+    double ts = (e->time - t0) / 1000.0;
+
+    /* A context stops running whenever its hart drops into the runtime */
+    if (running && !in_context(e->type)) {
+      begin_record();
+      fprintf(out, "{\"ph\": \"E\", \"pid\": 0, \"tid\": %u, \"ts\": %.3f}",
+              hart->hart, ts);
+      running = false;
+    }
+
+    begin_record();
+    if (e->type == LITHE_TRACE_CONTEXT_RUN) {
+      fprintf(out, "{\"name\": \"context %" PRId64 "\", \"ph\": \"B\", ",
+              (int64_t)e->arg0);
+      running = true;
+    }
+    else {
+      fprintf(out, "{\"name\": \"%s\", \"ph\": \"i\", \"s\": \"t\", ",
+              events[e->type].name);
+    }
+    fprintf(out, "\"pid\": 0, \"tid\": %u, \"ts\": %.3f, \"args\": {",
+            hart->hart, ts);
+    print_arg(events[e->type].arg0, e->arg0);
+    fprintf(out, ", ");
+    print_arg(events[e->type].arg1, e->arg1);
+    fprintf(out, "}}");
+  }
+
+  /* Close a context still running when the trace was taken */
+  if (running && hart->nevents) {
+    begin_record();
+    fprintf(out, "{\"ph\": \"E\", \"pid\": 0, \"tid\": %u, \"ts\": %.3f}",
+            hart->hart, ((e - 1)->time - t0) / 1000.0);
+  }
+}
+
+int main(int argc, char **argv)
+{
+  if (argc < 2 || argc > 3) {
+    fprintf(stderr, "usage: %s <dump> [<output.json>]\n", argv[0]);
+    return 1;
+  }
+
+  FILE *in = fopen(argv[1], "rb");
+  if (in == NULL) {
+    perror(argv[1]);
+    return 1;
+  }
+
+  struct lithe_trace_header header;
+  if (fread(&header, sizeof(header), 1, in) != 1 ||
+      memcmp(header.magic, LITHE_TRACE_MAGIC, sizeof(header.magic)) != 0 ||
+      header.version != LITHE_TRACE_VERSION) {
+    fprintf(stderr, "%s: not a lithe trace (version %d)\n", argv[1],
+            LITHE_TRACE_VERSION);
+    return 1;
+  }
+
+  /* Read in every hart's events up front, to find the earliest timestamp */
+  struct lithe_trace_hart *harts = calloc(header.nharts, sizeof(*harts));
+  struct lithe_trace_event **hart_events = calloc(header.nharts, sizeof(*hart_events));
+  uint64_t t0 = UINT64_MAX;
+  for (uint32_t i = 0; i < header.nharts; i++) {
+    if (fread(&harts[i], sizeof(harts[i]), 1, in) != 1) {
+      fprintf(stderr, "%s: truncated trace\n", argv[1]);
+      return 1;
+    }
+    hart_events[i] = malloc(sizeof(struct lithe_trace_event) * (harts[i].nevents + 1));
+    if (fread(hart_events[i], sizeof(struct lithe_trace_event),
+              harts[i].nevents, in) != harts[i].nevents) {
+      fprintf(stderr, "%s: truncated trace\n", argv[1]);
+      return 1;
+    }
+    if (harts[i].nevents && hart_events[i][0].time < t0)
+      t0 = hart_events[i][0].time;
+    if (harts[i].lost)
+      fprintf(stderr, "hart %u: %u events lost to ring buffer wrap-around\n",
+              harts[i].hart, harts[i].lost);
+  }
+  fclose(in);
+
+  out = argc == 3 ? fopen(argv[2], "w") : stdout;
+  if (out == NULL) {
+    perror(argv[2]);
+    return 1;
+  }
+
+  fprintf(out, "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [");
+  for (uint32_t i = 0; i < header.nharts; i++) {
+    convert_hart(&harts[i], hart_events[i], t0);
+    free(hart_events[i]);
+  }
+  fprintf(out, "\n]}\n");
+
+  free(hart_events);
+  free(harts);
+  return fclose(out) == 0 ? 0 : 1;
+}